@@ -1,5 +1,52 @@
 #include "AST.h"
 
+namespace {
+	/**
+	* Moves the expressions that `expression` owns onto `operands`, so that deleting it doesn't delete them.
+	*/
+	void detach_operands(ASTExpression* expression, std::vector<ASTExpression*>& operands) {
+		auto detach = [&](ASTExpression*& operand) {
+			if (operand) {
+				operands.push_back(operand);
+				operand = nullptr;
+			}
+		};
+
+		if (auto unary = dynamic_cast<ASTUnaryOp*>(expression)) {
+			detach(unary->right);
+		} else if (auto binary = dynamic_cast<ASTBinaryOp*>(expression)) {
+			detach(binary->left);
+			detach(binary->right);
+		} else if (auto cast = dynamic_cast<ASTCast*>(expression)) {
+			detach(cast->original);
+		} else if (auto call = dynamic_cast<ASTFunctionCall*>(expression)) {
+			detach(call->func);
+			for (auto& arg : call->args) {
+				detach(arg);
+			}
+			call->args.clear();
+		} else if (auto member = dynamic_cast<ASTStructMemberRef*>(expression)) {
+			detach(member->structure);
+		}
+	}
+
+	/**
+	* Deletes the expressions that `expression` owns. Machine-generated expressions like "a + b + c + ..." or
+	* "- - - a" are too deep to delete recursively, so they're taken apart and deleted one node at a time.
+	*/
+	void delete_operands(ASTExpression* expression) {
+		std::vector<ASTExpression*> operands;
+		detach_operands(expression, operands);
+
+		while (!operands.empty()) {
+			auto operand = operands.back();
+			operands.pop_back();
+			detach_operands(operand, operands);
+			delete operand;
+		}
+	}
+}
+
 void ASTNode::print(int indentation) {
 	printf("%*snode\n", indentation * 2, "");
 }
@@ -113,7 +160,7 @@ const void* ASTStructMemberRef::accept(ASTNodeVisitor* visitor) {
 }
 
 ASTStructMemberRef::~ASTStructMemberRef() {
-	delete structure;
+	delete_operands(this);
 }
 
 void ASTFloatingPoint::print(int indentation) {
@@ -150,7 +197,7 @@ const void* ASTUnaryOp::accept(ASTNodeVisitor* visitor) {
 }
 
 ASTUnaryOp::~ASTUnaryOp() {
-	delete right;
+	delete_operands(this);
 }
 
 void ASTBinaryOp::print(int indentation) {
@@ -164,8 +211,7 @@ const void* ASTBinaryOp::accept(ASTNodeVisitor* visitor) {
 }
 
 ASTBinaryOp::~ASTBinaryOp() {
-	delete left;
-	delete right;
+	delete_operands(this);
 }
 
 void ASTReturn::print(int indentation) {
@@ -218,10 +264,7 @@ const void* ASTFunctionCall::accept(ASTNodeVisitor* visitor) {
 }
 
 ASTFunctionCall::~ASTFunctionCall() {
-	delete func;
-	for (ASTExpression* exp : args) {
-		delete exp;
-	}
+	delete_operands(this);
 }
 
 void ASTCast::print(int indentation) {
@@ -234,7 +277,7 @@ const void* ASTCast::accept(ASTNodeVisitor* visitor) {
 }
 
 ASTCast::~ASTCast() {
-	delete original;
+	delete_operands(this);
 }
 
 void ASTCondition::print(int indentation) {
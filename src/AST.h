@@ -6,6 +6,7 @@
 #include <list>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 
 class ASTNodeVisitor;
 
@@ -70,9 +71,9 @@ struct ASTFunctionRef : ASTExpression {
 
 struct ASTFunctionProto : ASTNode {
 	C3FunctionPtr func;
-	std::vector<std::string> arg_names;
+	std::vector<Symbol> arg_names;
 
-	ASTFunctionProto(C3FunctionPtr func, const std::vector<std::string>& arg_names) : func(func), arg_names(arg_names) {}
+	ASTFunctionProto(C3FunctionPtr func, const std::vector<Symbol>& arg_names) : func(func), arg_names(arg_names) {}
 	virtual void print(int indentation = 0);
 	virtual const void* accept(ASTNodeVisitor* visitor);
 	virtual ~ASTFunctionProto() {}
@@ -81,9 +82,9 @@ struct ASTFunctionProto : ASTNode {
 struct ASTFunctionDef : ASTNode {
 	ASTFunctionProto* proto;
 	ASTSequence* body;
-	std::string arg_prefix;
+	Symbol arg_prefix;
 
-	ASTFunctionDef(ASTFunctionProto* proto, ASTSequence* body, const std::string& arg_prefix) : proto(proto), body(body), arg_prefix(arg_prefix) {}
+	ASTFunctionDef(ASTFunctionProto* proto, ASTSequence* body, Symbol arg_prefix) : proto(proto), body(body), arg_prefix(arg_prefix) {}
 	virtual void print(int indentation = 0);
 	virtual const void* accept(ASTNodeVisitor* visitor);
 	virtual ~ASTFunctionDef();
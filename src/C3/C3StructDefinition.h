@@ -1,6 +1,7 @@
 #pragma once
 
 #include "C3TypePtr.h"
+#include "../Symbol.h"
 
 #include <vector>
 #include <string>
@@ -8,9 +9,9 @@
 class C3StructDefinition {
 	public:
 		struct MemberVariable {
-			MemberVariable(std::string name, C3TypePtr type) : name(name), type(type) {}
+			MemberVariable(Symbol name, C3TypePtr type) : name(name), type(type) {}
 
-			std::string name;
+			Symbol name;
 			C3TypePtr type;
 		};
 	
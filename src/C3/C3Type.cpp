@@ -2,7 +2,20 @@
 
 #include <assert.h>
 
-C3Type::C3Type(const std::string& name, const std::string& global_name, C3TypeType type) : _name(name), _global_name(global_name), _type(type) {
+#include <mutex>
+
+namespace {
+	/**
+	* Guards the pointer and reference types that are made on demand, since functions can be parsed on several
+	* threads at once.
+	*/
+	std::mutex& derived_types_mutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+}
+
+C3Type::C3Type(const std::string& name, Symbol global_name, C3TypeType type) : _name(name), _global_name(global_name), _type(type) {
 }
 
 C3Type::C3Type(const std::string& name, C3TypeType type) : _name(name), _global_name(name), _type(type) {
@@ -112,6 +125,7 @@ bool C3Type::operator!=(const C3Type& right) const {
 }
 
 C3TypePtr C3Type::PointerType(C3TypePtr type) {
+	std::lock_guard<std::mutex> lock(derived_types_mutex());
 	if (!type->_pointer) {
 		type->_pointer = C3TypePtr(new C3Type(type->name() + "*", C3TypeTypePointer, type));
 	}
@@ -119,6 +133,7 @@ C3TypePtr C3Type::PointerType(C3TypePtr type) {
 }
 
 C3TypePtr C3Type::ReferenceType(C3TypePtr type) {
+	std::lock_guard<std::mutex> lock(derived_types_mutex());
 	if (!type->_reference) {
 		type->_reference = C3TypePtr(new C3Type(type->name() + "&", C3TypeTypeReference, type));
 	}
@@ -149,14 +164,19 @@ C3TypePtr C3Type::FunctionType(const C3FunctionSignature& signature) {
 	return C3TypePtr(new C3Type(signature));
 }
 
-C3TypePtr C3Type::StructType(const std::string& name, const std::string& global_name, const C3StructDefinition& definition) {
+C3TypePtr C3Type::StructType(const std::string& name, Symbol global_name, const C3StructDefinition& definition) {
 	auto type = C3TypePtr(new C3Type(name, global_name, C3TypeTypeStruct));
 	type->define(definition);
 	return type;
 }
 
 C3TypePtr C3Type::ModifiedType(C3TypePtr type, int modifiers) {
+	std::unique_lock<std::mutex> lock(derived_types_mutex());
 	auto ret = C3TypePtr(new C3Type(*type));
+	// the copy's pointer and reference types have to point to the copy
+	ret->_pointer = nullptr;
+	ret->_reference = nullptr;
+	lock.unlock();
 	ret->set_modifiers(modifiers);
 	return ret;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../Symbol.h"
+
 #include <string>
 #include <memory>
 
@@ -34,7 +36,7 @@ class C3Type;
 class C3Type {
 	public:
 		std::string name() const;
-		const std::string& global_name() const { return _global_name; }
+		Symbol global_name() const { return _global_name; }
 		C3TypeType type() const { return _type; }
 		size_t size() const;
 
@@ -63,7 +65,7 @@ class C3Type {
 		static C3TypePtr PointerType(C3TypePtr type);
 		static C3TypePtr ReferenceType(C3TypePtr type);
 		static C3TypePtr FunctionType(const C3FunctionSignature& signature);
-		static C3TypePtr StructType(const std::string& name, const std::string& global_name, const C3StructDefinition& definition);
+		static C3TypePtr StructType(const std::string& name, Symbol global_name, const C3StructDefinition& definition);
 		static C3TypePtr ModifiedType(C3TypePtr type, int modifiers);
 		static C3TypePtr AutoType();
 		static C3TypePtr VoidType();
@@ -77,13 +79,13 @@ class C3Type {
 		static C3TypePtr RemoveReference(C3TypePtr type);
 
 	private:
-		C3Type(const std::string& name, const std::string& global_name, C3TypeType type);
+		C3Type(const std::string& name, Symbol global_name, C3TypeType type);
 		C3Type(const std::string& name, C3TypeType type);
 		C3Type(const std::string& name, C3TypeType type, C3TypePtr pointed_to_or_referenced);
 		C3Type(const C3FunctionSignature& signature);
 
 		std::string _name;
-		std::string _global_name;
+		Symbol _global_name;
 		C3TypeType _type;
 		
 		int _modifiers = 0;
@@ -1,29 +1,30 @@
 #pragma once
 
 #include "C3Type.h"
-#include "../Token.h"
+#include "../SourceLocation.h"
+#include "../Symbol.h"
 
 #include <string>
 #include <memory>
 
 class C3Variable {
 	public:
-		C3Variable(C3TypePtr type, const std::string& name, const std::string& global_name, TokenPtr declaration, bool is_static = false)
+		C3Variable(C3TypePtr type, Symbol name, Symbol global_name, SourceLocation declaration, bool is_static = false)
 			: _type(type), _name(name), _global_name(global_name), _declaration(declaration), _is_static(is_static)
 		{}
 
 		C3TypePtr type() { return _type; }
-		const std::string& name() { return _name; }
-		const std::string& global_name() { return _global_name; }
-		TokenPtr declaration() { return _declaration; }
+		Symbol name() { return _name; }
+		Symbol global_name() { return _global_name; }
+		SourceLocation declaration() { return _declaration; }
 			
 		bool is_static() { return _is_static; }
 
 	private:
 		C3TypePtr _type;
-		std::string _name;
-		std::string _global_name;
-		TokenPtr _declaration;
+		Symbol _name;
+		Symbol _global_name;
+		SourceLocation _declaration;
 
 		bool _is_static = false;
 };
@@ -0,0 +1,26 @@
+#include "DependencyScanner.h"
+
+void scan_dependencies(LexedFile& file, std::vector<std::string>& includes, std::vector<std::string>& imports) {
+	auto& tokens = file.tokens();
+	const char* contents = file.contents();
+
+	for (size_t i = 0; i + 2 < tokens.size(); ++i) {
+		auto& first = tokens[i];
+		auto& second = tokens[i + 1];
+		auto& third = tokens[i + 2];
+
+		if ((first.flags & TokenFlagLineFirst) && first.kind == TokenKindHash) {
+			// #include "filename"
+			if (second.flags & TokenFlagLineFirst || second.type != TokenTypeIdentifier || std::string(contents + second.location, second.length) != "include") {
+				continue;
+			}
+			if (third.flags & TokenFlagLineFirst || third.type != TokenTypeStringLiteral || third.length < 2) {
+				continue;
+			}
+			includes.emplace_back(contents + third.location + 1, third.length - 2);
+		} else if (first.kind == TokenKindKeywordImport && second.type == TokenTypeIdentifier && second.kind == TokenKindNone) {
+			// import name;
+			imports.emplace_back(contents + second.location, second.length);
+		}
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "LexedFile.h"
+
+#include <string>
+#include <vector>
+
+/**
+* Finds the names that a lexed file includes or imports by looking for the directives' token patterns, without
+* preprocessing or parsing it. The results are only good for loading files ahead of time: a file might be found
+* that isn't actually used.
+*/
+void scan_dependencies(LexedFile& file, std::vector<std::string>& includes, std::vector<std::string>& imports);
@@ -0,0 +1,20 @@
+#include "FileSystemCache.h"
+
+#include <sys/stat.h>
+
+bool FileSystemCache::is_file(const std::string& path) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _is_file.find(path);
+		if (it != _is_file.end()) {
+			return it->second;
+		}
+	}
+
+	struct stat st;
+	bool is_file = !stat(path.c_str(), &st) && S_ISREG(st.st_mode);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_is_file[path] = is_file;
+	return is_file;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+* Answers whether regular files exist, remembering the answers so that searching the same directories for the same
+* names doesn't keep hitting the filesystem. Misses are remembered too, since most of a search is misses. Files are
+* assumed not to come or go during a compilation. Thread-safe.
+*/
+class FileSystemCache {
+	public:
+		bool is_file(const std::string& path);
+
+	private:
+		std::mutex _mutex;
+		std::unordered_map<std::string, bool> _is_file;
+};
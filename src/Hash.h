@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+* murmur3's finalizer.
+*/
+inline uint64_t hash_mix(uint64_t hash) {
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	return hash ^ (hash >> 33);
+}
+
+/**
+* Hashes bytes a word at a time, which is quick for long identifiers and qualified names as well as whole files.
+*/
+inline uint64_t hash_bytes(const char* data, size_t size) {
+	uint64_t hash = size * 0x9e3779b97f4a7c15ULL;
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = hash_mix(hash ^ word);
+	}
+
+	if (i < size) {
+		uint64_t word = 0;
+		memcpy(&word, data + i, size - i);
+		hash = hash_mix(hash ^ word);
+	}
+
+	return hash;
+}
@@ -19,8 +19,15 @@ LLVMCodeGenerator::~LLVMCodeGenerator() {
 }
 
 bool LLVMCodeGenerator::build_ir(ASTNode* ast) {
-	ast->accept(this);
+	add_ir(ast);
+	return finish_ir();
+}
+
+void LLVMCodeGenerator::add_ir(ASTNode* node) {
+	node->accept(this);
+}
 
+bool LLVMCodeGenerator::finish_ir() {
 	_module->dump();
 
 	return !llvm::verifyModule(*_module, llvm::PrintMessageAction); // verifyModule returns false on success
@@ -112,7 +119,7 @@ const void* LLVMCodeGenerator::visit(ASTVariableDec* node) {
 }
 
 const void* LLVMCodeGenerator::visit(ASTFunctionRef* node) {
-	llvm::Value* v = _module->getFunction(node->func->global_name());
+	llvm::Value* v = _module->getFunction(node->func->global_name().str());
 	assert(v);
 	return v;
 }
@@ -123,7 +130,7 @@ const void* LLVMCodeGenerator::visit(ASTFunctionProto* node) {
 		arg_types.push_back(_llvm_type(type));
 	}
 
-	const std::string& name = node->func->global_name();
+	const std::string& name = node->func->global_name().str();
 
 	llvm::FunctionType* ft = llvm::FunctionType::get(_llvm_type(node->func->return_type()), arg_types, false);
 	llvm::Function* f = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, name, _module);
@@ -143,7 +150,7 @@ const void* LLVMCodeGenerator::visit(ASTFunctionDef* node) {
 	// set names
 	size_t i = 0;
 	for (llvm::Function::arg_iterator ai = function->arg_begin(); ai != function->arg_end(); ++ai) {
-		ai->setName(node->proto->arg_names[i]);
+		ai->setName(node->proto->arg_names[i].str());
 		++i;
 	}
 
@@ -157,8 +164,9 @@ const void* LLVMCodeGenerator::visit(ASTFunctionDef* node) {
 	// TODO: make sure llvm can optimize the unnecessary copies out?
 	i = 0;
 	for (llvm::Function::arg_iterator ai = function->arg_begin(); ai != function->arg_end(); ++ai) {
-		llvm::AllocaInst* alloca = _builder.CreateAlloca(ai->getType(), 0, node->arg_prefix + node->proto->arg_names[i]);
-		_named_values[node->arg_prefix + node->proto->arg_names[i]] = alloca;
+		auto name = Symbol::Concat(node->arg_prefix, node->proto->arg_names[i]);
+		llvm::AllocaInst* alloca = _builder.CreateAlloca(ai->getType(), 0, name.str());
+		_named_values[name] = alloca;
 		_builder.CreateStore(ai, alloca);
 		++i;
 	}
@@ -470,7 +478,7 @@ llvm::Type* LLVMCodeGenerator::_llvm_type(C3TypePtr type) {
 			llvm::StructType* ret = nullptr;
 			
 			if (!_named_types.count(type->global_name())) {
-				_named_types[type->global_name()] = ret = llvm::StructType::create(_context, type->global_name());
+				_named_types[type->global_name()] = ret = llvm::StructType::create(_context, type->global_name().str());
 			} else {
 				auto t = _named_types[type->global_name()];
 				assert(t->isStructTy());
@@ -15,6 +15,13 @@ class LLVMCodeGenerator : public ASTNodeVisitor {
 		virtual ~LLVMCodeGenerator();
 	
 		bool build_ir(ASTNode* ast);
+
+		/**
+		* Builds the IR for the AST a piece at a time, for when the pieces come in as they're parsed. Pieces must be
+		* added in the order they appear in the AST. finish_ir() returns what build_ir() would have.
+		*/
+		void add_ir(ASTNode* node);
+		bool finish_ir();
 		bool write_ll_file(const char* path);
 		bool write_executable(const char* path);
 	
@@ -66,6 +73,6 @@ class LLVMCodeGenerator : public ASTNodeVisitor {
 		FunctionContext _current_function_context;
 		bool _is_current_block_terminated = false;
 
-		std::unordered_map<std::string, llvm::Value*> _named_values;
-		std::unordered_map<std::string, llvm::Type*> _named_types;
+		std::unordered_map<Symbol, llvm::Value*> _named_values;
+		std::unordered_map<Symbol, llvm::Type*> _named_types;
 };
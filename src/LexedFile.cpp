@@ -1,64 +1,326 @@
 #include "LexedFile.h"
+#include "LexerScan.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
 #include <string>
 #include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+	// files at least this big are lexed in parallel
+	const size_t kParallelLexingMinimumSize = 4 * 1024 * 1024;
+
+	template <class Scan>
+	void find_line_starts(const char* data, size_t size, std::vector<uint32_t>& line_starts) {
+		line_starts.push_back(0);
+		for (size_t i = Scan::find_newline(data, size, 0); i < size; i = Scan::find_newline(data, size, i)) {
+			if (data[i] == '\r' && i + 1 < size && data[i + 1] == '\n') {
+				++i;
+			}
+			line_starts.push_back(++i);
+		}
+	}
+}
 
 LexedFile::LexedFile() {}
-LexedFile LexedFile::operator=(const LexedFile& other) { return *this; }
 
 LexedFile::LexedFile(const char* filename) {
 	_filename = filename;
 }
 
 LexedFile::~LexedFile() {
-	free(_contents);
+	if (_is_mapped) {
+		munmap(_contents, _mapped_size);
+	} else {
+		free(_contents);
+	}
 }
 
-bool LexedFile::lex(std::shared_ptr<LexedFile> self) {
-	if (_is_lexed) {
+bool LexedFile::_map() {
+	if (_filename == "-") {
 		return false;
 	}
-	
-	FILE* f = fopen(_filename.c_str(), "r");
+
+	int fd = open(_filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	void* contents = MAP_FAILED;
+
+	// empty files can't be mapped, and anything that isn't a regular file might not support it
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+		contents = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+
+	close(fd);
+
+	if (contents == MAP_FAILED) {
+		return false;
+	}
+
+	madvise(contents, st.st_size, MADV_SEQUENTIAL);
+
+	_contents = (char*)contents;
+	_size = st.st_size;
+	_mapped_size = _size;
+	_is_mapped = true;
+	return true;
+}
+
+bool LexedFile::_read(Lexer& l, std::vector<TokenRange>& ranges) {
+	bool is_stdin = (_filename == "-");
+	FILE* f = is_stdin ? stdin : fopen(_filename.c_str(), "r");
 
 	if (!f) {
 		printf("Unable to open file %s\n", _filename.c_str());
 		return false;
 	}
 
-	fseek(f, 0, SEEK_END);
-	_size = ftell(f);
-	rewind(f);
- 
-	_contents = (char*)malloc(_size);
-	if (!_contents) {
+	// read and lex in chunks so that pipes work and the lexer can keep up with the reads. the lexer only carries the
+	// bytes of an unfinished token from one chunk to the next, so the only thing that grows is the file itself
+
+	size_t capacity = 0;
+	bool success = true;
+
+	while (true) {
+		if (_size == capacity) {
+			capacity = capacity ? capacity * 2 : 64 * 1024;
+			char* contents = (char*)realloc(_contents, capacity);
+			if (!contents) {
+				printf("Unable to allocate memory for file %s\n", _filename.c_str());
+				success = false;
+				break;
+			}
+			_contents = contents;
+		}
+
+		size_t count = fread(_contents + _size, 1, capacity - _size, f);
+		if (!count) {
+			if (ferror(f)) {
+				printf("Unable to read file %s\n", _filename.c_str());
+				success = false;
+			}
+			break;
+		}
+
+		if (!l.lex_chunk(_contents + _size, count, ranges)) {
+			printf("Unable to lex file %s\n", _filename.c_str());
+			success = false;
+			break;
+		}
+
+		_size += count;
+	}
+
+	if (!is_stdin) {
 		fclose(f);
-		printf("Unable to allocate memory for file %s\n", _filename.c_str());
+	}
+
+	if (success && !l.finish(ranges)) {
+		printf("Unable to lex file %s\n", _filename.c_str());
+		success = false;
+	}
+
+	return success;
+}
+
+bool LexedFile::lex() {
+	if (_is_lexed) {
 		return false;
 	}
-	
-	if (fread(_contents, _size, 1, f) != 1) {
-		fclose(f);
-		printf("Unable to read file %s\n", _filename.c_str());
+
+	Lexer l;
+	std::vector<TokenRange> ranges;
+
+	if (_map()) {
+		// lex the mapping directly, in parallel if it's big enough to be worth it
+		bool is_parallel = _size >= kParallelLexingMinimumSize && ThreadPool::Shared().size() > 1;
+		if (!(is_parallel ? l.lex_parallel(_contents, _size, ranges, ThreadPool::Shared()) : l.lex(_contents, _size, ranges))) {
+			printf("Unable to lex file %s\n", _filename.c_str());
+			return false;
+		}
+	} else if (!_read(l, ranges)) {
 		return false;
 	}
 
-	fclose(f);
+	for (auto& range : ranges) {
+		range.kind = token_kind(range.type, _contents + range.location, range.length);
+	}
+
+	_tokens.assign(std::move(ranges));
+
+	std::vector<uint32_t> line_starts;
+
+	switch (l.kernels()) {
+#if LEXER_SCAN_X86
+		case LexerKernelsAVX2:
+			find_line_starts<AVX2Scan>(_contents, _size, line_starts);
+			break;
+		case LexerKernelsSSE2:
+			find_line_starts<SSE2Scan>(_contents, _size, line_starts);
+			break;
+#endif
+		default:
+			find_line_starts<ScalarScan>(_contents, _size, line_starts);
+	}
+
+	_line_starts.assign(std::move(line_starts));
+	_pieces.reset(_contents, _size);
 	
+	_is_lexed = true;
+	return true;
+}
+
+bool LexedFile::edit(size_t offset, size_t removed, const char* text, size_t inserted) {
+	std::lock_guard<std::mutex> lock(_tokens_mutex);
+
+	if (!_is_lexed || offset + removed > _size || _size - removed + inserted > UINT32_MAX || !_relex_discarded_tokens()) {
+		return false;
+	}
+
+	_pieces.replace(offset, removed, text, inserted);
+	_size = _pieces.size();
+	_is_flat = false;
+
+	LexerEdit edit = { offset, removed, inserted };
+	std::vector<TokenRange> relexed;
+	size_t begin = 0, end = 0;
+
 	Lexer l;
+	if (!l.relex(_pieces, _tokens, edit, relexed, &begin, &end)) {
+		printf("Unable to lex file %s\n", _filename.c_str());
+		_tokens.clear();
+		_is_lexed = false;
+		return false;
+	}
 
-	_is_lexed = l.lex(_contents, _size, [&](const TokenRange& range) {
-		_tokens.push_back(std::shared_ptr<LexedFileToken>(new LexedFileToken(range.type, range.flags, range.location, range.length, self)));
-	});
-	
-	return _is_lexed;
+	// tokens that straddle pieces are copied out so that their text is contiguous
+	std::string token_text;
+	for (auto& token : relexed) {
+		size_t available = 0;
+		const char* data = _pieces.span(token.location, &available);
+		if (available < token.length) {
+			token_text.resize(token.length);
+			_pieces.copy(token.location, token.length, &token_text[0]);
+			data = token_text.data();
+		}
+		token.kind = token_kind(token.type, data, token.length);
+	}
+
+	// offsets wrap around, so this moves them back for removals
+	uint32_t delta = (uint32_t)(inserted - removed);
+
+	_tokens.replace(begin, end, relexed.data(), relexed.size(), delta);
+
+	// whether a line starts at an offset depends on the bytes on either side of it, so the only line starts that
+	// can change are the ones in [offset, offset + removed] before the edit, or [offset, offset + inserted] after
+
+	size_t first = std::max<size_t>(_line_starts.partition_point([&](uint32_t start) { return start < offset; }), 1);
+	size_t last = std::max(first, _line_starts.partition_point([&](uint32_t start) { return start <= offset + removed; }));
+
+	std::vector<uint32_t> line_starts;
+	for (size_t i = std::max<size_t>(offset, 1); i <= offset + inserted; ++i) {
+		if (_is_line_start(i)) {
+			line_starts.push_back(i);
+		}
+	}
+
+	_line_starts.replace(first, last, line_starts.data(), line_starts.size(), delta);
+
+	return true;
+}
+
+const std::vector<TokenRange>& LexedFile::tokens() {
+	_ensure_flat();
+	return _tokens.flatten();
 }
 
-const std::list<std::shared_ptr<LexedFileToken>>& LexedFile::tokens() {
-	return _tokens;
+void LexedFile::discard_tokens() {
+	std::lock_guard<std::mutex> lock(_tokens_mutex);
+	if (_token_users && --_token_users) {
+		return;
+	}
+	_tokens.clear();
+	_are_tokens_discarded = true;
+}
+
+bool LexedFile::restore_tokens() {
+	std::lock_guard<std::mutex> lock(_tokens_mutex);
+	if (!_relex_discarded_tokens()) {
+		return false;
+	}
+	++_token_users;
+	return true;
+}
+
+bool LexedFile::_relex_discarded_tokens() {
+	if (!_are_tokens_discarded) {
+		return true;
+	}
+
+	_flatten();
+
+	Lexer l;
+	std::vector<TokenRange> ranges;
+
+	if (!l.lex(_contents, _size, ranges)) {
+		printf("Unable to lex file %s\n", _filename.c_str());
+		return false;
+	}
+
+	for (auto& range : ranges) {
+		range.kind = token_kind(range.type, _contents + range.location, range.length);
+	}
+
+	_tokens.assign(std::move(ranges));
+	_are_tokens_discarded = false;
+	return true;
+}
+
+void LexedFile::_flatten() {
+	if (_is_flat.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	char* contents = (char*)malloc(std::max<size_t>(_size, 1));
+	if (!contents) {
+		printf("Unable to allocate memory for file %s\n", _filename.c_str());
+		abort();
+	}
+	_pieces.copy(0, _size, contents);
+
+	if (_is_mapped) {
+		munmap(_contents, _mapped_size);
+	} else {
+		free(_contents);
+	}
+	_contents = contents;
+	_is_mapped = false;
+	_pieces.reset(_contents, _size);
+
+	_tokens.flatten();
+	_line_starts.flatten();
+
+	_is_flat.store(true, std::memory_order_release);
+}
+
+void LexedFile::_ensure_flat() {
+	if (!_is_flat.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> lock(_tokens_mutex);
+		_flatten();
+	}
 }
 
 const char* LexedFile::contents() {
+	_ensure_flat();
 	return _contents;
 }
 
@@ -70,54 +332,60 @@ const std::string LexedFile::filename() {
 	return _filename;
 }
 
-LexedFileToken::LexedFileToken(TokenType type, size_t location, size_t length, std::shared_ptr<LexedFile> file) : 
-	_type(type),
-	_flags(0),
-	_location(location),
-	_length(length),
-	_file(file) {
+void LexedFile::line_column(size_t offset, size_t* line, size_t* column) {
+	_ensure_flat();
+	auto& line_starts = _line_starts.flatten();
+	size_t index = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin();
+	*line = index;
+	*column = offset - line_starts[index - 1] + 1;
 }
 
-LexedFileToken::LexedFileToken(TokenType type, uint32_t flags, size_t location, size_t length, std::shared_ptr<LexedFile> file) : 
-	_type(type),
-	_flags(flags),
-	_location(location),
-	_length(length),
-	_file(file) {
+size_t LexedFile::line_start(size_t line) {
+	_ensure_flat();
+	return _line_starts[line - 1];
 }
 
-TokenType LexedFileToken::type() {
-	return _type;
+size_t LexedFile::line_end(size_t line) {
+	_ensure_flat();
+	if (line == _line_starts.size()) {
+		return _size;
+	}
+	size_t end = _line_starts[line] - 1;
+	if (end > _line_starts[line - 1] && _contents[end] == '\n' && _contents[end - 1] == '\r') {
+		--end;
+	}
+	return end;
 }
 
-uint32_t LexedFileToken::flags() {
-	return _flags;
+bool LexedFile::_is_line_start(size_t offset) {
+	if (!offset || offset > _size) {
+		return !offset;
+	}
+	char c = _pieces.at(offset - 1);
+	return c == '\n' || (c == '\r' && (offset == _size || _pieces.at(offset) != '\n'));
 }
 
-const std::string LexedFileToken::value() {
-	return std::string(_file->contents() + _location, _length);
+std::string LexedFile::location_string(size_t offset) {
+	size_t line = 0, column = 0;
+	line_column(offset, &line, &column);
+	return _filename + ":" + std::to_string(line) + ":" + std::to_string(column);
 }
 
-void LexedFileToken::print_pointer() {
-	const char* start = _file->contents() + _location;
-	int offset = 0;
+void LexedFile::print_pointer(size_t offset) {
+	size_t line = 0, column = 0;
+	line_column(offset, &line, &column);
 
-	while (start > _file->contents() && start[-1] != '\r' && start[-1] != '\n') {
-		--start;
-		++offset;
-	}
+	const char* start = _contents + line_start(line);
+	const char* end = _contents + line_end(line);
+	int indent = column - 1;
 
-	while (*start == ' ' || *start == '\t') {
+	while (start < end && (*start == ' ' || *start == '\t')) {
 		++start;
-		--offset;
+		--indent;
 	}
 
-	const char* end = _file->contents() + _location;
-
-	while (end - _file->contents() + 1 < _file->size() && end[1] != '\r' && end[1] != '\n') {
-		++end;
-	}
+	std::string location = location_string(offset);
 
-	printf("%s: %.*s\n", _file->filename().c_str(), (int)(end - start + 1), start);
-	printf("%*s  %*s^\n", (int)_file->filename().size(), "", offset, "");
+	printf("%s: %.*s\n", location.c_str(), (int)(end - start), start);
+	printf("%*s  %*s^\n", (int)location.size(), "", indent, "");
 }
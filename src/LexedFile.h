@@ -1,55 +1,138 @@
 #pragma once
 
 #include "Token.h"
+#include "TokenKind.h"
 #include "Lexer.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <list>
-
-class LexedFileToken;
+#include <vector>
 
 class LexedFile {
 	public:
+		/**
+		* A filename of "-" reads from standard input.
+		*/
 		LexedFile(const char* filename);
 		~LexedFile();
 		
-		bool lex(std::shared_ptr<LexedFile> self);
+		bool lex();
+
+		/**
+		* Replaces `removed` bytes at `offset` with `text` and updates the tokens by relexing only the region around
+		* the edit. Neither the contents nor the tokens and line starts after the edit are copied or moved, so an edit
+		* takes about as long in a big file as in a small one. Reading the whole file again, e.g. with contents() or
+		* tokens(), puts it back together once. Thread-safe with respect to discard_tokens() and restore_tokens().
+		*/
+		bool edit(size_t offset, size_t removed, const char* text, size_t inserted);
+
+		const std::vector<TokenRange>& tokens();
 
-		const std::list<std::shared_ptr<LexedFileToken>>& tokens();
+		/**
+		* Frees the tokens once they've been copied elsewhere, unless someone else who called restore_tokens() still
+		* needs them. The contents and line starts are kept for diagnostics. Thread-safe.
+		*/
+		void discard_tokens();
+
+		/**
+		* Lexes the contents again if the tokens were discarded, and keeps them until a matching discard_tokens(), so
+		* that the same file can be processed by more than one preprocessor at a time. Thread-safe.
+		*/
+		bool restore_tokens();
 
 		const char* contents();
 		size_t size();
 
+		/**
+		* Finds the 1-based line and column of a byte offset with a binary search of the file's line starts. Columns
+		* count bytes.
+		*/
+		void line_column(size_t offset, size_t* line, size_t* column);
+
+		/**
+		* The offset of the first byte of a 1-based line.
+		*/
+		size_t line_start(size_t line);
+
+		/**
+		* The offset just past the last byte of a 1-based line, not including its newline.
+		*/
+		size_t line_end(size_t line);
+
+		/**
+		* Returns "file:line:column" for a byte offset.
+		*/
+		std::string location_string(size_t offset);
+
+		/**
+		* Prints the line containing a byte offset with a caret under it.
+		*/
+		void print_pointer(size_t offset);
+
 		const std::string filename();
 
 	private:
 		LexedFile();
-		LexedFile operator=(const LexedFile& other);
+		LexedFile(const LexedFile& other) = delete;
+		LexedFile& operator=(const LexedFile& other) = delete;
 
 		std::string _filename;
 
+		// regular files are mapped read-only and lexed in place, anything else is read into a buffer
 		char* _contents = nullptr;
 		size_t _size = 0;
+		bool _is_mapped = false;
+
+		// the mapping's size, which edits don't change
+		size_t _mapped_size = 0;
+
+		/**
+		* Edits are made to the pieces, and to the chunks of the tokens and line starts, rather than to the contents.
+		* The file's flat once everything's been put back together since the last edit.
+		*/
+		PieceTable _pieces;
+		std::atomic<bool> _is_flat{true};
 
 		bool _is_lexed = false;
 
-		std::list<std::shared_ptr<LexedFileToken>> _tokens;
-};
+		// guards the tokens being discarded, restored, and edited
+		std::mutex _tokens_mutex;
+		bool _are_tokens_discarded = false;
+		size_t _token_users = 0;
 
-class LexedFileToken : public Token {
-	public:
-		LexedFileToken(TokenType type, size_t location, size_t length, std::shared_ptr<LexedFile> file);
-		LexedFileToken(TokenType type, uint32_t flags, size_t location, size_t length, std::shared_ptr<LexedFile> file);
+		bool _relex_discarded_tokens();
 
-		virtual uint32_t flags();
-		virtual TokenType type();
-		virtual const std::string value();
-		virtual void print_pointer();
+		/**
+		* Puts the contents, tokens, and line starts back together after edits. Expects the tokens mutex to be locked.
+		*/
+		void _flatten();
 
-	private:
-		TokenType _type;
-		uint32_t _flags;
-		size_t _location;
-		size_t _length;
-		std::shared_ptr<LexedFile> _file;
+		/**
+		* Does the same if it's needed, locking the tokens mutex to do it.
+		*/
+		void _ensure_flat();
+
+		// the offset of the first byte of every line, built while lexing
+		OffsetChunks<uint32_t> _line_starts;
+
+		/**
+		* Maps the file. Returns false without printing an error if it can't be mapped, in which case it should be
+		* read instead.
+		*/
+		bool _map();
+
+		/**
+		* Reads the file into a buffer, lexing it as it's read. The whole file ends up in the buffer: tokens are
+		* offsets into it, and it's needed later for token values, diagnostics, and relexing.
+		*/
+		bool _read(Lexer& l, std::vector<TokenRange>& ranges);
+
+		/**
+		* Whether a line starts at `offset`, treating cr, lf, and cr+lf as newlines.
+		*/
+		bool _is_line_start(size_t offset);
+
+		OffsetChunks<TokenRange> _tokens;
 };
@@ -1,169 +1,508 @@
 #include "Lexer.h"
+#include "LexerScan.h"
+#include "LexerTables.h"
+#include "ThreadPool.h"
 
 #include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 
-Lexer::Lexer() {}
-
-bool Lexer::lex(const char* data, size_t size, std::function<void(const TokenRange&)> lambda) {
-	bool line_first = true;
-	bool skip_to_new_line = false;
-	bool skip_to_end_of_comment_block = false;
-
-	char c;
-	char prevc = '\0';
-	
-	for (size_t i = 0; i < size; ++i, prevc = c) {
-		size_t rem = size - i;
-		c = data[i];
-		
-		if (skip_to_end_of_comment_block) {
-			if (c != '*') {
-				continue;
-			}
-			if (rem >= 1 && data[i + 1] == '/') {
-				++i;
-				skip_to_end_of_comment_block = false;
+namespace {
+	// relexing works forward from the edit in windows that start this small and double
+	const size_t kInitialRelexWindowSize = 256;
+
+	/**
+	* Whether the newline ending at `pos` always puts the lexer at the start of a line (or leaves it in a block
+	* comment or literal). Escaped newlines continue line comments and don't start new lines, so they're avoided.
+	*/
+	bool is_line_boundary(const char* data, size_t pos) {
+		size_t newline = (pos >= 2 && data[pos - 2] == '\r') ? pos - 2 : pos - 1;
+		return !newline || data[newline - 1] != '\\';
+	}
+
+	inline void push_token(std::vector<TokenRange>& tokens, TokenType type, uint8_t flags, uint64_t start, uint64_t end) {
+		tokens.push_back(TokenRange(type, start, end - start));
+		tokens.back().flags = flags;
+	}
+}
+
+Lexer::Lexer() : _kernels(BestKernels()) {
+	reset();
+}
+
+Lexer::Lexer(LexerKernels kernels) : _kernels(kernels < BestKernels() ? kernels : BestKernels()) {
+	reset();
+}
+
+LexerKernels Lexer::BestKernels() {
+#if LEXER_SCAN_X86
+	static const LexerKernels best = __builtin_cpu_supports("avx2") ? LexerKernelsAVX2 : (__builtin_cpu_supports("sse2") ? LexerKernelsSSE2 : LexerKernelsScalar);
+	return best;
+#else
+	return LexerKernelsScalar;
+#endif
+}
+
+bool Lexer::lex(const char* data, size_t size, std::vector<TokenRange>& tokens) {
+	// generated sources average around 10 bytes per token
+	tokens.reserve(tokens.size() + size / 8);
+
+	reset();
+	bool ret = _lex(data, size, true, tokens);
+	reset();
+	return ret;
+}
+
+bool Lexer::lex_parallel(const char* data, size_t size, std::vector<TokenRange>& tokens, ThreadPool& pool, size_t minimum_chunk_size) {
+	if (size > UINT32_MAX) {
+		return false;
+	}
+
+	size_t chunk_count = pool.size() > 1 ? std::min(pool.size() * 4, size / std::max<size_t>(minimum_chunk_size, 1)) : 1;
+
+	if (chunk_count < 2) {
+		return lex(data, size, tokens);
+	}
+
+	std::vector<size_t> bounds(1, 0);
+
+	for (size_t i = 1; i < chunk_count; ++i) {
+		size_t pos = std::max(size * i / chunk_count, bounds.back());
+		while (pos < size) {
+			const char* newline = (const char*)memchr(data + pos, '\n', size - pos);
+			pos = newline ? newline - data + 1 : size;
+			if (is_line_boundary(data, pos)) {
+				break;
 			}
-			continue;
 		}
-
-		if (c == ' ' || c == '\t' || c == '\0') {
-			// whitespace
-			continue;
+		if (pos >= size) {
+			break;
 		}
-		
-		if (c == '\r' || c == '\n') {
-			// newline
-			if (prevc != '\\') {
-				skip_to_new_line = false;
-				line_first = true;
+		bounds.push_back(pos);
+	}
+
+	bounds.push_back(size);
+	chunk_count = bounds.size() - 1;
+
+	struct Chunk {
+		Lexer lexer;
+		std::vector<TokenRange> tokens;
+		bool success;
+	};
+
+	std::vector<Chunk> chunks(chunk_count);
+	std::vector<std::future<void>> futures;
+
+	for (size_t i = 0; i < chunk_count; ++i) {
+		futures.push_back(pool.submit([&, i]() {
+			Chunk& chunk = chunks[i];
+			chunk.lexer = Lexer(_kernels);
+			if (i) {
+				chunk.lexer._offset = bounds[i];
+				chunk.lexer._prev = '\n';
 			}
-			if (c == '\r' && rem >= 2 && data[i + 1] == '\n') {
-				// cr+lf, skip an extra character
-				++i;
+			chunk.tokens.reserve((bounds[i + 1] - bounds[i]) / 8);
+			chunk.success = chunk.lexer.lex_chunk(data + bounds[i], bounds[i + 1] - bounds[i], chunk.tokens);
+		}));
+	}
+
+	for (auto& future : futures) {
+		pool.wait(future);
+	}
+
+	// stitch the chunks together, lexing again any that didn't start where the speculation assumed
+
+	reset();
+
+	size_t total = 0;
+	for (auto& chunk : chunks) {
+		total += chunk.tokens.size();
+	}
+	tokens.reserve(tokens.size() + total);
+
+	for (size_t i = 0; i < chunk_count; ++i) {
+		Chunk& chunk = chunks[i];
+		if (_is_at_line_start() && chunk.success) {
+			tokens.insert(tokens.end(), chunk.tokens.begin(), chunk.tokens.end());
+			*this = chunk.lexer;
+		} else if (!lex_chunk(data + bounds[i], bounds[i + 1] - bounds[i], tokens)) {
+			reset();
+			return false;
+		}
+	}
+
+	return finish(tokens);
+}
+
+bool Lexer::relex(const PieceTable& contents, const OffsetChunks<TokenRange>& tokens, const LexerEdit& edit, std::vector<TokenRange>& relexed, size_t* replaced_begin, size_t* replaced_end) {
+	size_t size = contents.size();
+	if (size > UINT32_MAX || edit.offset + edit.inserted > size) {
+		return false;
+	}
+
+	int64_t delta = (int64_t)edit.inserted - (int64_t)edit.removed;
+
+	// keep every token that ends before the edit and starts far enough before it that punctuator lookahead can't
+	// have reached the edit either
+
+	size_t keep = tokens.partition_point([&](const TokenRange& token) {
+		return token.location + std::max<size_t>(token.length + 1, sizeof(_pending)) <= edit.offset;
+	});
+
+	// the lexer is always in the normal state right after a token
+
+	reset();
+	if (keep) {
+		auto last = tokens[keep - 1];
+		_offset = last.location + last.length;
+		_line_first = false;
+		_prev = contents.at(_offset - 1);
+	}
+
+	// old tokens after the edit are the candidates for resynchronizing
+	size_t old = tokens.partition_point([&](const TokenRange& token) {
+		return token.location < edit.offset + edit.removed;
+	});
+	old = std::max(old, keep);
+
+	relexed.clear();
+	size_t checked = 0;
+	size_t pos = _offset;
+	size_t window = kInitialRelexWindowSize;
+	bool is_synced = false;
+
+	while (!is_synced) {
+		size_t end = pos + std::min(window, size - pos);
+		bool is_last = (end == size);
+
+		// the window can span pieces of the contents, which the lexer takes as consecutive chunks
+		while (pos < end) {
+			size_t count = 0;
+			const char* data = contents.span(pos, &count);
+			count = std::min(count, end - pos);
+			if (!lex_chunk(data, count, relexed)) {
+				reset();
+				return false;
 			}
-			continue;
+			pos += count;
 		}
-		
-		if (skip_to_new_line) {
-			continue;
+
+		if (is_last && !finish(relexed)) {
+			reset();
+			return false;
 		}
 
-		if (c == '/' && rem >= 2) {
-			if (data[i + 1] == '/') {
-				// single line comment, advance to next line
-				skip_to_new_line = true;
-				continue;
-			} else if (data[i + 1] == '*') {
-				// multi line comment, advance to next "*/", skipping the next asterisk
-				++i;
-				skip_to_end_of_comment_block = true;
+		window *= 2;
+
+		for (; checked < relexed.size(); ++checked) {
+			const TokenRange& token = relexed[checked];
+			if (token.location < edit.offset + edit.inserted) {
 				continue;
 			}
+			uint64_t location = token.location - delta;
+			while (old < tokens.size() && tokens[old].location < location) {
+				++old;
+			}
+			if (old == tokens.size()) {
+				break;
+			}
+			auto old_token = tokens[old];
+			if (old_token.location == location && old_token.length == token.length && old_token.type == token.type && old_token.flags == token.flags) {
+				is_synced = true;
+				break;
+			}
 		}
 
-		// read token
-		TokenRange token = _read_token(data, size, i);
-		token.flags |= (line_first ? TokenFlagLineFirst : 0);
-		line_first = false;
+		if (is_last) {
+			break;
+		}
+	}
 
-		lambda(token);
-		
-		i += (token.length - 1);
+	reset();
+
+	if (!is_synced) {
+		// everything after the edit changed
+		old = tokens.size();
+		checked = relexed.size();
 	}
-	
+
+	relexed.erase(relexed.begin() + checked, relexed.end());
+	*replaced_begin = keep;
+	*replaced_end = old;
+
 	return true;
 }
 
-TokenRange Lexer::_read_token(const char* data, size_t size, size_t pos) {
-	char c = data[pos];
-	size_t rem = size - pos;
+bool Lexer::lex_chunk(const char* data, size_t size, std::vector<TokenRange>& tokens) {
+	return _lex(data, size, false, tokens);
+}
 
-	if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_') {
-		// identifier
-		size_t len = 1;
-		for (; rem >= len; ++len) {
-			char c2 = data[pos + len];
-			if (!(c2 >= 'A' && c2 <= 'Z') && !(c2 >= 'a' && c2 <= 'z') && !(c2 >= '0' && c2 <= '9') && c2 != '_') {
-				break;
-			}
+bool Lexer::finish(std::vector<TokenRange>& tokens) {
+	bool ret = _lex(nullptr, 0, true, tokens);
+	reset();
+	return ret;
+}
+
+void Lexer::reset() {
+	_offset = 0;
+	_state = StateNormal;
+	_line_first = true;
+	_skip_lf = false;
+	_block_comment_star = false;
+	_prev = '\0';
+	_pending_size = 0;
+}
+
+uint64_t Lexer::pending_location() const {
+	if (_pending_size) {
+		return _pending_location;
+	}
+	if (_state == StateIdentifier || _state == StateNumber || _state == StateLiteral) {
+		return _token_start;
+	}
+	return _offset;
+}
+
+bool Lexer::_is_at_line_start() const {
+	return _state == StateNormal && _line_first && !_skip_lf && !_pending_size;
+}
+
+bool Lexer::_lex(const char* data, size_t size, bool is_last, std::vector<TokenRange>& tokens) {
+	if (_offset + size > UINT32_MAX) {
+		return false;
+	}
+
+	auto lex_range = [&](const char* data, size_t size, uint64_t offset, bool is_last) {
+		switch (_kernels) {
+#if LEXER_SCAN_X86
+			case LexerKernelsAVX2:
+				return _lex_range<AVX2Scan>(data, size, offset, is_last, tokens);
+			case LexerKernelsSSE2:
+				return _lex_range<SSE2Scan>(data, size, offset, is_last, tokens);
+#endif
+			default:
+				return _lex_range<ScalarScan>(data, size, offset, is_last, tokens);
+		}
+	};
+
+	size_t i = 0;
+
+	while (_pending_size && (i < size || is_last)) {
+		// re-lex whatever was pending along with enough of this chunk to make a decision
+		char window[sizeof(_pending) + 4];
+		size_t pending_size = _pending_size;
+		size_t count = std::min(size - i, sizeof(window) - pending_size);
+		memcpy(window, _pending, pending_size);
+		if (count) {
+			memcpy(window + pending_size, data + i, count);
+		}
+		_pending_size = 0;
+		if (!lex_range(window, pending_size + count, _pending_location, is_last && i + count == size)) {
+			return false;
 		}
-		return TokenRange(TokenTypeIdentifier, pos, len);
+		i += count;
 	}
-	
-	if ((c >= '0' && c <= '9') || (c == '.' && rem >= 1 && data[pos + 1] >= '0' && data[pos + 1] <= '9')) {
-		// number
-		size_t len = 1;
-		for (char c2, prevc2 = c; rem >= len; ++len, prevc2 = c2) {
-			c2 = data[pos + len];
-			if ((c2 >= 'a' && c2 <= 'z') || (c2 >= 'A' && c2 <= 'Z') || (c2 >= '0' && c2 <= '9') || c2 == '_' || c2 == '.') {
-				// letter, digit, underscore, or period
-				continue;
-			}
-			if ((c2 == '+' || c2 == '-') && (prevc2 == 'e' || prevc2 == 'E' || prevc2 == 'p' || prevc2 == 'P')) {
-				// exponent
-				continue;
+
+	if (i < size || is_last) {
+		if (!lex_range(data + i, size - i, _offset + i, is_last)) {
+			return false;
+		}
+	}
+
+	_offset += size;
+	return true;
+}
+
+template <class Scan>
+bool Lexer::_lex_range(const char* data, size_t size, uint64_t offset, bool is_last, std::vector<TokenRange>& tokens) {
+	size_t i = 0;
+
+	// skips the newline at `i`, treating cr+lf as a single newline
+	auto skip_newline = [&]() {
+		if (data[i] == '\r') {
+			if (i + 1 == size) {
+				_skip_lf = !is_last;
+			} else if (data[i + 1] == '\n') {
+				++i;
 			}
-			break;
 		}
-		return TokenRange(TokenTypeNumber, pos, len);
+		++i;
+	};
+
+	if (_skip_lf && size) {
+		// the last range ended with a carriage return
+		_skip_lf = false;
+		if (data[0] == '\n') {
+			i = 1;
+		}
 	}
-	
-	if (c == '\'' || c == '"') {
-		// string literal or character constant
-		size_t len = 1;
-		bool escape = false;
-		for (; ; ++len) {
-			if (len > rem) {
-				// unterminated literal!
+
+	while (i < size) {
+		switch (_state) {
+			case StateNormal:
 				break;
-			}
-			
-			char c2 = data[pos + len];
-			
-			if (escape) {
-				escape = false;
+			case StateLineComment:
+				// advance to the next newline that isn't escaped
+				i = Scan::find_newline(data, size, i);
+				if (i < size) {
+					if ((i ? data[i - 1] : _prev) == '\\') {
+						skip_newline();
+					} else {
+						_state = StateNormal;
+					}
+				}
+				continue;
+			case StateBlockComment: {
+				// advance past the next "*/"
+				if (_block_comment_star && data[i] == '/') {
+					_block_comment_star = false;
+					_state = StateNormal;
+					++i;
+					continue;
+				}
+				size_t end = Scan::find_comment_end(data, size, i);
+				if (end < size) {
+					_state = StateNormal;
+					i = end + 2;
+				} else {
+					_block_comment_star = (data[size - 1] == '*');
+					i = size;
+				}
 				continue;
 			}
+			case StateIdentifier:
+				i = Scan::identifier_end(data, size, i);
+				if (i < size) {
+					push_token(tokens, _token_type, _token_flags, _token_start, offset + i);
+					_state = StateNormal;
+				}
+				continue;
+			case StateNumber:
+				for (; i < size; ++i) {
+					char c = data[i];
+					if (char_class(c) & CharClassNumberBody) {
+						// letter, digit, underscore, or period
+					} else if ((c == '+' || c == '-') && (_token_prev == 'e' || _token_prev == 'E' || _token_prev == 'p' || _token_prev == 'P')) {
+						// exponent
+					} else {
+						break;
+					}
+					_token_prev = c;
+				}
+				if (i < size) {
+					push_token(tokens, _token_type, _token_flags, _token_start, offset + i);
+					_state = StateNormal;
+				}
+				continue;
+			case StateLiteral:
+				if (_escape) {
+					_escape = false;
+					++i;
+					continue;
+				}
+				i = Scan::find_quote_or_escape(data, size, i, _quote);
+				if (i < size) {
+					if (data[i] == _quote) {
+						push_token(tokens, _token_type, _token_flags, _token_start, offset + i + 1);
+						_state = StateNormal;
+					} else {
+						_escape = true;
+					}
+					++i;
+				}
+				continue;
+		}
+
+		char c = data[i];
+		uint8_t cls = char_class(c);
 
-			if (c2 == '\\') {
-				escape = true;
+		if (cls & CharClassBlank) {
+			// whitespace
+			i = Scan::skip_blanks(data, size, i + 1);
+			continue;
+		}
+
+		if (cls & CharClassNewline) {
+			// newline
+			if ((i ? data[i - 1] : _prev) != '\\') {
+				_line_first = true;
 			}
+			skip_newline();
+			continue;
+		}
 
-			if (c2 == c) {
-				++len;
-				break;
+		if (!(cls & ~CharClassPeriod) && size - i < sizeof(_pending) && !is_last) {
+			// punctuators, comments, and numbers that start with a period can take up to 4 bytes to decide on
+			_pending_size = size - i;
+			_pending_location = offset + i;
+			memcpy(_pending, data + i, _pending_size);
+			i = size;
+			break;
+		}
+
+		if (c == '/' && i + 1 < size) {
+			if (data[i + 1] == '/') {
+				// single line comment
+				_state = StateLineComment;
+				i += 2;
+				continue;
+			} else if (data[i + 1] == '*') {
+				// multi line comment, the opening asterisk can't also close it
+				_state = StateBlockComment;
+				_block_comment_star = false;
+				i += 2;
+				continue;
 			}
 		}
-		return TokenRange(c == '\'' ? TokenTypeCharacterConstant : TokenTypeStringLiteral, pos, len);
-	}
 
-	if ((unsigned char)c >= 0x7F || c < 0x20 || c == '$' || c == '@' || c == '`') {
-		// other
-		return TokenRange(TokenTypeOther, pos, 1);
-	}			
+		// read token
 
-	// punctuator
-	
-	// multicharacter punctuators
-	const static char* punctuators[] = { 
-		"%:%:", 
-		"...", "<<=", ">>=", "->*",
-		"->", "++", "--", "##", "<<", ">>", "!=", "<=", 
-		">=", "==", "&&", "||", "*=", "/=", "%=", "+=", 
-		"-=", "&=", "^=", "|=", ".*", "<%", "%>", "<:",
-		":>", "%:", "::"
-	};
+		_token_start = offset + i;
+		_token_flags = (_line_first ? TokenFlagLineFirst : 0);
+		_line_first = false;
 
-	size_t punctuator_length = 1;
-	
-	for (size_t i = 0; i < sizeof(punctuators) / sizeof(char*); ++i) {
-		size_t len = strlen(punctuators[i]);
-		if (rem >= len && !memcmp(data + pos, punctuators[i], len)) {
-			punctuator_length = len;
-			break;
+		if (cls & CharClassIdentifierStart) {
+			// identifier
+			_token_type = TokenTypeIdentifier;
+			_state = StateIdentifier;
+			++i;
+		} else if ((cls & CharClassDigit) || ((cls & CharClassPeriod) && i + 1 < size && (char_class(data[i + 1]) & CharClassDigit))) {
+			// number
+			_token_type = TokenTypeNumber;
+			_token_prev = c;
+			_state = StateNumber;
+			++i;
+		} else if (cls & CharClassQuote) {
+			// string literal or character constant
+			_token_type = (c == '\'' ? TokenTypeCharacterConstant : TokenTypeStringLiteral);
+			_quote = c;
+			_escape = false;
+			_state = StateLiteral;
+			++i;
+		} else if (cls & CharClassOther) {
+			// other
+			push_token(tokens, TokenTypeOther, _token_flags, _token_start, _token_start + 1);
+			++i;
+		} else {
+			// punctuator
+			size_t length = punctuator_length(data + i, size - i);
+			push_token(tokens, TokenTypePunctuator, _token_flags, _token_start, _token_start + length);
+			i += length;
 		}
 	}
 
-	return TokenRange(TokenTypePunctuator, pos, punctuator_length);
+	if (is_last) {
+		if (_state == StateIdentifier || _state == StateNumber || _state == StateLiteral) {
+			// the token ends with the stream (for literals, this means it's unterminated)
+			push_token(tokens, _token_type, _token_flags, _token_start, offset + size);
+		}
+		_state = StateNormal;
+	}
+
+	if (size) {
+		_prev = data[size - 1];
+	}
+
+	return true;
 }
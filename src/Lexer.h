@@ -1,28 +1,160 @@
 #pragma once
 
 #include "Token.h"
+#include "TokenKind.h"
+#include "OffsetChunks.h"
+#include "PieceTable.h"
 
 #include <string>
-#include <list>
-#include <functional>
+#include <vector>
 
+class ThreadPool;
+
+/**
+* A token as a range of the lexed buffer. Kept to 12 bytes so that a file's worth of them can be stored
+* contiguously. The lexer leaves `kind` as TokenKindNone, it's assigned once the token's text is available.
+*/
 struct TokenRange {
-	TokenRange(TokenType type, size_t location, size_t length) : type(type), flags(0), location(location), length(length) {}
+	TokenRange(TokenType type, uint32_t location, uint32_t length) : type(type), flags(0), kind(TokenKindNone), location(location), length(length) {}
 
 	TokenType type;
-	uint32_t flags;
-	size_t location;
-	size_t length;
+	uint8_t flags;
+	TokenKind kind;
+	uint32_t location;
+	uint32_t length;
+};
+
+template <>
+struct ChunkOffset<TokenRange> {
+	static uint32_t& get(TokenRange& token) { return token.location; }
+};
+
+/**
+* Replaces `removed` bytes at `offset` with `inserted` bytes.
+*/
+struct LexerEdit {
+	size_t offset;
+	size_t removed;
+	size_t inserted;
+};
+
+/**
+* Which scanning kernels the lexer uses. See LexerScan.h.
+*/
+enum LexerKernels {
+	LexerKernelsScalar,
+	LexerKernelsSSE2,
+	LexerKernelsAVX2,
 };
 
+/**
+* The lexer is a resumable state machine. Input can be given all at once with `lex` or streamed in chunks of any
+* size with `lex_chunk` followed by `finish`. Either way, the same tokens are produced.
+*/
 class Lexer {
 	public:
-	
+
+		/**
+		* Uses the best kernels supported by the cpu.
+		*/
 		Lexer();
-		
-		bool lex(const char* data, size_t size, std::function<void(const TokenRange&)> lambda);
-		
+
+		/**
+		* Uses the given kernels. Mostly useful for comparing them against the scalar reference.
+		*/
+		Lexer(LexerKernels kernels);
+
+		/**
+		* Appends the tokens in `data` to `tokens`. Buffers must be smaller than 4GB.
+		*/
+		bool lex(const char* data, size_t size, std::vector<TokenRange>& tokens);
+
+		/**
+		* Produces the same tokens as `lex`, but splits `data` into chunks at newlines and lexes them on `pool`.
+		*
+		* Each chunk is speculatively lexed as if it starts a new line. That's almost always the case, but if the
+		* previous chunk actually ends in a block comment or literal, the chunk is lexed again with that state while
+		* the results are stitched together. Chunks are at least `minimum_chunk_size` bytes, since smaller ones aren't
+		* worth a task.
+		*/
+		bool lex_parallel(const char* data, size_t size, std::vector<TokenRange>& tokens, ThreadPool& pool, size_t minimum_chunk_size = 256 * 1024);
+
+		/**
+		* Lexes the edited buffer `contents` again near `edit`, given the `tokens` lexed from it before the edit was
+		* made. Lexing starts after the last token the edit can't have affected and stops as soon as it produces a
+		* token identical to an old one, which means the lexer is back in sync. The tokens in `relexed` replace the old
+		* ones at [`replaced_begin`, `replaced_end`), and the old ones after them only need moving by the size of the
+		* edit.
+		*/
+		bool relex(const PieceTable& contents, const OffsetChunks<TokenRange>& tokens, const LexerEdit& edit, std::vector<TokenRange>& relexed, size_t* replaced_begin, size_t* replaced_end);
+
+		/**
+		* Appends the tokens completed by the next chunk of a stream to `tokens`. Token locations are offsets from the
+		* beginning of the stream. Tokens that are still incomplete at the end of the chunk are appended by a later
+		* call. Streams must be smaller than 4GB.
+		*/
+		bool lex_chunk(const char* data, size_t size, std::vector<TokenRange>& tokens);
+
+		/**
+		* Ends the stream, appending any remaining tokens to `tokens`, and resets the lexer.
+		*/
+		bool finish(std::vector<TokenRange>& tokens);
+
+		/**
+		* Discards any stream in progress.
+		*/
+		void reset();
+
+		/**
+		* The offset of the first byte of the stream that may still be part of a token that hasn't been appended yet.
+		* Streaming callers don't need to retain anything before it for the sake of the lexer.
+		*/
+		uint64_t pending_location() const;
+
+		LexerKernels kernels() const { return _kernels; }
+
+		static LexerKernels BestKernels();
+
 	private:
-	
-		TokenRange _read_token(const char* data, size_t size, size_t pos);
+
+		enum State : uint8_t {
+			StateNormal,
+			StateLineComment,
+			StateBlockComment,
+			StateIdentifier,
+			StateNumber,
+			StateLiteral,
+		};
+
+		LexerKernels _kernels;
+
+		uint64_t _offset;            // stream offset of the next chunk
+		State _state;
+		bool _line_first;
+		bool _skip_lf;               // the last chunk ended with a carriage return
+		bool _block_comment_star;    // the last chunk ended with an asterisk that can close a block comment
+		char _prev;                  // the last byte of the last chunk
+
+		// the token in progress
+		uint64_t _token_start;
+		TokenType _token_type;
+		uint8_t _token_flags;
+		char _token_prev;            // the last byte of a number
+		char _quote;                 // the delimiter of a literal
+		bool _escape;                // the last byte of a literal was a backslash
+
+		// punctuators (and anything else starting with one) that were too close to the end of the last chunk
+		char _pending[4];
+		uint8_t _pending_size;
+		uint64_t _pending_location;
+
+		bool _lex(const char* data, size_t size, bool is_last, std::vector<TokenRange>& tokens);
+
+		/**
+		* Whether the lexer is in the state that every chunk is speculatively lexed from in lex_parallel.
+		*/
+		bool _is_at_line_start() const;
+
+		template <class Scan>
+		bool _lex_range(const char* data, size_t size, uint64_t offset, bool is_last, std::vector<TokenRange>& tokens);
 };
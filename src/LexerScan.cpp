@@ -0,0 +1,169 @@
+#include "LexerScan.h"
+
+#if LEXER_SCAN_X86
+
+#include <immintrin.h>
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+namespace {
+	// true (0xFF) for each byte of `v` in the unsigned range [lo, hi]
+
+	SSE2_TARGET inline __m128i in_range(__m128i v, char lo, char hi) {
+		__m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+		return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(hi - lo)), offset);
+	}
+
+	AVX2_TARGET inline __m256i in_range(__m256i v, char lo, char hi) {
+		__m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+		return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(hi - lo)), offset);
+	}
+
+	SSE2_TARGET inline __m128i identifier_bytes(__m128i v) {
+		__m128i letters = in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+		__m128i digits = in_range(v, '0', '9');
+		__m128i underscores = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+		return _mm_or_si128(_mm_or_si128(letters, digits), underscores);
+	}
+
+	AVX2_TARGET inline __m256i identifier_bytes(__m256i v) {
+		__m256i letters = in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+		__m256i digits = in_range(v, '0', '9');
+		__m256i underscores = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+		return _mm256_or_si256(_mm256_or_si256(letters, digits), underscores);
+	}
+
+	SSE2_TARGET inline __m128i blank_bytes(__m128i v) {
+		__m128i spaces = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+		__m128i tabs = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+		__m128i nulls = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+		return _mm_or_si128(_mm_or_si128(spaces, tabs), nulls);
+	}
+
+	AVX2_TARGET inline __m256i blank_bytes(__m256i v) {
+		__m256i spaces = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+		__m256i tabs = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'));
+		__m256i nulls = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+		return _mm256_or_si256(_mm256_or_si256(spaces, tabs), nulls);
+	}
+
+	SSE2_TARGET inline __m128i load16(const char* p) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+	}
+
+	AVX2_TARGET inline __m256i load32(const char* p) {
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+	}
+
+	inline unsigned mask16(int m) { return (unsigned)m & 0xFFFF; }
+	inline unsigned mask32(int m) { return (unsigned)m; }
+}
+
+// SSE2
+
+SSE2_TARGET size_t SSE2Scan::skip_blanks(const char* data, size_t size, size_t pos) {
+	for (; pos + 16 <= size; pos += 16) {
+		if (unsigned m = mask16(~_mm_movemask_epi8(blank_bytes(load16(data + pos))))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return ScalarScan::skip_blanks(data, size, pos);
+}
+
+SSE2_TARGET size_t SSE2Scan::find_newline(const char* data, size_t size, size_t pos) {
+	for (; pos + 16 <= size; pos += 16) {
+		__m128i v = load16(data + pos);
+		__m128i newlines = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+		if (unsigned m = mask16(_mm_movemask_epi8(newlines))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return ScalarScan::find_newline(data, size, pos);
+}
+
+SSE2_TARGET size_t SSE2Scan::find_comment_end(const char* data, size_t size, size_t pos) {
+	for (; pos + 17 <= size; pos += 16) {
+		__m128i asterisks = _mm_cmpeq_epi8(load16(data + pos), _mm_set1_epi8('*'));
+		__m128i slashes = _mm_cmpeq_epi8(load16(data + pos + 1), _mm_set1_epi8('/'));
+		if (unsigned m = mask16(_mm_movemask_epi8(_mm_and_si128(asterisks, slashes)))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return ScalarScan::find_comment_end(data, size, pos);
+}
+
+SSE2_TARGET size_t SSE2Scan::identifier_end(const char* data, size_t size, size_t pos) {
+	for (; pos + 16 <= size; pos += 16) {
+		if (unsigned m = mask16(~_mm_movemask_epi8(identifier_bytes(load16(data + pos))))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return ScalarScan::identifier_end(data, size, pos);
+}
+
+SSE2_TARGET size_t SSE2Scan::find_quote_or_escape(const char* data, size_t size, size_t pos, char quote) {
+	for (; pos + 16 <= size; pos += 16) {
+		__m128i v = load16(data + pos);
+		__m128i stops = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(quote)), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+		if (unsigned m = mask16(_mm_movemask_epi8(stops))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return ScalarScan::find_quote_or_escape(data, size, pos, quote);
+}
+
+// AVX2
+
+AVX2_TARGET size_t AVX2Scan::skip_blanks(const char* data, size_t size, size_t pos) {
+	for (; pos + 32 <= size; pos += 32) {
+		if (unsigned m = mask32(~_mm256_movemask_epi8(blank_bytes(load32(data + pos))))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return SSE2Scan::skip_blanks(data, size, pos);
+}
+
+AVX2_TARGET size_t AVX2Scan::find_newline(const char* data, size_t size, size_t pos) {
+	for (; pos + 32 <= size; pos += 32) {
+		__m256i v = load32(data + pos);
+		__m256i newlines = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+		if (unsigned m = mask32(_mm256_movemask_epi8(newlines))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return SSE2Scan::find_newline(data, size, pos);
+}
+
+AVX2_TARGET size_t AVX2Scan::find_comment_end(const char* data, size_t size, size_t pos) {
+	for (; pos + 33 <= size; pos += 32) {
+		__m256i asterisks = _mm256_cmpeq_epi8(load32(data + pos), _mm256_set1_epi8('*'));
+		__m256i slashes = _mm256_cmpeq_epi8(load32(data + pos + 1), _mm256_set1_epi8('/'));
+		if (unsigned m = mask32(_mm256_movemask_epi8(_mm256_and_si256(asterisks, slashes)))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return SSE2Scan::find_comment_end(data, size, pos);
+}
+
+AVX2_TARGET size_t AVX2Scan::identifier_end(const char* data, size_t size, size_t pos) {
+	for (; pos + 32 <= size; pos += 32) {
+		if (unsigned m = mask32(~_mm256_movemask_epi8(identifier_bytes(load32(data + pos))))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return SSE2Scan::identifier_end(data, size, pos);
+}
+
+AVX2_TARGET size_t AVX2Scan::find_quote_or_escape(const char* data, size_t size, size_t pos, char quote) {
+	for (; pos + 32 <= size; pos += 32) {
+		__m256i v = load32(data + pos);
+		__m256i stops = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(quote)), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+		if (unsigned m = mask32(_mm256_movemask_epi8(stops))) {
+			return pos + __builtin_ctz(m);
+		}
+	}
+	return SSE2Scan::find_quote_or_escape(data, size, pos, quote);
+}
+
+#endif
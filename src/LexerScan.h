@@ -0,0 +1,88 @@
+#pragma once
+
+#include "LexerTables.h"
+
+#include <cstddef>
+
+/**
+* Scanning kernels used by the lexer for its longest runs: blanks, comment bodies, identifiers, and literals.
+*
+* Every kernel takes a position and returns the position of the first byte that ends the run (or `size`). The
+* scalar versions are the reference implementation. The vector versions must return exactly the same results.
+*/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEXER_SCAN_X86 1
+#endif
+
+struct ScalarScan {
+	/**
+	* Returns the position of the first byte that isn't a space, tab, or null.
+	*/
+	static size_t skip_blanks(const char* data, size_t size, size_t pos) {
+		while (pos < size && (char_class(data[pos]) & CharClassBlank)) { ++pos; }
+		return pos;
+	}
+
+	/**
+	* Returns the position of the next carriage return or line feed.
+	*/
+	static size_t find_newline(const char* data, size_t size, size_t pos) {
+		while (pos < size && !(char_class(data[pos]) & CharClassNewline)) { ++pos; }
+		return pos;
+	}
+
+	/**
+	* Returns the position of the asterisk of the next "*" "/" pair.
+	*/
+	static size_t find_comment_end(const char* data, size_t size, size_t pos) {
+		for (; pos + 1 < size; ++pos) {
+			if (data[pos] == '*' && data[pos + 1] == '/') {
+				return pos;
+			}
+		}
+		return size;
+	}
+
+	/**
+	* Returns the position of the first byte that can't be part of an identifier.
+	*/
+	static size_t identifier_end(const char* data, size_t size, size_t pos) {
+		while (pos < size && (char_class(data[pos]) & CharClassIdentifier)) { ++pos; }
+		return pos;
+	}
+
+	/**
+	* Returns the position of the next `quote` or backslash.
+	*/
+	static size_t find_quote_or_escape(const char* data, size_t size, size_t pos, char quote) {
+		while (pos < size && data[pos] != quote && data[pos] != '\\') { ++pos; }
+		return pos;
+	}
+};
+
+#if LEXER_SCAN_X86
+
+/**
+* 16 bytes at a time. Falls back to ScalarScan for tails.
+*/
+struct SSE2Scan {
+	static size_t skip_blanks(const char* data, size_t size, size_t pos);
+	static size_t find_newline(const char* data, size_t size, size_t pos);
+	static size_t find_comment_end(const char* data, size_t size, size_t pos);
+	static size_t identifier_end(const char* data, size_t size, size_t pos);
+	static size_t find_quote_or_escape(const char* data, size_t size, size_t pos, char quote);
+};
+
+/**
+* 32 bytes at a time. Falls back to SSE2Scan for tails.
+*/
+struct AVX2Scan {
+	static size_t skip_blanks(const char* data, size_t size, size_t pos);
+	static size_t find_newline(const char* data, size_t size, size_t pos);
+	static size_t find_comment_end(const char* data, size_t size, size_t pos);
+	static size_t identifier_end(const char* data, size_t size, size_t pos);
+	static size_t find_quote_or_escape(const char* data, size_t size, size_t pos, char quote);
+};
+
+#endif
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+* Lookup tables used by the lexer. Everything here is generated at compile time.
+*/
+
+#define LEXER_TABLE_4(f, n)   f(n), f(n + 1), f(n + 2), f(n + 3)
+#define LEXER_TABLE_16(f, n)  LEXER_TABLE_4(f, n), LEXER_TABLE_4(f, n + 4), LEXER_TABLE_4(f, n + 8), LEXER_TABLE_4(f, n + 12)
+#define LEXER_TABLE_64(f, n)  LEXER_TABLE_16(f, n), LEXER_TABLE_16(f, n + 16), LEXER_TABLE_16(f, n + 32), LEXER_TABLE_16(f, n + 48)
+#define LEXER_TABLE_256(f, n) LEXER_TABLE_64(f, n), LEXER_TABLE_64(f, n + 64), LEXER_TABLE_64(f, n + 128), LEXER_TABLE_64(f, n + 192)
+
+// CHARACTER CLASSES
+
+enum CharClass : uint8_t {
+	CharClassBlank           = (1 << 0), // space, tab, or null
+	CharClassNewline         = (1 << 1),
+	CharClassIdentifierStart = (1 << 2), // letter or underscore
+	CharClassDigit           = (1 << 3),
+	CharClassPeriod          = (1 << 4),
+	CharClassQuote           = (1 << 5), // starts a string literal or character constant
+	CharClassOther           = (1 << 6), // a token of type TokenTypeOther all by itself
+
+	CharClassIdentifier = CharClassIdentifierStart | CharClassDigit,
+	CharClassNumberBody = CharClassIdentifierStart | CharClassDigit | CharClassPeriod,
+};
+
+constexpr uint8_t classify_character(unsigned char c) {
+	return (c == ' ' || c == '\t' || c == '\0') ? CharClassBlank
+		: (c == '\r' || c == '\n') ? CharClassNewline
+		: ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_') ? CharClassIdentifierStart
+		: (c >= '0' && c <= '9') ? CharClassDigit
+		: (c == '.') ? CharClassPeriod
+		: (c == '\'' || c == '"') ? CharClassQuote
+		: (c >= 0x7F || c < 0x20 || c == '$' || c == '@' || c == '`') ? CharClassOther
+		: 0;
+}
+
+constexpr uint8_t char_classes[256] = { LEXER_TABLE_256(classify_character, 0) };
+
+inline uint8_t char_class(char c) {
+	return char_classes[(unsigned char)c];
+}
+
+// PUNCTUATORS
+
+/**
+* Multicharacter punctuators grouped by their first two characters. Each group knows the longest punctuator
+* beginning with its prefix, and whether the prefix is a punctuator on its own.
+*/
+struct PunctuatorGroup {
+	char first;
+	char second;
+	char third;  // the remaining characters of the longest punctuator, if longer than two
+	char fourth;
+	uint8_t long_length;  // 0 if no punctuator longer than two characters has this prefix
+	uint8_t short_length; // 2 if the prefix is itself a punctuator, otherwise 1
+};
+
+constexpr PunctuatorGroup punctuator_groups[] = {
+	{ '%', ':', '%', ':', 4, 2 },
+	{ '.', '.', '.',  0,  3, 1 },
+	{ '<', '<', '=',  0,  3, 2 },
+	{ '>', '>', '=',  0,  3, 2 },
+	{ '-', '>', '*',  0,  3, 2 },
+	{ '+', '+',  0,   0,  0, 2 },
+	{ '-', '-',  0,   0,  0, 2 },
+	{ '#', '#',  0,   0,  0, 2 },
+	{ '!', '=',  0,   0,  0, 2 },
+	{ '<', '=',  0,   0,  0, 2 },
+	{ '>', '=',  0,   0,  0, 2 },
+	{ '=', '=',  0,   0,  0, 2 },
+	{ '&', '&',  0,   0,  0, 2 },
+	{ '|', '|',  0,   0,  0, 2 },
+	{ '*', '=',  0,   0,  0, 2 },
+	{ '/', '=',  0,   0,  0, 2 },
+	{ '%', '=',  0,   0,  0, 2 },
+	{ '+', '=',  0,   0,  0, 2 },
+	{ '-', '=',  0,   0,  0, 2 },
+	{ '&', '=',  0,   0,  0, 2 },
+	{ '^', '=',  0,   0,  0, 2 },
+	{ '|', '=',  0,   0,  0, 2 },
+	{ '.', '*',  0,   0,  0, 2 },
+	{ '<', '%',  0,   0,  0, 2 },
+	{ '%', '>',  0,   0,  0, 2 },
+	{ '<', ':',  0,   0,  0, 2 },
+	{ ':', '>',  0,   0,  0, 2 },
+	{ ':', ':',  0,   0,  0, 2 },
+};
+
+constexpr size_t punctuator_group_count = sizeof(punctuator_groups) / sizeof(PunctuatorGroup);
+
+/**
+* Perfect hash of the first two characters of a punctuator into a 64-entry table.
+*/
+constexpr unsigned punctuator_hash(char first, char second) {
+	return (uint16_t)((((unsigned)(unsigned char)first << 8) | (unsigned char)second) * 2009u) >> 10;
+}
+
+constexpr size_t punctuator_group_for_slot(unsigned slot, size_t i = 0) {
+	return (i == punctuator_group_count || punctuator_hash(punctuator_groups[i].first, punctuator_groups[i].second) == slot) ? i : punctuator_group_for_slot(slot, i + 1);
+}
+
+constexpr PunctuatorGroup punctuator_slot(unsigned slot) {
+	return punctuator_group_for_slot(slot) < punctuator_group_count ? punctuator_groups[punctuator_group_for_slot(slot)] : PunctuatorGroup{ 0, 0, 0, 0, 0, 1 };
+}
+
+constexpr PunctuatorGroup punctuator_table[64] = { LEXER_TABLE_64(punctuator_slot, 0) };
+
+constexpr bool punctuator_hash_is_perfect(size_t i = 0) {
+	return i == punctuator_group_count || (punctuator_group_for_slot(punctuator_hash(punctuator_groups[i].first, punctuator_groups[i].second)) == i && punctuator_hash_is_perfect(i + 1));
+}
+
+static_assert(punctuator_hash_is_perfect(), "punctuator hash has collisions");
+
+/**
+* Returns the length of the punctuator at the beginning of `data`.
+*/
+inline size_t punctuator_length(const char* data, size_t size) {
+	if (size < 2) {
+		return 1;
+	}
+	const PunctuatorGroup& group = punctuator_table[punctuator_hash(data[0], data[1])];
+	if (group.first != data[0] || group.second != data[1]) {
+		return 1;
+	}
+	if (group.long_length && size >= group.long_length && data[2] == group.third && (group.long_length < 4 || data[3] == group.fourth)) {
+		return group.long_length;
+	}
+	return group.short_length;
+}
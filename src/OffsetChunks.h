@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// chunks of offsets are split once they get twice this big
+const size_t kOffsetChunkSize = 512;
+
+/**
+* How OffsetChunks gets at the offset of a value. Values that aren't offsets themselves specialize it.
+*/
+template <class T>
+struct ChunkOffset {
+	static uint32_t& get(T& value) { return value; }
+};
+
+/**
+* A sequence of values sorted by their offsets into a buffer that's being edited, e.g. tokens or line starts.
+*
+* Until the first edit, the values are a plain vector. After that, they're split into chunks, each with a base that's
+* added to the offsets in it, so that moving everything after an edit only changes one base per chunk. The chunks
+* start out as windows of the vector and only get their own copy of their values once they're edited themselves.
+* Offsets wrap around at 4GB, so a base can be "negative".
+*/
+template <class T>
+class OffsetChunks {
+	public:
+		/**
+		* Replaces the values with `values`, which have to be sorted by offset.
+		*/
+		void assign(std::vector<T>&& values) {
+			_values = std::move(values);
+			_chunks.clear();
+			_is_chunked = false;
+		}
+
+		/**
+		* Removes the values and frees their memory.
+		*/
+		void clear() {
+			assign(std::vector<T>());
+		}
+
+		size_t size() const {
+			return _is_chunked ? _size : _values.size();
+		}
+
+		/**
+		* Returns the value at `index`, with its offset in the edited buffer.
+		*/
+		T operator[](size_t index) const {
+			if (!_is_chunked) {
+				return _values[index];
+			}
+			auto& chunk = _chunks[_chunk_index(index)];
+			return _at(chunk, index - chunk.first);
+		}
+
+		/**
+		* Returns the index of the first value for which `predicate` is false. It has to be true for every value
+		* before that one and false for every value after it.
+		*/
+		template <class Predicate>
+		size_t partition_point(Predicate predicate) const {
+			if (!_is_chunked) {
+				return std::partition_point(_values.begin(), _values.end(), predicate) - _values.begin();
+			}
+			if (!_size) {
+				return 0;
+			}
+
+			// find the first chunk whose last value fails, then the value within it
+			auto chunk = std::partition_point(_chunks.begin(), _chunks.end(), [&](const Chunk& chunk) {
+				return predicate(_at(chunk, chunk.size - 1));
+			});
+			if (chunk == _chunks.end()) {
+				return _size;
+			}
+
+			size_t begin = 0, end = chunk->size - 1;
+			while (begin < end) {
+				size_t middle = begin + (end - begin) / 2;
+				if (predicate(_at(*chunk, middle))) {
+					begin = middle + 1;
+				} else {
+					end = middle;
+				}
+			}
+			return chunk->first + begin;
+		}
+
+		/**
+		* Replaces the values at [`begin`, `end`) with `count` values at `values`, whose offsets are already in the
+		* edited buffer, and adds `delta` to the offsets of every value after them. Only the chunks that the replaced
+		* values are in are copied.
+		*/
+		void replace(size_t begin, size_t end, const T* values, size_t count, uint32_t delta) {
+			if (!_is_chunked) {
+				_split_into_chunks();
+			}
+			if (_chunks.empty()) {
+				_chunks.push_back(Chunk{0, 0, 0, nullptr, std::vector<T>()});
+			}
+
+			// the new values go in the chunk `begin` is in, followed by whatever's left of the chunk `end - 1` is in
+			size_t first = _chunk_index(std::min(begin, _size ? _size - 1 : 0));
+			size_t last = end > begin ? _chunk_index(end - 1) : first;
+
+			auto& chunk = _chunks[first];
+			auto& tail = _chunks[last];
+
+			std::vector<T> replaced;
+			replaced.reserve(begin - chunk.first + count + tail.first + tail.size - end);
+
+			auto data = _data(chunk);
+			replaced.insert(replaced.end(), data, data + (begin - chunk.first));
+
+			for (size_t i = 0; i < count; ++i) {
+				T value = values[i];
+				ChunkOffset<T>::get(value) -= chunk.base;
+				replaced.push_back(value);
+			}
+
+			auto tail_data = _data(tail);
+			for (size_t i = end - tail.first; i < tail.size; ++i) {
+				T value = tail_data[i];
+				ChunkOffset<T>::get(value) += tail.base + delta - chunk.base;
+				replaced.push_back(value);
+			}
+
+			chunk.values.swap(replaced);
+			chunk.size = chunk.values.size();
+			chunk.window = nullptr;
+
+			_chunks.erase(_chunks.begin() + first + 1, _chunks.begin() + last + 1);
+
+			for (size_t i = first + 1; i < _chunks.size(); ++i) {
+				_chunks[i].first = _chunks[i - 1].first + _chunks[i - 1].size;
+				_chunks[i].base += delta;
+			}
+
+			_size = _size - (end - begin) + count;
+
+			_rebalance(first);
+		}
+
+		/**
+		* Returns the values as a plain vector, copying them out of the chunks first if they've been edited.
+		*/
+		const std::vector<T>& flatten() {
+			if (_is_chunked) {
+				std::vector<T> values;
+				values.reserve(_size);
+				for (auto& chunk : _chunks) {
+					auto data = _data(chunk);
+					for (size_t i = 0; i < chunk.size; ++i) {
+						values.push_back(data[i]);
+						ChunkOffset<T>::get(values.back()) += chunk.base;
+					}
+				}
+				assign(std::move(values));
+			}
+			return _values;
+		}
+
+	private:
+		struct Chunk {
+			// the index of the chunk's first value
+			size_t first;
+			size_t size;
+
+			// added to the offsets stored in the chunk
+			uint32_t base;
+
+			// where the values are in `_values`, until the chunk's edited and gets its own copy of them
+			const T* window;
+			std::vector<T> values;
+		};
+
+		std::vector<T> _values;
+		std::vector<Chunk> _chunks;
+		bool _is_chunked = false;
+		size_t _size = 0;
+
+		const T* _data(const Chunk& chunk) const {
+			return chunk.window ? chunk.window : chunk.values.data();
+		}
+
+		size_t _chunk_index(size_t index) const {
+			return std::upper_bound(_chunks.begin(), _chunks.end(), index, [](size_t index, const Chunk& chunk) {
+				return index < chunk.first;
+			}) - _chunks.begin() - 1;
+		}
+
+		T _at(const Chunk& chunk, size_t index) const {
+			T value = _data(chunk)[index];
+			ChunkOffset<T>::get(value) += chunk.base;
+			return value;
+		}
+
+		void _split_into_chunks() {
+			_chunks.clear();
+			for (size_t first = 0; first < _values.size(); first += kOffsetChunkSize) {
+				_chunks.push_back(Chunk{first, std::min(kOffsetChunkSize, _values.size() - first), 0, _values.data() + first, std::vector<T>()});
+			}
+			_size = _values.size();
+			_is_chunked = true;
+		}
+
+		/**
+		* Splits the chunk at `index` if it's grown too big, or drops it if it's empty and isn't the only one.
+		*/
+		void _rebalance(size_t index) {
+			auto& chunk = _chunks[index];
+
+			if (!chunk.size && _chunks.size() > 1) {
+				_chunks.erase(_chunks.begin() + index);
+				return;
+			}
+
+			if (chunk.size < 2 * kOffsetChunkSize) {
+				return;
+			}
+
+			std::vector<Chunk> chunks;
+			for (size_t i = 0; i < chunk.size; i += kOffsetChunkSize) {
+				size_t size = std::min(kOffsetChunkSize, chunk.size - i);
+				chunks.push_back(Chunk{chunk.first + i, size, chunk.base, nullptr, std::vector<T>(chunk.values.begin() + i, chunk.values.begin() + i + size)});
+			}
+			_chunks.erase(_chunks.begin() + index);
+			_chunks.insert(_chunks.begin() + index, std::make_move_iterator(chunks.begin()), std::make_move_iterator(chunks.end()));
+		}
+};
@@ -1,114 +1,179 @@
 #include "Parser.h"
+#include "Hash.h"
 #include "Preprocessor.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <iterator>
 #include <sstream>
 
-Parser::Parser() {
-	Scope global("^");
-
-	global.types["void"]   = C3Type::VoidType();
-	global.types["auto"]   = C3Type::AutoType();
-	global.types["bool"]   = C3Type::BoolType();
-	global.types["int8"]   = C3Type::Int8Type();
-	global.types["uint8"]  = C3Type::ModifiedType(C3Type::Int8Type(), C3TypeModifierUnsigned);
-	global.types["int32"]  = C3Type::Int32Type();
-	global.types["uint32"] = C3Type::ModifiedType(C3Type::Int32Type(), C3TypeModifierUnsigned);
-	global.types["int64"]  = C3Type::Int64Type();
-	global.types["uint64"] = C3Type::ModifiedType(C3Type::Int64Type(), C3TypeModifierUnsigned);
-	global.types["double"] = C3Type::DoubleType();
-
-	_scopes.push_back(global);
-	
-	for (auto& kv : global.types) {
-		_keywords.insert(kv.first);
+void ParseError::print(SourceManager& sources) const {
+	std::string location_string = sources.location_string(location);
+	if (location_string.empty()) {
+		printf("Error: %s\n", message.c_str());
+	} else {
+		printf("%s: error: %s\n", location_string.c_str(), message.c_str());
 	}
-	
-	_keywords.insert("asm");
-	_keywords.insert("class");
-	_keywords.insert("const");
-	_keywords.insert("extern");
-	_keywords.insert("return");
-	_keywords.insert("import");
-	_keywords.insert("if");
-	_keywords.insert("else");
-	_keywords.insert("while");
-	_keywords.insert("static");
-	_keywords.insert("static_cast");
-	_keywords.insert("namespace");
-	_keywords.insert("nullptr");
+	sources.print_pointer(location);
+}
+
+namespace {
+	// how many positions each memo table holds. speculative parses don't look far back, so this can be small, but it
+	// has to be a power of two
+	const size_t kMemoCount = 64;
 
 	// TODO: respect unary precedence
-	_binary_ops["."]  = { 110, false };
-	_binary_ops["->"] = { 110, false };
-	 _unary_ops["+"]  = { 100, true };
-	 _unary_ops["-"]  = { 100, true };
-	 _unary_ops["*"]  = { 100, true };
-	 _unary_ops["&"]  = { 100, true };
-	 _unary_ops["!"]  = { 100, true };
-	_binary_ops["*"]  = {  80, false };
-	_binary_ops["/"]  = {  80, false };
-	_binary_ops["%"]  = {  80, false };
-	_binary_ops["+"]  = {  60, false };
-	_binary_ops["-"]  = {  60, false };
-	_binary_ops["<"]  = {  50, false };
-	_binary_ops["<="] = {  50, false };
-	_binary_ops[">"]  = {  50, false };
-	_binary_ops[">="] = {  50, false };
-	_binary_ops["=="] = {  40, false };
-	_binary_ops["!="] = {  40, false };
-	_binary_ops["="]  = {  20, true };
-}
-
-ASTSequence* Parser::generate_ast(const std::list<TokenPtr>& tokens) {
+	constexpr int unary_rank(TokenKind kind) {
+		return (kind == TokenKindPlus || kind == TokenKindMinus || kind == TokenKindAsterisk || kind == TokenKindAmpersand || kind == TokenKindExclamation) ? 100 : 0;
+	}
+
+	constexpr int binary_rank(TokenKind kind) {
+		return (kind == TokenKindPeriod || kind == TokenKindArrow) ? 110 :
+			(kind == TokenKindAsterisk || kind == TokenKindSlash || kind == TokenKindPercent) ? 80 :
+			(kind == TokenKindPlus || kind == TokenKindMinus) ? 60 :
+			(kind == TokenKindLessThan || kind == TokenKindLessThanOrEqual || kind == TokenKindGreaterThan || kind == TokenKindGreaterThanOrEqual) ? 50 :
+			(kind == TokenKindEquality || kind == TokenKindInequality) ? 40 :
+			(kind == TokenKindAssignment) ? 20 :
+			0;
+	}
+
+	struct OperatorRanks {
+		uint8_t unary;
+		uint8_t binary;
+		bool is_binary_rtol;
+	};
+
+	/**
+	* How tightly each kind of token binds as an operator, or 0 if it isn't one. Unary operators are always right to
+	* left.
+	*/
+	constexpr OperatorRanks kOperatorRanks[TokenKindCount] = {
+		{0, 0, false},
+#define OPERATOR_RANKS(name, spelling) {unary_rank(TokenKind##name), binary_rank(TokenKind##name), TokenKind##name == TokenKindAssignment},
+		TOKEN_KIND_KEYWORDS(OPERATOR_RANKS)
+		TOKEN_KIND_PUNCTUATORS(OPERATOR_RANKS)
+#undef OPERATOR_RANKS
+	};
+
+	void set_entity_value(PrecompiledModule::Entity& entity, C3TypePtr type) {
+		entity.kind = PrecompiledModule::EntityKindType;
+		entity.type = type;
+	}
+
+	void set_entity_value(PrecompiledModule::Entity& entity, C3VariablePtr variable) {
+		entity.kind = PrecompiledModule::EntityKindVariable;
+		entity.variable = variable;
+	}
+
+	void set_entity_value(PrecompiledModule::Entity& entity, C3FunctionPtr function) {
+		entity.kind = PrecompiledModule::EntityKindFunction;
+		entity.function = function;
+	}
+}
+
+Parser::Parser() : _type_memos(kMemoCount), _variable_memos(kMemoCount), _function_memos(kMemoCount) {
+	Scope& global = _push_scope();
+	global.reset(Symbol("^"), nullptr);
+
+	_declare(global.root.types, Symbol("void"), C3Type::VoidType());
+	_declare(global.root.types, Symbol("auto"), C3Type::AutoType());
+	_declare(global.root.types, Symbol("bool"), C3Type::BoolType());
+	_declare(global.root.types, Symbol("int8"), C3Type::Int8Type());
+	_declare(global.root.types, Symbol("uint8"), C3Type::ModifiedType(C3Type::Int8Type(), C3TypeModifierUnsigned));
+	_declare(global.root.types, Symbol("int32"), C3Type::Int32Type());
+	_declare(global.root.types, Symbol("uint32"), C3Type::ModifiedType(C3Type::Int32Type(), C3TypeModifierUnsigned));
+	_declare(global.root.types, Symbol("int64"), C3Type::Int64Type());
+	_declare(global.root.types, Symbol("uint64"), C3Type::ModifiedType(C3Type::Int64Type(), C3TypeModifierUnsigned));
+	_declare(global.root.types, Symbol("double"), C3Type::DoubleType());
+
+	_builtin_generation = _generation;
+}
+
+ASTSequence* Parser::generate_ast(TokenBuffer& tokens) {
 	// may be called recursively when importing modules
 
+	auto prev_tokens = _tokens;
 	auto prev_cur_tok = _cur_tok;
-	auto prev_end_tok = _end_tok;
 	
-	_cur_tok = tokens.begin();
-	_end_tok = tokens.end();
+	_tokens = &tokens;
+	_cur_tok = 0;
+
+	// memoized parses refer to positions in the other tokens
+	++_generation;
 
 	auto block = _parse_block();
 	
 	if (block && !_peek(ptt_end_token)) {
-		_errors.push_back(ParseError("expected end of file", _token()));
+		_errors.push_back(ParseError("expected end of file", _location()));
 		delete block;
 		block = nullptr;
 	}
 	
+	_tokens = prev_tokens;
 	_cur_tok = prev_cur_tok;
-	_end_tok = prev_end_tok;
+	++_generation;
 
 	return block;
 }
 
+void Parser::set_statement_handler(std::function<void(ASTNode*)> handler) {
+	_statement_handler = std::move(handler);
+}
+
+void Parser::set_lazy_imports(bool is_lazy) {
+	_lazy_imports = is_lazy;
+}
+
+void Parser::set_precompiled_modules(bool is_enabled) {
+	_precompiled_modules = is_enabled;
+}
+
 const std::list<ParseError>& Parser::errors() {
 	return _errors;
 }
 
-TokenPtr Parser::_token() {
-	if (_cur_tok != _end_tok) {
-		return *_cur_tok;
+SourceLocation Parser::_location() {
+	return _location(_cur_tok);
+}
+
+SourceLocation Parser::_location(TokenIterator it) {
+	auto token = _tokens->at(it);
+	return token ? _tokens->location(*token) : SourceLocation();
+}
+
+TokenRecord Parser::_record() {
+	if (auto token = _tokens->at(_cur_tok)) {
+		return *token;
 	}
 
-	class DummyToken : public Token {
-		virtual TokenType type() { return TokenTypeOther; }
-		virtual uint32_t flags() { return 0; }
-		virtual const std::string value() { return std::string(); }
-	};
-	
-	static TokenPtr dummy(new DummyToken());
+	static const TokenRecord dummy = { TokenTypeOther, 0, TokenKindNone, 0, 0, 0, { 0 } };
 	return dummy;
 }
 
+std::string Parser::_value() {
+	auto token = _tokens->at(_cur_tok);
+	return token ? _tokens->value(*token) : std::string();
+}
+
+Symbol Parser::_symbol() {
+	return _symbol(_cur_tok);
+}
+
+Symbol Parser::_symbol(TokenIterator it) {
+	auto token = _tokens->at(it);
+	return token ? _tokens->symbol(*token) : Symbol();
+}
+
 void Parser::_consume(size_t tokens) {
-	for (size_t i = 0; i < tokens && _cur_tok != _end_tok; ++i) {
+	for (size_t i = 0; i < tokens && _tokens->at(_cur_tok); ++i) {
 		++_cur_tok;
 	}
 }
 
-TokenPtr Parser::_consume_token() {
-	TokenPtr ret = _token();
+std::string Parser::_consume_value() {
+	std::string ret = _value();
 	_consume(1);
 	return ret;
 }
@@ -119,93 +184,91 @@ bool Parser::_peek(ParserTokenType type, TokenIterator* next) {
 		++*next;
 	}
 
-	TokenPtr tok = _token();
+	TokenRecord tok = _record();
 
 	switch (type) {
 		case ptt_open_angle:
-			return tok->type() == TokenTypePunctuator && tok->value() == "<";
+			return tok.kind == TokenKindLessThan;
 		case ptt_close_angle:
-			return tok->type() == TokenTypePunctuator && tok->value() == ">";
+			return tok.kind == TokenKindGreaterThan;
 		case ptt_semicolon:
-			return tok->type() == TokenTypePunctuator && tok->value() == ";";
+			return tok.kind == TokenKindSemicolon;
 		case ptt_colon:
-			return tok->type() == TokenTypePunctuator && tok->value() == ":";
+			return tok.kind == TokenKindColon;
 		case ptt_open_brace:
-			return tok->type() == TokenTypePunctuator && tok->value() == "{";
+			return tok.kind == TokenKindOpenBrace;
 		case ptt_close_brace:
-			return tok->type() == TokenTypePunctuator && tok->value() == "}";
+			return tok.kind == TokenKindCloseBrace;
 		case ptt_open_paren:
-			return tok->type() == TokenTypePunctuator && tok->value() == "(";
+			return tok.kind == TokenKindOpenParen;
 		case ptt_close_paren:
-			return tok->type() == TokenTypePunctuator && tok->value() == ")";
+			return tok.kind == TokenKindCloseParen;
 		case ptt_comma:
-			return tok->type() == TokenTypePunctuator && tok->value() == ",";
+			return tok.kind == TokenKindComma;
 		case ptt_asterisk:
-			return tok->type() == TokenTypePunctuator && tok->value() == "*";
+			return tok.kind == TokenKindAsterisk;
 		case ptt_ampersand:
-			return tok->type() == TokenTypePunctuator && tok->value() == "&";
+			return tok.kind == TokenKindAmpersand;
 		case ptt_assignment:
-			return tok->type() == TokenTypePunctuator && tok->value() == "=";
+			return tok.kind == TokenKindAssignment;
 		case ptt_equality:
-			return tok->type() == TokenTypePunctuator && tok->value() == "==";
+			return tok.kind == TokenKindEquality;
 		case ptt_inequality:
-			return tok->type() == TokenTypePunctuator && tok->value() == "!=";
+			return tok.kind == TokenKindInequality;
 		case ptt_namespace_delimiter:
-			return tok->type() == TokenTypePunctuator && tok->value() == "::";
+			return tok.kind == TokenKindNamespaceDelimiter;
 		case ptt_keyword:
-			return tok->type() == TokenTypeIdentifier && _keywords.count(tok->value()) > 0;
+			return token_kind_is_keyword(tok.kind);
 		case ptt_keyword_asm:
-			return _peek(ptt_keyword) && tok->value() == "asm";
+			return tok.kind == TokenKindKeywordAsm;
 		case ptt_keyword_auto:
-			return _peek(ptt_keyword) && tok->value() == "auto";
+			return tok.kind == TokenKindKeywordAuto;
 		case ptt_keyword_class:
-			return _peek(ptt_keyword) && tok->value() == "class";
+			return tok.kind == TokenKindKeywordClass;
 		case ptt_keyword_const:
-			return _peek(ptt_keyword) && tok->value() == "const";
+			return tok.kind == TokenKindKeywordConst;
 		case ptt_keyword_extern:
-			return _peek(ptt_keyword) && tok->value() == "extern";
+			return tok.kind == TokenKindKeywordExtern;
 		case ptt_keyword_return:
-			return _peek(ptt_keyword) && tok->value() == "return";
+			return tok.kind == TokenKindKeywordReturn;
 		case ptt_keyword_import:
-			return _peek(ptt_keyword) && tok->value() == "import";
+			return tok.kind == TokenKindKeywordImport;
 		case ptt_keyword_if:
-			return _peek(ptt_keyword) && tok->value() == "if";
+			return tok.kind == TokenKindKeywordIf;
 		case ptt_keyword_else:
-			return _peek(ptt_keyword) && tok->value() == "else";
+			return tok.kind == TokenKindKeywordElse;
 		case ptt_keyword_while:
-			return _peek(ptt_keyword) && tok->value() == "while";
+			return tok.kind == TokenKindKeywordWhile;
 		case ptt_keyword_static:
-			return _peek(ptt_keyword) && tok->value() == "static";
+			return tok.kind == TokenKindKeywordStatic;
 		case ptt_keyword_static_cast:
-			return _peek(ptt_keyword) && tok->value() == "static_cast";
+			return tok.kind == TokenKindKeywordStaticCast;
 		case ptt_keyword_namespace:
-			return _peek(ptt_keyword) && tok->value() == "namespace";
+			return tok.kind == TokenKindKeywordNamespace;
 		case ptt_keyword_nullptr:
-			return _peek(ptt_keyword) && tok->value() == "nullptr";
+			return tok.kind == TokenKindKeywordNullptr;
 		case ptt_number:
-			return tok->type() == TokenTypeNumber;
+			return tok.type == TokenTypeNumber;
 		case ptt_end_token:
-			return _cur_tok == _end_tok;
+			return !_tokens->at(_cur_tok);
 		case ptt_unary_op:
-			return tok->type() == TokenTypePunctuator && _unary_ops.find(tok->value()) != _unary_ops.end();
+			return tok.type == TokenTypePunctuator && kOperatorRanks[tok.kind].unary;
 		case ptt_binary_op:
-			return tok->type() == TokenTypePunctuator && _binary_ops.find(tok->value()) != _binary_ops.end();
+			return tok.type == TokenTypePunctuator && kOperatorRanks[tok.kind].binary;
 		case ptt_string_literal:
-			return tok->type() == TokenTypeStringLiteral;
+			return tok.type == TokenTypeStringLiteral;
 		case ptt_char_constant:
-			return tok->type() == TokenTypeCharacterConstant;
+			return tok.type == TokenTypeCharacterConstant;
 		case ptt_identifier: {
-			return tok->type() == TokenTypeIdentifier;
+			return tok.type == TokenTypeIdentifier;
 		}
 		case ptt_undefd_func_name: {
 			if (!_peek(ptt_identifier)) {
 				return false;
 			}
 
-			Scope& s = _scopes.back();
-
-			auto fit = s.functions.find(s.local_prefix() + tok->value());
-			if (fit != s.functions.end() && !fit->second->definition()) {
+			auto function = _scope().current->functions.find(_symbol());
+			if (function && !function->value->definition().is_valid()) {
 				return true;
 			}
 
@@ -220,21 +283,20 @@ bool Parser::_peek(ParserTokenType type, TokenIterator* next) {
 				return false;
 			}
 
-			Scope& s = _scopes.back();
+			auto ns = _scope().current;
 
-			if (s.variables.count(s.local_prefix() + tok->value())) {
+			if (ns->variables.count(_symbol())) {
 				return false;
 			}
 
-			if (s.functions.count(s.local_prefix() + tok->value())) {
+			if (ns->functions.count(_symbol())) {
 				return false;
 			}
 
 			return true;
 		}
 		case ptt_local_type_name: {
-			Scope& s = _scopes.back();
-			return s.types.count(s.local_prefix() + tok->value());
+			return _scope().current->types.count(_symbol());
 		}
 		case ptt_type: {
 			auto tok = _cur_tok;
@@ -244,7 +306,7 @@ bool Parser::_peek(ParserTokenType type, TokenIterator* next) {
 			return ret;
 		}
 		case ptt_type_name: {
-			return (bool)_resolve_type(tok->value());
+			return (bool)_resolve_type(QualifiedName{_cur_tok, _cur_tok + 1});
 		}
 	}
 	
@@ -265,11 +327,28 @@ bool Parser::_peek(std::initializer_list<ParserTokenType> types) {
 	return true;
 }
 
-Parser::Scope& Parser::_push_scope(const std::string& name) {
-	Scope s = Scope(_scopes.back().global_prefix() + name + ".");
-	s.return_type = _scopes.back().return_type;
-	_scopes.push_back(s);
-	return _scopes.back();
+Parser::Scope& Parser::_scope() {
+	return *_scopes[_scope_count - 1];
+}
+
+Symbol Parser::_scope_prefix(Symbol name) {
+	static const Symbol delimiter(".");
+	return Symbol::Concat(Symbol::Concat(_scope().global_prefix(), name), delimiter);
+}
+
+Parser::Scope& Parser::_push_scope(Symbol name) {
+	if (_scope_count == _scopes.size()) {
+		_scopes.emplace_back(new Scope());
+	}
+
+	++_generation;
+
+	Scope& s = *_scopes[_scope_count];
+	if (_scope_count) {
+		s.reset(_scope_prefix(name), _scope().return_type);
+	}
+	++_scope_count;
+	return s;
 }
 
 Parser::Scope& Parser::_push_scope(C3FunctionPtr function) {
@@ -279,57 +358,110 @@ Parser::Scope& Parser::_push_scope(C3FunctionPtr function) {
 }
 
 void Parser::_pop_scope() {
-	if (_scopes.size() == 1) {
+	if (_scope_count == 1) {
 		// don't pop the global scope
 		return;
 	}
 
-	_scopes.pop_back();
+	// what the scope declared is freed now rather than whenever the scope is reused
+	++_generation;
+	--_scope_count;
+	_scopes[_scope_count]->reset(Symbol(), nullptr);
 }
 
-std::string Parser::_try_parse_full_name() {
-	std::string ret = "";
+Parser::QualifiedName Parser::_try_parse_full_name() {
+	QualifiedName ret{_cur_tok, _cur_tok};
 
 	while (true) {
 		if (!_peek(ptt_identifier)) {
 			return ret;
 		}
-		ret += _token()->value();
 		_consume(1);
+		ret.end = _cur_tok;
 		if (!_peek(ptt_namespace_delimiter)) {
 			return ret;
 		}
-		ret += _token()->value();
 		_consume(1);
+		ret.end = _cur_tok;
 	}
 
 	return ret;
 }
 
-C3TypePtr Parser::_resolve_type(const std::string& name) {
-	for (auto it = _scopes.rbegin(); it != _scopes.rend(); ++it) {
-		auto& scope = *it;
-		auto namespace_copy = scope.current_namespace;
-		while (true) {
-			std::string prefix = "";
-			for (auto& str : namespace_copy) {
-				prefix += str + "::";
+template <class T>
+T Parser::_resolve(QualifiedName name, SymbolMap<Declaration<T>> Namespace::*members) {
+	if (!name.is_complete()) {
+		return nullptr;
+	}
+
+	auto last = _symbol(name.end - 1);
+
+	for (size_t i = _scope_count; i > 0; --i) {
+		auto& scope = *_scopes[i - 1];
+
+		for (auto ns = scope.current; ns; ns = ns->parent) {
+			// walk down to the namespace the name is qualified with
+			auto target = ns;
+			for (auto it = name.begin; target && it + 1 < name.end; it += 2) {
+				auto child = target->namespaces.find(_symbol(it));
+				target = child ? *child : nullptr;
 			}
-			auto it2 = scope.types.find(prefix + name);
-			if (it2 != scope.types.end()) {
-				return it2->second;
+			if (!target) {
+				continue;
 			}
-			if (namespace_copy.empty()) {
-				break;
+			const Declaration<T>* declaration = (target->*members).find(last);
+			while (declaration && declaration->generation > scope.visible_generation) {
+				declaration = declaration->previous;
+			}
+			if (declaration) {
+				return declaration->value;
 			}
-			namespace_copy.pop_back();
-		};
+		}
 	}
-	
+
 	return nullptr;
 }
 
+template <class T>
+void Parser::_declare(SymbolMap<Declaration<T>>& members, Symbol name, T value) {
+	// deferred bodies may be looking the name up, so the declaration's published whole, in front of what it replaces
+	Declaration<T> declaration;
+	declaration.value = value;
+	declaration.generation = ++_generation;
+	declaration.module = _module;
+	declaration.previous = members.find(name);
+	members.insert(name, std::move(declaration));
+}
+
+C3TypePtr Parser::_resolve_type(QualifiedName name) {
+	return _resolve(name, &Namespace::types);
+}
+
+template <class T>
+T Parser::_memoized(std::vector<Memo<T>>& memos, T (Parser::*parse)()) {
+	auto& memo = memos[_cur_tok & (memos.size() - 1)];
+
+	if (memo.generation == _generation && memo.begin == _cur_tok) {
+		_cur_tok = memo.end;
+		return memo.result;
+	}
+
+	auto begin = _cur_tok;
+	auto result = (this->*parse)();
+
+	memo.begin = begin;
+	memo.end = _cur_tok;
+	memo.generation = _generation;
+	memo.result = result;
+
+	return result;
+}
+
 C3TypePtr Parser::_try_parse_type() {
+	return _memoized(_type_memos, &Parser::_try_parse_type_unmemoized);
+}
+
+C3TypePtr Parser::_try_parse_type_unmemoized() {
 	auto start = _cur_tok;
 
 	bool is_constant = false;
@@ -369,30 +501,15 @@ C3TypePtr Parser::_try_parse_type() {
 	return type;
 }
 
-C3VariablePtr Parser::_resolveVariable(const std::string& name) {
-	for (auto it = _scopes.rbegin(); it != _scopes.rend(); ++it) {
-		auto& scope = *it;
-		auto namespace_copy = scope.current_namespace;
-		while (true) {
-			std::string prefix = "";
-			for (auto& str : namespace_copy) {
-				prefix += str + "::";
-			}
-			auto it2 = scope.variables.find(prefix + name);
-			if (it2 != scope.variables.end()) {
-				return it2->second;
-			}
-			if (namespace_copy.empty()) {
-				break;
-			}
-			namespace_copy.pop_back();
-		};
-	}
-	
-	return nullptr;
+C3VariablePtr Parser::_resolveVariable(QualifiedName name) {
+	return _resolve(name, &Namespace::variables);
 }
 
 C3VariablePtr Parser::_try_parse_variable() {
+	return _memoized(_variable_memos, &Parser::_try_parse_variable_unmemoized);
+}
+
+C3VariablePtr Parser::_try_parse_variable_unmemoized() {
 	auto start = _cur_tok;
 
 	auto name = _try_parse_full_name();
@@ -407,30 +524,19 @@ C3VariablePtr Parser::_try_parse_variable() {
 	return nullptr;
 }
 
-C3FunctionPtr Parser::_resolveFunction(const std::string& name) {
-	for (auto it = _scopes.rbegin(); it != _scopes.rend(); ++it) {
-		auto& scope = *it;
-		auto namespace_copy = scope.current_namespace;
-		while (true) {
-			std::string prefix = "";
-			for (auto& str : namespace_copy) {
-				prefix += str + "::";
-			}
-			auto it2 = scope.functions.find(prefix + name);
-			if (it2 != scope.functions.end()) {
-				return it2->second;
-			}
-			if (namespace_copy.empty()) {
-				break;
-			}
-			namespace_copy.pop_back();
-		};
-	}
-	
-	return nullptr;
+C3FunctionPtr Parser::_resolveFunction(QualifiedName name) {
+	return _resolve(name, &Namespace::functions);
 }
 
 C3FunctionPtr Parser::_try_parse_function() {
+	auto function = _memoized(_function_memos, &Parser::_try_parse_function_unmemoized);
+	if (function && _lazy_imports) {
+		_referenced_functions.insert(function.get());
+	}
+	return function;
+}
+
+C3FunctionPtr Parser::_try_parse_function_unmemoized() {
 	auto start = _cur_tok;
 
 	auto name = _try_parse_full_name();
@@ -520,7 +626,7 @@ C3TypePtr Parser::_resolve_auto_type(C3TypePtr auto_type, C3TypePtr target) {
 }
 
 ASTVariableDec* Parser::_parse_variable_dec() {
-	bool is_static = _scopes.size() == 1;
+	bool is_static = _scope_count == 1;
 
 	if (_peek(ptt_keyword_static)) {
 		is_static = true;
@@ -530,18 +636,20 @@ ASTVariableDec* Parser::_parse_variable_dec() {
 	auto type = _try_parse_type();
 
 	if (!type) {
-		_errors.push_back(ParseError("expected type", _token()));
+		_errors.push_back(ParseError("expected type", _location()));
 		return nullptr;
 	}
 
 	if (!_peek(ptt_new_variable_name)) {
-		_errors.push_back(ParseError("expected new variable name", _token()));
+		_errors.push_back(ParseError("expected new variable name", _location()));
 		return nullptr;
 	}
 
-	TokenPtr name_tok = _consume_token();
+	auto name_tok = _location();
+	Symbol name = _symbol();
+	_consume(1);
 
-	Scope& scope = _scopes.back();
+	Scope& scope = _scope();
 	
 	ASTExpression* init = nullptr;
 	
@@ -579,8 +687,8 @@ ASTVariableDec* Parser::_parse_variable_dec() {
 		_errors.push_back(ParseError("variables with auto types must have an initialization", name_tok));
 	}
 
-	C3VariablePtr var = C3VariablePtr(new C3Variable(type, name_tok->value(), scope.global_prefix() + name_tok->value(), name_tok, is_static));
-	scope.variables[scope.local_prefix() + var->name()] = var;
+	C3VariablePtr var = C3VariablePtr(new C3Variable(type, name, Symbol::Concat(scope.global_prefix(), name), name_tok, is_static));
+	_declare(scope.current->variables, name, var);
 
 	return new ASTVariableDec(var, init);
 }
@@ -588,34 +696,34 @@ ASTVariableDec* Parser::_parse_variable_dec() {
 ASTNode* Parser::_parse_function_proto_or_def(bool* was_just_proto) {
 	// function prototype	
 	bool args_are_named = false;
-	TokenPtr protoTok = _token();
+	auto proto_tok = _cur_tok;
 	ASTFunctionProto* proto = _parse_function_proto(&args_are_named);
 	if (proto && _peek(ptt_open_brace)) {
 		// function body
 		ASTNode* node = nullptr;
 		if (!args_are_named) {
 			// unnamed arguments
-			_errors.push_back(ParseError("function definition has unnamed arguments", _token()));
+			_errors.push_back(ParseError("function definition has unnamed arguments", _location()));
 			// try to recover
 			_consume(1);
 			_push_scope(proto->func);
 			delete _parse_block();
 			_pop_scope();
+		} else if (_scope_count == 1 && _defer_function_body(proto, _location(proto_tok), _lazy_imports && _import_depth > 0)) {
+			// the body's parsed once the rest of the file has been, and lazy ones only if they're needed
+			auto& deferred = _deferred_bodies.back();
+			node = deferred.is_lazy ? static_cast<ASTNode*>(proto) : deferred.node;
 		} else {
 			// set up / parse the function body
-			proto->func->set_definition(_token());
+			proto->func->set_definition(_location());
 			_consume(1);
-			_push_scope(proto->func);
-			// add the arguments to the scope
-			Scope& scope = _scopes.back();
-			for (size_t i = 0; i < proto->arg_names.size(); ++i) {
-				scope.variables[proto->arg_names[i]] = C3VariablePtr(new C3Variable(proto->func->arg_types()[i], proto->arg_names[i], scope.global_prefix() + proto->arg_names[i], protoTok));
-			}
+			Scope& scope = _push_scope(proto->func);
+			_declare_arguments(proto->func, proto->arg_names, _location(proto_tok));
 			// parse the body
 			ASTSequence* body = _parse_block();
 			if (body) {
 				if (!_peek(ptt_close_brace)) {
-					_errors.push_back(ParseError("expected closing brace", _token()));
+					_errors.push_back(ParseError("expected closing brace", _location()));
 					delete body;
 				} else {
 					_consume(1); // }
@@ -638,56 +746,226 @@ ASTNode* Parser::_parse_function_proto_or_def(bool* was_just_proto) {
 	return proto;
 }
 
+void Parser::_declare_arguments(C3FunctionPtr function, const std::vector<Symbol>& names, SourceLocation location) {
+	Scope& scope = _scope();
+	for (size_t i = 0; i < names.size(); ++i) {
+		_declare(scope.root.variables, names[i], C3VariablePtr(new C3Variable(function->arg_types()[i], names[i], Symbol::Concat(scope.global_prefix(), names[i]), location)));
+	}
+}
+
+bool Parser::_defer_function_body(ASTFunctionProto* proto, SourceLocation arg_location, bool is_lazy) {
+	if (!is_lazy && ThreadPool::Shared().size() < 2) {
+		// there'd be nothing to parse the bodies in parallel with
+		return false;
+	}
+
+	// find the closing brace
+	auto end = _cur_tok;
+	for (size_t depth = 0;; ++end) {
+		auto token = _tokens->at(end);
+		if (!token) {
+			// leave it to the usual error handling
+			return false;
+		}
+		if (token->kind == TokenKindOpenBrace) {
+			++depth;
+		} else if (token->kind == TokenKindCloseBrace && --depth == 0) {
+			break;
+		}
+	}
+
+	proto->func->set_definition(_location());
+
+	DeferredBody deferred;
+	deferred.is_lazy = is_lazy;
+	deferred.is_needed = !is_lazy;
+	deferred.function = proto->func;
+	deferred.arg_names = proto->arg_names;
+	deferred.arg_location = arg_location;
+	deferred.arg_prefix = _scope_prefix(proto->func->name());
+	if (!is_lazy) {
+		deferred.node = new ASTFunctionDef(proto, nullptr, deferred.arg_prefix);
+	}
+	deferred.tokens = _tokens->copy(_cur_tok, end + 1);
+	deferred.sources = &_tokens->sources();
+	deferred.ns = _scope().current;
+	deferred.generation = _generation;
+	deferred.preceding_errors = _errors.size();
+	deferred.statement = _top_level->sequence.size();
+	_deferred_bodies.push_back(std::move(deferred));
+
+	if (!is_lazy) {
+		_submit_deferred_body(_deferred_bodies.back());
+	}
+
+	_cur_tok = end + 1;
+	return true;
+}
+
+bool Parser::_parse_deferred_bodies() {
+	if (_deferred_bodies.empty()) {
+		return true;
+	}
+
+	for (auto& deferred : _deferred_bodies) {
+		if (deferred.is_needed) {
+			_wait_for_deferred_body(deferred);
+		}
+	}
+
+	// lazy bodies become needed as the bodies that are parsed reference their functions
+	while (true) {
+		std::vector<DeferredBody*> bodies;
+		for (auto& deferred : _deferred_bodies) {
+			if (!deferred.is_needed && _referenced_functions.count(deferred.function.get())) {
+				deferred.is_needed = true;
+				_submit_deferred_body(deferred);
+				bodies.push_back(&deferred);
+			}
+		}
+		if (bodies.empty()) {
+			break;
+		}
+		for (auto deferred : bodies) {
+			_wait_for_deferred_body(*deferred);
+		}
+	}
+
+	// put each body's errors where they'd have been if it had been parsed in place
+	std::list<ParseError> errors;
+	size_t merged = 0;
+
+	for (auto& deferred : _deferred_bodies) {
+		if (!deferred.is_needed) {
+			continue;
+		}
+		errors.splice(errors.end(), _errors, _errors.begin(), std::next(_errors.begin(), deferred.preceding_errors - merged));
+		merged = deferred.preceding_errors;
+		errors.splice(errors.end(), deferred.errors);
+		if (!deferred.body) {
+			// the parse would have stopped here
+			_errors.swap(errors);
+			return false;
+		}
+	}
+
+	errors.splice(errors.end(), _errors);
+	_errors.swap(errors);
+	return true;
+}
+
+void Parser::_submit_deferred_body(DeferredBody& deferred) {
+	auto lazy_imports = _lazy_imports;
+
+	deferred.parsed = ThreadPool::Shared().submit([&deferred, lazy_imports]() {
+		// bodies never wait on the pool, so a thread's parser is only ever parsing one at a time
+		static thread_local Parser parser;
+		parser._lazy_imports = lazy_imports;
+		parser._parse_deferred_body(deferred);
+
+		std::unordered_set<const C3Function*> referenced;
+		referenced.swap(parser._referenced_functions);
+		return referenced;
+	});
+}
+
+void Parser::_wait_for_deferred_body(DeferredBody& deferred) {
+	if (deferred.parsed.valid()) {
+		auto referenced = ThreadPool::Shared().wait(deferred.parsed);
+		_referenced_functions.insert(referenced.begin(), referenced.end());
+	}
+}
+
+void Parser::_parse_deferred_body(DeferredBody& deferred) {
+	TokenBuffer tokens(*deferred.sources);
+	tokens.append(deferred.tokens);
+
+	_tokens = &tokens;
+	_cur_tok = 0;
+	++_generation;
+
+	// look things up in the file's global scope as it was when the body was skipped
+	Scope& global = _scope();
+	global.current = deferred.ns;
+	global.visible_generation = deferred.generation;
+
+	_consume(1); // {
+	_push_scope(deferred.function);
+	_declare_arguments(deferred.function, deferred.arg_names, deferred.arg_location);
+
+	ASTSequence* body = _parse_block();
+	if (body && !_peek(ptt_close_brace)) {
+		_errors.push_back(ParseError("expected closing brace", _location()));
+		delete body;
+		body = nullptr;
+	}
+
+	// the parser's used again for the thread's next body, even if this one stopped partway into a scope
+	while (_scope_count > 1) {
+		_pop_scope();
+	}
+
+	global.current = &global.root;
+	global.visible_generation = UINT64_MAX;
+
+	_tokens = nullptr;
+
+	deferred.body = body;
+	deferred.errors.swap(_errors);
+}
+
 ASTFunctionProto* Parser::_parse_function_proto(bool* args_are_named) {
 	auto return_type = _try_parse_type();
 	
 	if (!return_type) {
-		_errors.push_back(ParseError("expected type", _token()));
+		_errors.push_back(ParseError("expected type", _location()));
 		return nullptr;
 	}
 	
 	if (return_type->is_auto()) {
-		_errors.push_back(ParseError("cannot declare an auto return type", _token()));
+		_errors.push_back(ParseError("cannot declare an auto return type", _location()));
 		return nullptr;
 	}
 	
 	if (!_peek(ptt_undefd_func_name)) {
-		_errors.push_back(ParseError("expected undefined function name", _token()));
+		_errors.push_back(ParseError("expected undefined function name", _location()));
 		return nullptr;
 	}
 
-	TokenPtr tok = _consume_token();
+	auto tok = _location();
+	Symbol func_name = _symbol();
+	_consume(1);
 	
 	if (!_peek(ptt_open_paren)) {
-		_errors.push_back(ParseError("expected open parenthesis", _token()));
+		_errors.push_back(ParseError("expected open parenthesis", _location()));
 		return nullptr;
 	}
 
 	_consume(1); // consume open parenthesis
 
 	std::vector<C3TypePtr>   args;
-	std::vector<std::string> names;
+	std::vector<Symbol>      names;
 	
 	while (!_peek(ptt_close_paren)) {
 		C3TypePtr arg_type = _try_parse_type();
 
 		if (!arg_type) {
-			_errors.push_back(ParseError("expected argument type", _token()));
+			_errors.push_back(ParseError("expected argument type", _location()));
 			return nullptr;
 		}
 
 		if (arg_type->is_auto()) {
-			_errors.push_back(ParseError("cannot declare an auto argument type", _token()));
+			_errors.push_back(ParseError("cannot declare an auto argument type", _location()));
 			return nullptr;
 		}
 
 		bool named = false;
 		if (_peek(ptt_identifier) && !_peek(ptt_type_name)) {
-			std::string name = _token()->value();
+			Symbol name = _symbol();
 			named = true;
-			for (std::string& n : names) {
+			for (Symbol n : names) {
 				if (name == n) {
-					_errors.push_back(ParseError("duplicate argument name", _token()));
+					_errors.push_back(ParseError("duplicate argument name", _location()));
 					return nullptr;
 				}
 			}
@@ -700,7 +978,7 @@ ASTFunctionProto* Parser::_parse_function_proto(bool* args_are_named) {
 		if (_peek(ptt_comma)) {
 			_consume(1);
 		} else if (!_peek(ptt_close_paren)) {
-			_errors.push_back(ParseError(named ? "expected comma or end of argument list" : "expected comma, name, or end of argument list", _token()));
+			_errors.push_back(ParseError(named ? "expected comma or end of argument list" : "expected comma, name, or end of argument list", _location()));
 			return nullptr;
 		}		
 	}
@@ -711,34 +989,35 @@ ASTFunctionProto* Parser::_parse_function_proto(bool* args_are_named) {
 		*args_are_named = (args.size() == names.size());
 	}
 
-	Scope& scope = _scopes.back();
-	auto global_name = scope.global_prefix() + tok->value();
-	if (global_name == _scopes.front().prefix + "main") {
-		global_name = "main";
+	Scope& scope = _scope();
+	static const Symbol main_name("main");
+	auto global_name = Symbol::Concat(scope.global_prefix(), func_name);
+	if (global_name == Symbol::Concat(_scopes[0]->prefix(), main_name)) {
+		global_name = main_name;
 	}
-	C3FunctionPtr func = C3FunctionPtr(new C3Function(return_type, tok->value(), global_name, std::move(args), tok));
+	C3FunctionPtr func = C3FunctionPtr(new C3Function(return_type, func_name, global_name, std::move(args), tok));
 
-	auto fit = scope.functions.find(tok->value());
-	if (fit != scope.functions.end()) {
-		if (func->signature() != fit->second->signature()) {
+	auto previous = scope.current->functions.find(func_name);
+	if (previous) {
+		if (func->signature() != previous->value->signature()) {
 			_errors.push_back(ParseError("function has different signature than previous declaration", tok));
 			return nullptr;
 		}
-		return new ASTFunctionProto(fit->second, names);
+		return new ASTFunctionProto(previous->value, names);
 	}
 
-	scope.functions[scope.local_prefix() + func->name()] = func;
+	_declare(scope.current->functions, func_name, func);
 	return new ASTFunctionProto(func, names);
 }
 
 ASTFunctionCall* Parser::_parse_function_call(ASTExpression* func) {
 	if (func->type->type() != C3TypeTypeFunction) {
-		_errors.push_back(ParseError("previous expression is not a function", _token()));
+		_errors.push_back(ParseError("previous expression is not a function", _location()));
 		return nullptr;
 	}
 	
 	if (!_peek(ptt_open_paren)) {
-		_errors.push_back(ParseError("expected '('", _token()));
+		_errors.push_back(ParseError("expected '('", _location()));
 		return nullptr;
 	}
 	_consume(1); // consume '('
@@ -749,7 +1028,7 @@ ASTFunctionCall* Parser::_parse_function_call(ASTExpression* func) {
 	for (size_t i = 0; i < arg_types.size(); ++i) {
 		if (i > 0) {
 			if (!_peek(ptt_comma)) {
-				_errors.push_back(ParseError("expected ','", _token()));
+				_errors.push_back(ParseError("expected ','", _location()));
 				for (ASTExpression* exp : args) {
 					delete exp;
 				}
@@ -757,7 +1036,7 @@ ASTFunctionCall* Parser::_parse_function_call(ASTExpression* func) {
 			}
 			_consume(1); // consume comma
 		}
-		TokenPtr arg_tok = _token();
+		auto arg_tok = _cur_tok;
 		ASTExpression* arg = _parse_expression();
 		if (!arg) {
 			for (ASTExpression* exp : args) {
@@ -769,14 +1048,14 @@ ASTFunctionCall* Parser::_parse_function_call(ASTExpression* func) {
 		if (!converted) {
 			std::string msg = "invalid type for argument (expected '";
 			msg += arg_types[i]->name() + "' but got '" + arg->type->name() + "')";
-			_errors.push_back(ParseError(msg, arg_tok));
+			_errors.push_back(ParseError(msg, _location(arg_tok)));
 			// try to recover...
 		}
 		args.push_back(converted ? converted : arg);
 	}
 
 	if (!_peek(ptt_close_paren)) {
-		_errors.push_back(ParseError("expected ')'", _token()));
+		_errors.push_back(ParseError("expected ')'", _location()));
 		for (ASTExpression* exp : args) {
 			delete exp;
 		}
@@ -797,14 +1076,15 @@ ASTNode* Parser::_parse_class_dec_or_def() {
 	_consume(1); // struct
 	
 	if (!_peek(ptt_new_type_name)) {
-		_errors.push_back(ParseError("expected new type name", _token()));
+		_errors.push_back(ParseError("expected new type name", _location()));
 		return nullptr;
 	}
 	
-	auto name = _consume_token();
+	Symbol name = _symbol();
+	_consume(1);
 	
 	if (!_peek(ptt_open_brace)) {
-		_errors.push_back(ParseError("expected opening brace", _token()));
+		_errors.push_back(ParseError("expected opening brace", _location()));
 		return nullptr;
 	}
 	
@@ -812,25 +1092,25 @@ ASTNode* Parser::_parse_class_dec_or_def() {
 	
 	std::vector<C3StructDefinition::MemberVariable> member_vars;
 	
-	_push_scope(name->value());
+	_push_scope(name);
 	while (!_peek(ptt_close_brace)) {
 		C3TypePtr type = _try_parse_type();
 		if (!type) {
-			_errors.push_back(ParseError("expected type", _token()));
+			_errors.push_back(ParseError("expected type", _location()));
 			return nullptr;
 		}
 		if (type->is_auto()) {
-			_errors.push_back(ParseError("cannot declare an auto member type", _token()));
+			_errors.push_back(ParseError("cannot declare an auto member type", _location()));
 			return nullptr;
 		}
 		if (!_peek(ptt_new_variable_name)) {
-			_errors.push_back(ParseError("expected new member name", _token()));
+			_errors.push_back(ParseError("expected new member name", _location()));
 			return nullptr;
 		}
-		auto name = _consume_token();
-		member_vars.emplace_back(name->value(), type);
+		member_vars.emplace_back(_symbol(), type);
+		_consume(1);
 		if (!_peek(ptt_semicolon)) {
-			_errors.push_back(ParseError("expected semicolon", _token()));
+			_errors.push_back(ParseError("expected semicolon", _location()));
 			// try to recover
 		} else {
 			_consume(1); // ;
@@ -839,76 +1119,62 @@ ASTNode* Parser::_parse_class_dec_or_def() {
 	_pop_scope();
 
 	if (!_peek(ptt_close_brace)) {
-		_errors.push_back(ParseError("expected closing brace", _token()));
+		_errors.push_back(ParseError("expected closing brace", _location()));
 		return nullptr;
 	}
 
 	_consume(1); // }
 
-	Scope& scope = _scopes.back();
-	scope.types[scope.local_prefix() + name->value()] = C3Type::StructType(name->value(), scope.global_prefix() + name->value(), C3StructDefinition(std::move(member_vars)));
+	Scope& scope = _scope();
+	_declare(scope.current->types, name, C3Type::StructType(name.str(), Symbol::Concat(scope.global_prefix(), name), C3StructDefinition(std::move(member_vars))));
 
 	return new ASTNop();
 }
 
-ASTExpression* Parser::_parse_binop_rhs(ASTExpression* lhs) {
-	TokenPtr tok = _consume_token();
+ASTExpression* Parser::_parse_selection(ASTExpression* lhs) {
+	TokenKind kind = _record().kind;
+	_consume(1); // . or ->
 
-	if (tok->type() != TokenTypePunctuator || tok->value() == ";") {
-		_errors.push_back(ParseError("expected binary operator", _token()));
-		delete lhs;
-		return nullptr;
-	}
-	
-	if (tok->value() == "." || tok->value() == "->") {
-		if (tok->value() == "->") {
-			if (C3Type::RemoveReference(lhs->type)->type() != C3TypeTypePointer) {
-				_errors.push_back(ParseError(std::string("dereferencing selection operator used on non-pointer type '" + lhs->type->name() + "'"), _token()));
-				delete lhs;
-				return nullptr;
-			}
-			lhs = new ASTUnaryOp("*", lhs, C3Type::ReferenceType(C3Type::RemoveReference(lhs->type)->pointed_to_type()));
-		}
-		auto type = lhs->type;
-		auto rr_type = C3Type::RemoveReference(type);
-		if (rr_type->type() != C3TypeTypeStruct) {
-			_errors.push_back(ParseError(std::string("selection operator used on non-struct type '") + type->name() + "'", _token()));
+	if (kind == TokenKindArrow) {
+		if (C3Type::RemoveReference(lhs->type)->type() != C3TypeTypePointer) {
+			_errors.push_back(ParseError(std::string("dereferencing selection operator used on non-pointer type '" + lhs->type->name() + "'"), _location()));
 			delete lhs;
 			return nullptr;
 		}
-		if (!rr_type->is_defined()) {
-			_errors.push_back(ParseError("selection operator used on undefined struct", _token()));
-			delete lhs;
-			return nullptr;
-		}
-		auto member_vars = rr_type->struct_definition().member_vars();
-		for (size_t i = 0; i < member_vars.size(); ++i) {
-			if (member_vars[i].name == _token()->value()) {
-				_consume(1); // member name
-				return new ASTStructMemberRef(lhs, i);
-			}
-		}
-		_errors.push_back(ParseError("expected struct member", _token()));
+		lhs = new ASTUnaryOp("*", lhs, C3Type::ReferenceType(C3Type::RemoveReference(lhs->type)->pointed_to_type()));
+	}
+	auto type = lhs->type;
+	auto rr_type = C3Type::RemoveReference(type);
+	if (rr_type->type() != C3TypeTypeStruct) {
+		_errors.push_back(ParseError(std::string("selection operator used on non-struct type '") + type->name() + "'", _location()));
 		delete lhs;
 		return nullptr;
 	}
-	
-	auto precedence = _binary_ops[tok->value()];
-
-	ASTExpression* rhs = _parse_expression(precedence);
-
-	if (!rhs) {
+	if (!rr_type->is_defined()) {
+		_errors.push_back(ParseError("selection operator used on undefined struct", _location()));
 		delete lhs;
 		return nullptr;
 	}
+	auto member_vars = rr_type->struct_definition().member_vars();
+	for (size_t i = 0; i < member_vars.size(); ++i) {
+		if (member_vars[i].name == _symbol()) {
+			_consume(1); // member name
+			return new ASTStructMemberRef(lhs, i);
+		}
+	}
+	_errors.push_back(ParseError("expected struct member", _location()));
+	delete lhs;
+	return nullptr;
+}
 
+ASTExpression* Parser::_binary_operation(TokenIterator tok, TokenKind kind, ASTExpression* lhs, ASTExpression* rhs) {
 	auto lhs_rr_type = C3Type::RemoveReference(lhs->type);
 	auto rhs_rr_type = C3Type::RemoveReference(rhs->type);
 
 	C3TypePtr result_type = lhs_rr_type;
 	bool compatible = false;
 
-	if (tok->value() == "=") {
+	if (kind == TokenKindAssignment) {
 		if (!lhs->type->referenced_type() || lhs->type->is_constant()) {
 			compatible = false;
 		} else if (auto converted = _implicit_conversion(rhs, lhs->type->referenced_type())) {
@@ -917,7 +1183,7 @@ ASTExpression* Parser::_parse_binop_rhs(ASTExpression* lhs) {
 		} else {
 			compatible = false;
 		}
-	} else if (tok->value() == "==" || tok->value() == "!=" || tok->value() == "<" || tok->value() == "<=" || tok->value() == ">" || tok->value() == ">=") {
+	} else if (kind == TokenKindEquality || kind == TokenKindInequality || kind == TokenKindLessThan || kind == TokenKindLessThanOrEqual || kind == TokenKindGreaterThan || kind == TokenKindGreaterThanOrEqual) {
 		compatible = ((lhs_rr_type->is_floating_point() && rhs_rr_type->is_floating_point()) || (lhs_rr_type->is_integer() && rhs_rr_type->is_integer()));
 		result_type = C3Type::BoolType();
 	} else if (*lhs_rr_type == *rhs_rr_type) {
@@ -927,7 +1193,7 @@ ASTExpression* Parser::_parse_binop_rhs(ASTExpression* lhs) {
 		// integers are compatible because they get promoted as necessary
 		compatible = true;
 		result_type = C3Type::Int64Type();
-	} else if (lhs_rr_type->type() == C3TypeTypePointer && lhs_rr_type->pointed_to_type()->type() != C3TypeTypeVoid && rhs_rr_type->is_integer() && (tok->value() == "+" || tok->value() == "-")) {
+	} else if (lhs_rr_type->type() == C3TypeTypePointer && lhs_rr_type->pointed_to_type()->type() != C3TypeTypeVoid && rhs_rr_type->is_integer() && (kind == TokenKindPlus || kind == TokenKindMinus)) {
 		// pointer arithmetic
 		compatible = true;
 	}
@@ -935,44 +1201,44 @@ ASTExpression* Parser::_parse_binop_rhs(ASTExpression* lhs) {
 	if (!compatible) {
 		std::string msg = "incompatible types to binary operator ('";
 		msg += lhs->type->name() + "' and '" + rhs->type->name() + "')";
-		_errors.push_back(ParseError(msg, tok));
+		_errors.push_back(ParseError(msg, _location(tok)));
 		// try to recover...
 	}
 
-	return new ASTBinaryOp(tok->value(), lhs, rhs, result_type);
+	return new ASTBinaryOp(token_kind_spelling(kind), lhs, rhs, result_type);
 }
 
 ASTExpression* Parser::_parse_inline_asm_operand(std::string* constraint) {
 	if (!_peek(ptt_string_literal)) {
-		_errors.push_back(ParseError("expected string literal constraint", _token()));	
+		_errors.push_back(ParseError("expected string literal constraint", _location()));	
 		return nullptr;
 	}
 
 	// TODO: check constraints more closely
 	
-	if (_token()->value().find(',') != std::string::npos) {
-		_errors.push_back(ParseError("invalid constraint", _token()));
+	if (_value().find(',') != std::string::npos) {
+		_errors.push_back(ParseError("invalid constraint", _location()));
 		// recover...
 	}
 	
-	TokenPtr ctok = _consume_token();
-	if (ctok->value() == "m") {
+	std::string value = _consume_value();
+	if (value == "m") {
 		// make all memory operands indirect
 		*constraint = "*m";
-	} else if (ctok->value() == "=m") {
+	} else if (value == "=m") {
 		// make all memory operands indirect
 		*constraint = "=*m";
 	} else {
-		*constraint = ctok->value();
+		*constraint = value;
 	}
 	
 	if (!_peek(ptt_open_paren)) {
-		_errors.push_back(ParseError("expected '('", _token()));
+		_errors.push_back(ParseError("expected '('", _location()));
 		return nullptr;
 	}
 	_consume(1);
 
-	TokenPtr etok = _token();
+	auto etok = _cur_tok;
 	ASTExpression* exp = _parse_expression();
 
 	if (!exp) {
@@ -980,12 +1246,12 @@ ASTExpression* Parser::_parse_inline_asm_operand(std::string* constraint) {
 	}
 	
 	if ((*constraint)[0] == '*' && !exp->type->referenced_type()) {
-		_errors.push_back(ParseError("operand must be reference for indirect constraint", etok));
+		_errors.push_back(ParseError("operand must be reference for indirect constraint", _location(etok)));
 		// recover...
 	}
 
 	if (!_peek(ptt_close_paren)) {
-		_errors.push_back(ParseError("expected ')'", _token()));
+		_errors.push_back(ParseError("expected ')'", _location()));
 		delete exp;
 		return nullptr;
 	}
@@ -996,22 +1262,22 @@ ASTExpression* Parser::_parse_inline_asm_operand(std::string* constraint) {
 
 ASTInlineAsm* Parser::_parse_inline_asm() {
 	if (!_peek(ptt_keyword_asm)) {
-		_errors.push_back(ParseError("expected 'asm'", _token()));
+		_errors.push_back(ParseError("expected 'asm'", _location()));
 		return nullptr;
 	}
 	_consume(1);
 
 	if (!_peek(ptt_open_paren)) {
-		_errors.push_back(ParseError("expected '('", _token()));
+		_errors.push_back(ParseError("expected '('", _location()));
 		return nullptr;
 	}
 	_consume(1);
 	
 	if (!_peek(ptt_string_literal)) {
-		_errors.push_back(ParseError("expected string literal assembly", _token()));	
+		_errors.push_back(ParseError("expected string literal assembly", _location()));	
 		return nullptr;
 	}
-	std::string assembly = _consume_token()->value();
+	std::string assembly = _consume_value();
 	
 	bool failure = false;
 	std::vector<ASTExpression*> outputs;
@@ -1025,14 +1291,14 @@ ASTInlineAsm* Parser::_parse_inline_asm() {
 			// parse output operands
 			while (true) {
 				std::string constraint;
-				TokenPtr optok = _token();
+				auto optok = _cur_tok;
 				ASTExpression* exp = _parse_inline_asm_operand(&constraint);
 				if (!exp) {
 					failure = true;
 					break;
 				}
 				if (!exp->type->referenced_type()) {
-					_errors.push_back(ParseError("output operand must be reference", optok));
+					_errors.push_back(ParseError("output operand must be reference", _location(optok)));
 					// try to recover...
 				}
 				constraints.push_back(constraint);
@@ -1079,15 +1345,15 @@ ASTInlineAsm* Parser::_parse_inline_asm() {
 			// parse clobbers
 			while (true) {
 				if (!_peek(ptt_string_literal)) {
-					_errors.push_back(ParseError("expected string literal clobber", _token()));
+					_errors.push_back(ParseError("expected string literal clobber", _location()));
 					failure = true;
 					break;
 				}
-				if (_token()->value().find(',') != std::string::npos) {
-					_errors.push_back(ParseError("invalid clobber", _token()));
+				if (_value().find(',') != std::string::npos) {
+					_errors.push_back(ParseError("invalid clobber", _location()));
 					// recover...
 				}
-				constraints.push_back("~{" + _consume_token()->value() + '}');
+				constraints.push_back("~{" + _consume_value() + '}');
 				if (!_peek(ptt_comma)) {
 					break;
 				}
@@ -1098,7 +1364,7 @@ ASTInlineAsm* Parser::_parse_inline_asm() {
 
 	if (!failure) {
 		if (!_peek(ptt_close_paren)) {
-			_errors.push_back(ParseError("expected ')'", _token()));
+			_errors.push_back(ParseError("expected ')'", _location()));
 			failure = true;
 		} else {
 			_consume(1);
@@ -1120,7 +1386,7 @@ ASTInlineAsm* Parser::_parse_inline_asm() {
 
 ASTNode* Parser::_parse_external_declaration() {
 	if (!_peek(ptt_keyword_extern)) {
-		_errors.push_back(ParseError("expected 'extern'", _token()));
+		_errors.push_back(ParseError("expected 'extern'", _location()));
 		return nullptr;
 	}
 	
@@ -1132,34 +1398,33 @@ ASTNode* Parser::_parse_external_declaration() {
 	}
 	
 	if (!_peek(ptt_colon)) {
-		_errors.push_back(ParseError("expected colon", _token()));
+		_errors.push_back(ParseError("expected colon", _location()));
 		// try to continue
 	} else {
 		_consume(1);
 	}
 
 	if (!_peek(ptt_string_literal)) {
-		_errors.push_back(ParseError("expected external symbol name (a string literal)", _token()));
+		_errors.push_back(ParseError("expected external symbol name (a string literal)", _location()));
 		delete proto;
 		return nullptr;
 	}
 	
-	auto symbol = _consume_token();
-	proto->func->set_global_name(symbol->value());
+	proto->func->set_global_name(Symbol(_consume_value()));
 	
 	return proto;
 }
 
 ASTReturn* Parser::_parse_return() {
 	if (!_peek(ptt_keyword_return)) {
-		_errors.push_back(ParseError("expected 'return'", _token()));
+		_errors.push_back(ParseError("expected 'return'", _location()));
 		return nullptr;
 	}
 	
-	C3TypePtr expected_type = _scopes.back().return_type;
+	C3TypePtr expected_type = _scope().return_type;
 	
 	if (!expected_type) {
-		_errors.push_back(ParseError("unexpected return statement", _token()));
+		_errors.push_back(ParseError("unexpected return statement", _location()));
 		// recover...
 	}
 
@@ -1180,7 +1445,7 @@ ASTReturn* Parser::_parse_return() {
 	if (!converted) {
 		std::string msg = "invalid return type (expected '";
 		msg += expected_type->name() + "' but got '" + exp->type->name() + "'";
-		_errors.push_back(ParseError(msg, _token()));
+		_errors.push_back(ParseError(msg, _location()));
 		// recover...
 	}
 	
@@ -1201,79 +1466,69 @@ ASTExpression* Parser::_parse_primary() {
 		return new ASTNullPointer(C3Type::NullPointerType());
 	} else if (_peek(ptt_number)) {
 		// number
-		TokenPtr tok = _consume_token();
-		if (tok->value().find_first_of('.') != std::string::npos) {
-			return new ASTFloatingPoint(atof(tok->value().c_str()), C3Type::DoubleType());
+		std::string number = _value();
+		_consume(1);
+		if (number.find_first_of('.') != std::string::npos) {
+			return new ASTFloatingPoint(atof(number.c_str()), C3Type::DoubleType());
 		} else {
 			// TODO: support other bases
-			return new ASTInteger(strtoll(tok->value().c_str(), NULL, 10), C3Type::Int64Type());
+			return new ASTInteger(strtoll(number.c_str(), NULL, 10), C3Type::Int64Type());
 		}
 	} else if (_peek(ptt_char_constant)) {
 		// character constant
-		TokenPtr tok = _consume_token();
+		std::string constant = _value();
+		_consume(1);
 		uint64_t value = 0;
-		for (const char& c : tok->value()) {
+		for (const char& c : constant) {
 			value <<= 8;
 			value |= (unsigned char)c;
 		}
 		return new ASTInteger(value, C3Type::Int64Type());
 	} else if (_peek(ptt_string_literal)) {
 		// string literal
-		TokenPtr tok = _consume_token();
-		return new ASTConstantArray(tok->value().c_str(), tok->value().size(), C3Type::ModifiedType(C3Type::Int8Type(), C3TypeModifierUnsigned | C3TypeModifierConstant));
-	} else if (_peek(ptt_open_paren)) {
-		// parenthesized expression
-		_consume(1); // (
-		auto exp = _parse_expression();
-		if (!exp) {
-			return nullptr;
-		}
-		if (!_peek(ptt_close_paren)) {
-			_errors.push_back(ParseError("expected closing parenthesis", _token()));
-			delete exp;
-			return nullptr;
-		}
-		_consume(1); // )
-		return exp;
+		std::string literal = _value();
+		_consume(1);
+		return new ASTConstantArray(literal.c_str(), literal.size(), C3Type::ModifiedType(C3Type::Int8Type(), C3TypeModifierUnsigned | C3TypeModifierConstant));
 	}
 
-	_errors.push_back(ParseError("unexpected token", _token())); // intentionally vague
+	_errors.push_back(ParseError("unexpected token", _location())); // intentionally vague
 	return nullptr;
 }
 
 ASTCast* Parser::_parse_static_cast() {
 	if (!_peek(ptt_keyword_static_cast)) {
-		_errors.push_back(ParseError("expected static_cast", _token()));
+		_errors.push_back(ParseError("expected static_cast", _location()));
 		return nullptr;
 	}
 	
-	auto static_cast_tok = _consume_token();
+	auto static_cast_tok = _location();
+	_consume(1);
 	
 	if (!_peek(ptt_open_angle)) {
-		_errors.push_back(ParseError("expected opening angle bracket for type", _token()));
+		_errors.push_back(ParseError("expected opening angle bracket for type", _location()));
 		return nullptr;
 	}
 	_consume(1); // <
 
 	auto type = _try_parse_type();
 	if (!type) {
-		_errors.push_back(ParseError("expected type", _token()));
+		_errors.push_back(ParseError("expected type", _location()));
 		return nullptr;
 	}
 
 	if (type->is_auto()) {
-		_errors.push_back(ParseError("cannot static cast to auto type", _token()));
+		_errors.push_back(ParseError("cannot static cast to auto type", _location()));
 		return nullptr;
 	}
 
 	if (!_peek(ptt_close_angle)) {
-		_errors.push_back(ParseError("expected closing angle bracket for type", _token()));
+		_errors.push_back(ParseError("expected closing angle bracket for type", _location()));
 		return nullptr;
 	}
 	_consume(1); // >
 
 	if (!_peek(ptt_open_paren)) {
-		_errors.push_back(ParseError("expected opening parenthesis", _token()));
+		_errors.push_back(ParseError("expected opening parenthesis", _location()));
 		return nullptr;
 	}
 	_consume(1); // (
@@ -1284,7 +1539,7 @@ ASTCast* Parser::_parse_static_cast() {
 	}
 
 	if (!_peek(ptt_close_paren)) {
-		_errors.push_back(ParseError("expected closing parenthesis", _token()));
+		_errors.push_back(ParseError("expected closing parenthesis", _location()));
 		delete expression;
 		return nullptr;
 	}
@@ -1301,171 +1556,655 @@ ASTCast* Parser::_parse_static_cast() {
 	return new ASTCast(expression, type);
 }
 		
-ASTExpression* Parser::_parse_expression(Precedence minPrecedence) {
+ASTExpression* Parser::_unary_operation(TokenKind kind, TokenIterator operand_tok, ASTExpression* operand) {
 	ASTExpression* exp = nullptr;
+	std::string op = token_kind_spelling(kind);
 
-	if (_peek(ptt_unary_op)) {
-		// unary operation
-
-		auto precedence = _unary_ops[_token()->value()];
-		
-		if (precedence.rank < minPrecedence.rank || (precedence.rank == minPrecedence.rank && !minPrecedence.rtol)) {
-			return nullptr;
+	if (kind == TokenKindAmpersand) {
+		if (!operand->type->referenced_type()) {
+			_errors.push_back(ParseError("operand to '&' operator must be a reference", _location(operand_tok)));
+		} else {
+			exp = new ASTUnaryOp(op, operand, C3Type::PointerType(operand->type));
 		}
-
-		auto tok = _consume_token();
-		auto rhs_tok = _token();
-
-		auto rhs = _parse_expression(precedence);
-		if (!rhs) {
-			return nullptr;
+	} else if (kind == TokenKindAsterisk) {
+		if (C3Type::RemoveReference(operand->type)->type() != C3TypeTypePointer) {
+			_errors.push_back(ParseError("operand to '*' operator must be a pointer type", _location(operand_tok)));
+		} else {
+			exp = new ASTUnaryOp(op, operand, C3Type::ReferenceType(C3Type::RemoveReference(operand->type)->pointed_to_type()));
 		}
-
-		if (tok->value() == "&") {
-			if (!rhs->type->referenced_type()) {
-				_errors.push_back(ParseError("operand to '&' operator must be a reference", rhs_tok));
-			} else {
-				exp = new ASTUnaryOp(tok->value(), rhs, C3Type::PointerType(rhs->type));
-			}
-		} else if (tok->value() == "*") {
-			if (C3Type::RemoveReference(rhs->type)->type() != C3TypeTypePointer) {
-				_errors.push_back(ParseError("operand to '*' operator must be a pointer type", rhs_tok));
-			} else {
-				exp = new ASTUnaryOp(tok->value(), rhs, C3Type::ReferenceType(C3Type::RemoveReference(rhs->type)->pointed_to_type()));
-			}
-		} else if (tok->value() == "!") {
-			auto converted = _explicit_conversion(rhs, C3Type::BoolType());
-			if (!converted) {
-				_errors.push_back(ParseError("operand to '!' operator must be convertible to bool", rhs_tok));
-			} else {
-				exp = new ASTUnaryOp(tok->value(), converted, C3Type::BoolType());
-			}
-		} else if (tok->value() == "-") {
-			auto rr_type = C3Type::RemoveReference(rhs->type);
-			if (!rr_type->is_integer() && !rr_type->is_floating_point()) {
-				_errors.push_back(ParseError("operand to unary '-' operator must be integer or floating point", rhs_tok));
-			} else {
-				rr_type->set_modifiers(0);
-				exp = new ASTUnaryOp(tok->value(), rhs, rr_type);
-			}
+	} else if (kind == TokenKindExclamation) {
+		auto converted = _explicit_conversion(operand, C3Type::BoolType());
+		if (!converted) {
+			_errors.push_back(ParseError("operand to '!' operator must be convertible to bool", _location(operand_tok)));
+		} else {
+			exp = new ASTUnaryOp(op, converted, C3Type::BoolType());
 		}
-		
-		if (!exp) {
-			delete rhs;
-			return nullptr;
+	} else if (kind == TokenKindMinus) {
+		auto rr_type = C3Type::RemoveReference(operand->type);
+		if (!rr_type->is_integer() && !rr_type->is_floating_point()) {
+			_errors.push_back(ParseError("operand to unary '-' operator must be integer or floating point", _location(operand_tok)));
+		} else {
+			// the result is neither const nor unsigned, without changing the operand's type
+			exp = new ASTUnaryOp(op, operand, C3Type::ModifiedType(rr_type, 0));
 		}
 	}
 
 	if (!exp) {
-		exp = _parse_primary();
+		delete operand;
 	}
 
-	if (!exp) {
+	return exp;
+}
+
+ASTExpression* Parser::_parse_expression() {
+	// the operators below this belong to whatever this expression is part of
+	auto base = _pending_operators.size();
+	Precedence precedence = { 0, false };
+
+	auto fail = [&]() -> ASTExpression* {
+		for (auto i = base; i < _pending_operators.size(); ++i) {
+			delete _pending_operators[i].lhs;
+		}
+		_pending_operators.resize(base);
 		return nullptr;
-	}
-	
-	if (_peek(ptt_open_paren)) {
-		// function call
-		ASTExpression* call = _parse_function_call(exp);
-		if (!call) {
-			delete exp;
-			return nullptr;
+	};
+
+	while (true) {
+		// prefix operators and open parentheses, up to the operand they apply to
+
+		while (true) {
+			if (_peek(ptt_unary_op)) {
+				// unary operators bind more tightly than anything that can be waiting for an operand
+				TokenKind kind = _record().kind;
+				_consume(1);
+				_pending_operators.push_back(PendingOperator{_cur_tok, kind, nullptr, precedence});
+				precedence = { kOperatorRanks[kind].unary, true };
+			} else if (_peek(ptt_open_paren)) {
+				// parenthesized expression
+				_consume(1); // (
+				_pending_operators.push_back(PendingOperator{_cur_tok, TokenKindOpenParen, nullptr, precedence});
+				precedence = { 0, false };
+			} else {
+				break;
+			}
 		}
-		exp = call;
-	}
 
-	while (_peek(ptt_binary_op)) {
-		auto precedence = _binary_ops[_token()->value()];
-		
-		if (precedence.rank < minPrecedence.rank || (precedence.rank == minPrecedence.rank && !minPrecedence.rtol)) {
-			break;
+		auto exp = _parse_primary();
+		if (!exp) {
+			return fail();
 		}
-		
-		if (!(exp = _parse_binop_rhs(exp))) {
-			return nullptr;
+
+		// then whatever follows the operand, applying the pending operators as they're completed
+
+		bool can_call = true;
+
+		while (true) {
+			if (can_call && _peek(ptt_open_paren)) {
+				// function call
+				ASTExpression* call = _parse_function_call(exp);
+				if (!call) {
+					delete exp;
+					return fail();
+				}
+				exp = call;
+			}
+
+			bool needs_operand = false;
+
+			while (!needs_operand && _peek(ptt_binary_op)) {
+				TokenKind kind = _record().kind;
+				Precedence binary = { kOperatorRanks[kind].binary, kOperatorRanks[kind].is_binary_rtol };
+
+				if (!binary.binds_within(precedence)) {
+					break;
+				}
+
+				if (kind == TokenKindPeriod || kind == TokenKindArrow) {
+					if (!(exp = _parse_selection(exp))) {
+						return fail();
+					}
+				} else {
+					_pending_operators.push_back(PendingOperator{_cur_tok, kind, exp, precedence});
+					_consume(1);
+					precedence = binary;
+					needs_operand = true;
+				}
+			}
+
+			if (needs_operand) {
+				break;
+			}
+
+			if (_pending_operators.size() == base) {
+				return exp;
+			}
+
+			auto pending = _pending_operators.back();
+			_pending_operators.pop_back();
+			precedence = pending.enclosing;
+
+			if (pending.lhs) {
+				exp = _binary_operation(pending.tok, pending.kind, pending.lhs, exp);
+				can_call = false;
+			} else if (pending.kind == TokenKindOpenParen) {
+				if (!_peek(ptt_close_paren)) {
+					_errors.push_back(ParseError("expected closing parenthesis", _location()));
+					delete exp;
+					return fail();
+				}
+				_consume(1); // )
+				can_call = true;
+			} else {
+				if (!(exp = _unary_operation(pending.kind, pending.tok, exp))) {
+					return fail();
+				}
+				can_call = true;
+			}
 		}
 	}
-
-	return exp;
 }
 
 ASTSequence* Parser::_parse_block() {
 	ASTSequence* seq = new ASTSequence();
+	bool is_top_level = (_block_depth++ == 0 && _scope_count == 1);
+	if (is_top_level) {
+		_top_level = seq;
+	}
+
+	// how many statements have been given to the statement handler
+	size_t handed = 0;
 
 	while (true) {
 		while (_peek(ptt_semicolon)) { _consume(1); }
 
 		if (_peek(ptt_end_token) || _peek(ptt_close_brace)) {
+			--_block_depth;
+			if (is_top_level && !_finish_top_level(seq, handed, true)) {
+				delete seq;
+				return nullptr;
+			}
 			return seq;
 		}
 
+		if (_scope_count == 1) {
+			// nothing refers back to the tokens of earlier top-level statements
+			_tokens->release(_cur_tok);
+		}
+
 		ASTNode* node = _parse_statement();
 		if (!node) {
 			break;
 		}
 
 		seq->sequence.push_back(node);
+
+		if (is_top_level && _statement_handler) {
+			handed = _hand_statements(seq, handed);
+		}
 	}
 	
+	--_block_depth;
+	if (is_top_level) {
+		_finish_top_level(seq, handed, false);
+	}
 	delete seq;
 	return nullptr;
 }
 
+bool Parser::_finish_top_level(ASTSequence* seq, size_t handed, bool succeeded) {
+	succeeded = _parse_deferred_bodies() && succeeded;
+
+	// lazy bodies are added to their modules once the statement handler is done with them
+	std::vector<std::pair<ASTSequence*, ASTFunctionDef*>> definitions;
+
+	// if the parse failed, the statements the bodies belong to might already be gone
+	for (auto& deferred : _deferred_bodies) {
+		if (deferred.is_attached) {
+			// it's part of a statement that's already been handed over
+		} else if (!succeeded || !deferred.is_needed) {
+			delete deferred.body;
+		} else if (deferred.is_lazy) {
+			auto proto = new ASTFunctionProto(deferred.function, deferred.arg_names);
+			definitions.emplace_back(deferred.module, new ASTFunctionDef(proto, deferred.body, deferred.arg_prefix));
+		} else {
+			deferred.node->body = deferred.body;
+		}
+	}
+	_deferred_bodies.clear();
+	_attached_bodies = 0;
+	_top_level = nullptr;
+
+	if (_statement_handler) {
+		if (succeeded && _errors.empty()) {
+			for (auto it = std::next(seq->sequence.begin(), handed); it != seq->sequence.end(); ++it) {
+				_statement_handler(*it);
+			}
+			for (auto& definition : definitions) {
+				_statement_handler(definition.second);
+			}
+		}
+		// the handler has to be done with the statements before they're changed or deleted
+		_statement_handler(nullptr);
+	}
+
+	for (auto& definition : definitions) {
+		definition.first->sequence.push_back(definition.second);
+	}
+
+	return succeeded;
+}
+
+size_t Parser::_hand_statements(ASTSequence* seq, size_t handed) {
+	// the statements that haven't been handed over yet are the last few
+	auto statement = std::prev(seq->sequence.end(), seq->sequence.size() - handed);
+
+	for (; statement != seq->sequence.end() && _errors.empty(); ++statement) {
+		// the statement's bodies have to be given to their definitions first
+		for (; _attached_bodies < _deferred_bodies.size() && _deferred_bodies[_attached_bodies].statement == handed; ++_attached_bodies) {
+			auto& deferred = _deferred_bodies[_attached_bodies];
+			if (deferred.is_lazy) {
+				// only parsed at the end, if at all
+				continue;
+			}
+			if (deferred.parsed.valid() && deferred.parsed.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				return handed;
+			}
+			_wait_for_deferred_body(deferred);
+			if (!deferred.body || !deferred.errors.empty()) {
+				// its errors are merged in with the others at the end
+				return handed;
+			}
+			deferred.node->body = deferred.body;
+			deferred.is_attached = true;
+		}
+
+		_statement_handler(*statement);
+		++handed;
+	}
+
+	return handed;
+}
+
+ASTNode* Parser::_import_module(Symbol name, SourceLocation location) {
+	if (!_imported_modules.insert(name).second) {
+		return new ASTNop();
+	}
+
+	auto& sources = _tokens->sources();
+	std::string filename;
+	if (!sources.find_module(name.str(), &filename)) {
+		_errors.push_back(ParseError("unable to import module", location));
+		return nullptr;
+	}
+
+	bool is_recorded = !_precompiling.empty();
+	auto generation = _generation;
+
+	if (is_recorded) {
+		_dependencies.push_back(PrecompiledModule::Dependency{name, filename});
+	}
+
+	bool should_precompile = false;
+
+	if (_precompiled_modules && !_precompiling.count(name)) {
+		PrecompiledModule module;
+		if (!module.open(filename + "m") || !_is_current(module, filename)) {
+			should_precompile = true;
+		} else if (_can_load(module)) {
+			auto node = _load_module(name, module, location);
+			if (node && is_recorded && !_import_depth) {
+				_imports.push_back(ImportRecord{name, node, generation});
+			}
+			return node;
+		}
+	}
+
+	Preprocessor pp(sources);
+	if (!pp.process_file(filename.c_str())) {
+		_errors.push_back(ParseError("unable to import module", location));
+		return nullptr;
+	}
+
+	auto first_deferred = _deferred_bodies.size();
+	auto previous_module = _module;
+	_module = name;
+	++_import_depth;
+	auto node = generate_ast(pp.tokens());
+	--_import_depth;
+	_module = previous_module;
+
+	if (pp.failed()) {
+		_errors.push_back(ParseError("unable to import module", location));
+		delete node;
+		return nullptr;
+	}
+	if (!node) {
+		return nullptr;
+	}
+
+	for (auto i = first_deferred; i < _deferred_bodies.size(); ++i) {
+		if (_deferred_bodies[i].is_lazy && !_deferred_bodies[i].module) {
+			_deferred_bodies[i].module = node;
+		}
+	}
+
+	if (is_recorded) {
+		for (auto id : pp.files()) {
+			_dependency_files.push_back(_source_file(id));
+		}
+		if (!_import_depth) {
+			_imports.push_back(ImportRecord{name, node, generation});
+		}
+	}
+
+	if (should_precompile) {
+		_precompile_module(name, filename);
+	}
+
+	return node;
+}
+
+bool Parser::_is_current(const PrecompiledModule& module, const std::string& filename) {
+	auto& sources = _tokens->sources();
+
+	if (module.source() != filename || module.include_paths() != sources.include_paths()) {
+		return false;
+	}
+
+	for (auto& dependency : module.dependencies()) {
+		std::string path;
+		if (!sources.find_module(dependency.name.str(), &path) || path != dependency.path) {
+			return false;
+		}
+	}
+
+	return module.is_current();
+}
+
+bool Parser::_can_load(const PrecompiledModule& module) {
+	std::unordered_set<Symbol> identifiers(module.identifiers().begin(), module.identifiers().end());
+	std::unordered_set<Symbol> dependencies;
+	for (auto& dependency : module.dependencies()) {
+		dependencies.insert(dependency.name);
+	}
+	return _can_load(_scopes[0]->root, identifiers, dependencies);
+}
+
+bool Parser::_can_load(Namespace& ns, const std::unordered_set<Symbol>& identifiers, const std::unordered_set<Symbol>& dependencies) {
+	for (Symbol identifier : identifiers) {
+		if (!_can_load(ns.types, identifier, dependencies) || !_can_load(ns.variables, identifier, dependencies) || !_can_load(ns.functions, identifier, dependencies)) {
+			return false;
+		}
+		auto child = ns.namespaces.find(identifier);
+		if (child && !_can_load(**child, identifiers, dependencies)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <class T>
+bool Parser::_can_load(const SymbolMap<Declaration<T>>& members, Symbol name, const std::unordered_set<Symbol>& dependencies) {
+	for (auto declaration = members.find(name); declaration; declaration = declaration->previous) {
+		if (declaration->generation > _builtin_generation && !dependencies.count(declaration->module)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+ASTNode* Parser::_load_module(Symbol name, PrecompiledModule& module, SourceLocation location) {
+	auto& global = *_scopes[0];
+
+	PrecompiledModule::Importer importer;
+
+	importer.import = [&](Symbol dependency) {
+		return _import_module(dependency, location);
+	};
+
+	importer.declare = [&](const PrecompiledModule::Entity& entity) {
+		for (size_t i = 0; i + 1 < entity.name.size(); ++i) {
+			global.push_namespace(entity.name[i]);
+		}
+		switch (entity.kind) {
+			case PrecompiledModule::EntityKindType:
+				_declare(global.current->types, entity.name.back(), entity.type);
+				break;
+			case PrecompiledModule::EntityKindVariable:
+				_declare(global.current->variables, entity.name.back(), entity.variable);
+				break;
+			case PrecompiledModule::EntityKindFunction:
+				_declare(global.current->functions, entity.name.back(), entity.function);
+				break;
+		}
+		global.current = &global.root;
+	};
+
+	importer.resolve = [&](PrecompiledModule::Entity& entity) {
+		auto ns = &global.root;
+		for (size_t i = 0; i + 1 < entity.name.size(); ++i) {
+			auto child = ns->namespaces.find(entity.name[i]);
+			if (!child) {
+				return false;
+			}
+			ns = *child;
+		}
+		switch (entity.kind) {
+			case PrecompiledModule::EntityKindType: {
+				auto declaration = ns->types.find(entity.name.back());
+				if (declaration) {
+					entity.type = declaration->value;
+				}
+				return declaration && entity.type;
+			}
+			case PrecompiledModule::EntityKindVariable: {
+				auto declaration = ns->variables.find(entity.name.back());
+				if (declaration) {
+					entity.variable = declaration->value;
+				}
+				return declaration && entity.variable;
+			}
+			case PrecompiledModule::EntityKindFunction: {
+				auto declaration = ns->functions.find(entity.name.back());
+				if (declaration) {
+					entity.function = declaration->value;
+				}
+				return declaration && entity.function;
+			}
+		}
+		return false;
+	};
+
+	auto errors = _errors.size();
+	auto previous_module = _module;
+	_module = name;
+	++_import_depth;
+	auto node = module.load(importer, location);
+	--_import_depth;
+	_module = previous_module;
+
+	if (!node) {
+		// whatever it declared before failing stays declared, so it can't be parsed instead
+		if (_errors.size() == errors) {
+			_errors.push_back(ParseError("unable to import module", location));
+		}
+		return nullptr;
+	}
+
+	if (_lazy_imports) {
+		for (auto& function : module.referenced_functions()) {
+			_referenced_functions.insert(function.get());
+		}
+	}
+
+	if (!_precompiling.empty()) {
+		_dependency_files.insert(_dependency_files.end(), module.files().begin(), module.files().end());
+		_dependencies.insert(_dependencies.end(), module.dependencies().begin(), module.dependencies().end());
+	}
+
+	return node;
+}
+
+void Parser::_precompile_module(Symbol name, const std::string& filename) {
+	auto& sources = _tokens->sources();
+
+	// parsed again by itself, since what was parsed here could see whatever was declared before the import
+	Parser parser;
+	parser._precompiled_modules = true;
+	parser._precompiling = _precompiling;
+	parser._precompiling.insert(name);
+	parser._imported_modules.insert(name);
+
+	Preprocessor pp(sources);
+	if (!pp.process_file(filename.c_str())) {
+		return;
+	}
+
+	std::unique_ptr<ASTSequence> ast(parser.generate_ast(pp.tokens()));
+	if (!ast || pp.failed() || !parser._errors.empty()) {
+		return;
+	}
+
+	PrecompiledModuleWriter writer(filename, sources.include_paths());
+
+	std::unordered_set<Symbol> identifiers;
+
+	for (auto id : pp.files()) {
+		writer.add_file(_source_file(id));
+
+		auto& file = sources.file(id);
+		if (!file.restore_tokens()) {
+			return;
+		}
+		for (auto& token : file.tokens()) {
+			if (token.type == TokenTypeIdentifier) {
+				Symbol identifier(file.contents() + token.location, token.length);
+				if (identifiers.insert(identifier).second) {
+					writer.add_identifier(identifier);
+				}
+			}
+		}
+		file.discard_tokens();
+	}
+
+	for (auto& file : parser._dependency_files) {
+		writer.add_file(file);
+	}
+	for (auto& dependency : parser._dependencies) {
+		writer.add_dependency(dependency);
+	}
+
+	std::vector<Symbol> namespace_name;
+	DeclarationList declarations;
+	parser._collect_declarations(parser._scopes[0]->root, namespace_name, writer, declarations);
+
+	std::sort(declarations.begin(), declarations.end(), [](const DeclarationList::value_type& a, const DeclarationList::value_type& b) {
+		return a.first < b.first;
+	});
+
+	// the imports and declarations are made again in the same order
+	auto declaration = declarations.begin();
+	for (auto& import : parser._imports) {
+		for (; declaration != declarations.end() && declaration->first < import.generation; ++declaration) {
+			writer.add_declaration(declaration->second);
+		}
+		writer.add_import(import.name, import.node);
+	}
+	for (; declaration != declarations.end(); ++declaration) {
+		writer.add_declaration(declaration->second);
+	}
+
+	writer.write(ast.get(), filename + "m");
+}
+
+void Parser::_collect_declarations(Namespace& ns, std::vector<Symbol>& name, PrecompiledModuleWriter& writer, DeclarationList& declarations) {
+	_collect_declarations(ns.types, name, writer, declarations);
+	_collect_declarations(ns.variables, name, writer, declarations);
+	_collect_declarations(ns.functions, name, writer, declarations);
+
+	ns.namespaces.for_each([&](Symbol key, Namespace* child) {
+		name.push_back(key);
+		_collect_declarations(*child, name, writer, declarations);
+		name.pop_back();
+	});
+}
+
+template <class T>
+void Parser::_collect_declarations(SymbolMap<Declaration<T>>& members, std::vector<Symbol>& name, PrecompiledModuleWriter& writer, DeclarationList& declarations) {
+	members.for_each([&](Symbol key, Declaration<T>& latest) {
+		PrecompiledModule::Entity entity;
+		entity.name = name;
+		entity.name.push_back(key);
+
+		if (!latest.module.empty() || latest.generation <= _builtin_generation) {
+			// it's looked up by name when the module's loaded, so that everyone shares it
+			set_entity_value(entity, latest.value);
+			writer.add_external(entity);
+			return;
+		}
+
+		for (const Declaration<T>* declaration = &latest; declaration; declaration = declaration->previous) {
+			if (declaration->module.empty() && declaration->generation > _builtin_generation) {
+				set_entity_value(entity, declaration->value);
+				declarations.emplace_back(declaration->generation, entity);
+			}
+		}
+	});
+}
+
+PrecompiledModule::File Parser::_source_file(uint32_t id) {
+	auto& file = _tokens->sources().file(id);
+	return PrecompiledModule::File{file.filename(), file.size(), hash_bytes(file.contents(), file.size())};
+}
+
 ASTNode* Parser::_parse_statement() {
 	ASTNode* node = nullptr;
 	bool expect_semicolon = true;
 
 	if (_peek(ptt_keyword_import)) {
-		auto import_token = _consume_token();
-		if (_scopes.size() > 1) {
+		auto import_token = _location();
+		_consume(1);
+		if (_scope_count > 1) {
 			_errors.push_back(ParseError("imports can only be made in the global scope", import_token));
 			return nullptr;
 		}
-		Scope& s = _scopes.back();
-		if (!s.current_namespace.empty()) {
+		Scope& s = _scope();
+		if (s.in_namespace()) {
 			_errors.push_back(ParseError("imports can only be made in the top level namespace", import_token));
 			return nullptr;
 		}
 		if (!_peek(ptt_identifier)) {
-			_errors.push_back(ParseError("expected module name", _token()));
+			_errors.push_back(ParseError("expected module name", _location()));
 			return nullptr;
 		}
-		auto name = _consume_token()->value();
-		if (_imported_modules.insert(name).second) {
-			Preprocessor pp;
-			// TODO: some sort of module searching
-			if (!pp.process_file((std::string("modules/") + name + "/" + name + ".c3").c_str())) {
-				_errors.push_back(ParseError("unable to import module", import_token));
-				return nullptr;
-			}
-			node = generate_ast(pp.tokens());
-			if (!node) {
-				return nullptr;
-			}
-		} else {
-			node = new ASTNop();
+		auto name = _symbol();
+		_consume(1);
+		node = _import_module(name, import_token);
+		if (!node) {
+			return nullptr;
 		}
 	} else if (_peek(ptt_keyword_namespace)) {
 		_consume(1); // namespace
 		if (!_peek(ptt_new_namespace_name)) {
-			_errors.push_back(ParseError("expected namespace name", _token()));
+			_errors.push_back(ParseError("expected namespace name", _location()));
 			return nullptr;
 		}
-		auto name = _token()->value();
+		auto name = _symbol();
 		_consume(1); // name
 		if (!_peek(ptt_open_brace)) {
-			_errors.push_back(ParseError("expected opening brace", _token()));
+			_errors.push_back(ParseError("expected opening brace", _location()));
 			return nullptr;
 		}
 		_consume(1); // {
-		Scope& s = _scopes.back();
-		s.namespaces.insert(s.local_prefix() + name);
-		s.current_namespace.push_back(name);
+		Scope& s = _scope();
+		s.push_namespace(name);
+		++_generation;
 		node = _parse_block();
-		s.current_namespace.pop_back();
+		s.pop_namespace();
+		++_generation;
 		if (node) {
 			if (!_peek(ptt_close_brace)) {
-				_errors.push_back(ParseError("expected closing brace", _token()));
+				_errors.push_back(ParseError("expected closing brace", _location()));
 				delete node;
 				return nullptr;
 			}
@@ -1480,7 +2219,7 @@ ASTNode* Parser::_parse_statement() {
 		_pop_scope();
 		if (node) {
 			if (!_peek(ptt_close_brace)) {
-				_errors.push_back(ParseError("expected closing brace", _token()));
+				_errors.push_back(ParseError("expected closing brace", _location()));
 				delete node;
 				return nullptr;
 			}
@@ -1491,7 +2230,7 @@ ASTNode* Parser::_parse_statement() {
 		// if block
 		_consume(1); // if
 		if (!_peek(ptt_open_paren)) {
-			_errors.push_back(ParseError("expected opening parenthesis", _token()));
+			_errors.push_back(ParseError("expected opening parenthesis", _location()));
 			return nullptr;
 		}
 		_consume(1); // (
@@ -1500,7 +2239,7 @@ ASTNode* Parser::_parse_statement() {
 			return nullptr;
 		}
 		if (!_peek(ptt_close_paren)) {
-			_errors.push_back(ParseError("expected closing parenthesis", _token()));
+			_errors.push_back(ParseError("expected closing parenthesis", _location()));
 			delete condition;
 			return nullptr;
 		}
@@ -1530,7 +2269,7 @@ ASTNode* Parser::_parse_statement() {
 		// while loop
 		_consume(1); // if
 		if (!_peek(ptt_open_paren)) {
-			_errors.push_back(ParseError("expected opening parenthesis", _token()));
+			_errors.push_back(ParseError("expected opening parenthesis", _location()));
 			return nullptr;
 		}
 		_consume(1); // (
@@ -1539,7 +2278,7 @@ ASTNode* Parser::_parse_statement() {
 			return nullptr;
 		}
 		if (!_peek(ptt_close_paren)) {
-			_errors.push_back(ParseError("expected closing parenthesis", _token()));
+			_errors.push_back(ParseError("expected closing parenthesis", _location()));
 			delete condition;
 			return nullptr;
 		}
@@ -1585,8 +2324,7 @@ ASTNode* Parser::_parse_statement() {
 	}
 
 	if (node && expect_semicolon && !_peek(ptt_semicolon)) {
-		node->print();
-		_errors.push_back(ParseError("expected semicolon", _token()));
+		_errors.push_back(ParseError("expected semicolon", _location()));
 		// try to continue anyways
 	}
 	
@@ -1,26 +1,67 @@
 #pragma once
 
-#include "Token.h"
+#include "TokenKind.h"
+#include "TokenBuffer.h"
 #include "AST.h"
 #include "C3/C3.h"
+#include "PrecompiledModule.h"
+#include "SymbolMap.h"
 
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
 #include <list>
-#include <unordered_map>
+#include <memory>
 #include <unordered_set>
 #include <string>
 
 struct ParseError {
-	ParseError(const std::string& msg, TokenPtr tok) : message(msg), token(tok) {}
+	ParseError(const std::string& msg, SourceLocation location) : message(msg), location(location) {}
+
+	/**
+	* Prints the error as "file:line:column: error: message" followed by the offending line.
+	*/
+	void print(SourceManager& sources) const;
 	
 	std::string message;
-	TokenPtr token;
+	SourceLocation location;
 };
 
 class Parser {
 	public:
 		Parser();
 
-		ASTSequence* generate_ast(const std::list<TokenPtr>& tokens);
+		/**
+		* Parses tokens as they're produced, releasing each top-level statement's tokens once it's been parsed. When
+		* there's more than one thread in the shared pool, the bodies of top-level functions are skipped over and
+		* parsed on the pool while the rest of the file is.
+		*/
+		ASTSequence* generate_ast(TokenBuffer& tokens);
+
+		/**
+		* Sets a function to be called with each top-level statement, in order, as soon as it and the function bodies
+		* in it have been parsed, as long as there haven't been any errors yet. Imported modules are handed over whole,
+		* as their import statements, except for lazily parsed bodies, which are handed over as definitions of their
+		* own once the rest of the top level has been. The statements still belong to the AST. Once the top level is
+		* done, the function is called with nullptr, after which it must not touch the statements any more since they
+		* may be changed or deleted right away.
+		*/
+		void set_statement_handler(std::function<void(ASTNode*)> handler);
+
+		/**
+		* Whether imported modules' function bodies are only parsed if the functions are referenced, directly or
+		* through other functions, by code that's always parsed. The others are left as prototypes. Referenced bodies
+		* are added to the end of their modules.
+		*/
+		void set_lazy_imports(bool is_lazy);
+
+		/**
+		* Whether modules are imported from precompiled modules saved next to their sources, as "name.c3m". Modules
+		* that haven't been saved yet, or whose files have changed since, are parsed and saved again.
+		*/
+		void set_precompiled_modules(bool is_enabled);
+
 		const std::list<ParseError>& errors();
 
 	private:
@@ -71,72 +112,321 @@ class Parser {
 			ptt_keyword_nullptr,
 		};
 		
+		typedef size_t TokenIterator;
+
+		/**
+		* Something declared in a namespace, along with the generation it was declared in, so that function bodies
+		* parsed later can tell whether they'd have seen it.
+		*/
+		template <class T>
+		struct Declaration {
+			T value;
+			uint64_t generation = 0;
+
+			// the module that declared it, or empty for the file being compiled and the built-in types
+			Symbol module;
+
+			// what this replaced, if it was declared again, which the namespace keeps
+			const Declaration* previous = nullptr;
+		};
+
+		/**
+		* A namespace within a scope. Names are declared in the namespace they appear in, so qualified names are
+		* resolved by walking down the tree one component at a time. Deferred bodies look names up in the global
+		* scope's namespaces while the parser goes on declaring things in them, which the maps allow without locking.
+		*/
+		struct Namespace {
+			Namespace(Namespace* parent, Symbol global_prefix) : parent(parent), global_prefix(global_prefix) {}
+
+			void clear() {
+				namespaces.clear();
+				types.clear();
+				variables.clear();
+				functions.clear();
+			}
+
+			Namespace* parent;
+
+			/**
+			* The prefix of the global names of everything declared in the namespace. e.g. "^a::b::"
+			*/
+			Symbol global_prefix;
+
+			SymbolMap<Namespace*> namespaces;
+			SymbolMap<Declaration<C3TypePtr>> types;
+			SymbolMap<Declaration<C3VariablePtr>> variables;
+			SymbolMap<Declaration<C3FunctionPtr>> functions;
+		};
+
 		struct Scope {
-			Scope() : prefix("") {}
-			Scope(std::string prefix) : prefix(prefix) {}
-				
-			std::string global_prefix() {
-				return prefix + local_prefix();
+			Scope() : root(nullptr, Symbol()), current(&root) {}
+
+			Symbol prefix() {
+				return root.global_prefix;
 			}
-			
-			std::string local_prefix() {
-				std::string ret = "";
-				for (auto& name : current_namespace) {
-					ret += name + "::";
+
+			Symbol global_prefix() {
+				return current->global_prefix;
+			}
+
+			bool in_namespace() {
+				return current != &root;
+			}
+
+			void push_namespace(Symbol name) {
+				static const Symbol delimiter("::");
+				auto child = current->namespaces.find(name);
+				if (!child) {
+					namespaces.emplace_back(new Namespace(current, Symbol::Concat(Symbol::Concat(current->global_prefix, name), delimiter)));
+					child = &current->namespaces.insert(name, namespaces.back().get());
 				}
-				return ret;
+				current = *child;
+			}
+
+			void pop_namespace() {
+				current = current->parent;
+			}
+
+			/**
+			* Empties the scope so that it can be reused.
+			*/
+			void reset(Symbol prefix, C3TypePtr return_type) {
+				root.clear();
+				root.global_prefix = prefix;
+				namespaces.clear();
+				current = &root;
+				this->return_type = return_type;
 			}
-			
-			std::string prefix;
-			std::unordered_map<std::string, C3TypePtr> types;
-			std::unordered_map<std::string, C3VariablePtr> variables;
-			std::unordered_map<std::string, C3FunctionPtr> functions;
-			std::list<std::string> current_namespace;
-			std::unordered_set<std::string> namespaces;
+
+			Namespace root;
+			Namespace* current;
+
+			/**
+			* Only declarations from this generation or earlier can be seen through the scope.
+			*/
+			uint64_t visible_generation = UINT64_MAX;
+
+			// owns the namespaces below the root
+			std::vector<std::unique_ptr<Namespace>> namespaces;
+
 			C3TypePtr return_type;
 		};
-		
-		std::list<Scope> _scopes;
+
+		/**
+		* The scopes from the global scope inwards. Popped scopes are kept for reuse, so only the first
+		* `_scope_count` are in use.
+		*/
+		std::vector<std::unique_ptr<Scope>> _scopes;
+		size_t _scope_count = 0;
+
+		/**
+		* A name as it appears in the tokens, possibly qualified, e.g. "a::b::c". It's complete if it ends with an
+		* identifier rather than a delimiter.
+		*/
+		struct QualifiedName {
+			TokenIterator begin;
+			TokenIterator end;
+
+			bool empty() const { return begin == end; }
+			bool is_complete() const { return (end - begin) % 2 == 1; }
+		};
 		
 		struct Precedence {
 			int  rank;
 			bool rtol; // right to left associativity if true, unary operators are always right to left regardless
+
+			/**
+			* Whether an operator with this precedence takes the operand before it away from an enclosing operator.
+			*/
+			bool binds_within(Precedence enclosing) const {
+				return rank > enclosing.rank || (rank == enclosing.rank && enclosing.rtol);
+			}
 		};
-		
-		std::unordered_map<std::string, Precedence> _unary_ops;
-		std::unordered_map<std::string, Precedence> _binary_ops;
 
-		std::unordered_set<std::string> _keywords;
+		/**
+		* An operator whose right operand is being parsed, or an open parenthesis. Expressions are parsed with an
+		* explicit stack of these rather than by recursion, so that long or deeply nested expressions can't overflow
+		* the call stack. Expressions that start inside others, like function call arguments, push theirs on top.
+		*/
+		struct PendingOperator {
+			// the operator for binary operators, where the operand starts for unary ones
+			TokenIterator tok;
+			TokenKind kind;
 
-		std::unordered_set<std::string> _imported_modules;
+			// the left operand of a binary operator
+			ASTExpression* lhs;
 
-		typedef std::list<TokenPtr>::const_iterator TokenIterator;
-		
-		TokenIterator _cur_tok;
-		TokenIterator _end_tok;
+			// the precedence to go back to once the operator has been applied
+			Precedence enclosing;
+		};
+
+		std::vector<PendingOperator> _pending_operators;
+
+		std::unordered_set<Symbol> _imported_modules;
+
+		// the module being parsed or loaded, if any
+		Symbol _module;
+
+		// declarations up to this generation are the built-in types
+		uint64_t _builtin_generation = 0;
 
-		TokenPtr _token();
+		bool _precompiled_modules = false;
+
+		/**
+		* The modules being precompiled, innermost last. When there are any, this parser is parsing the last of them,
+		* and keeps track of what it imports so that it can be saved.
+		*/
+		std::unordered_set<Symbol> _precompiling;
+
+		struct ImportRecord {
+			Symbol name;
+			ASTNode* node;
+
+			// the generation before it was imported
+			uint64_t generation;
+		};
+
+		std::vector<ImportRecord> _imports;
+		std::vector<PrecompiledModule::File> _dependency_files;
+		std::vector<PrecompiledModule::Dependency> _dependencies;
+
+		TokenBuffer* _tokens = nullptr;
+		TokenIterator _cur_tok = 0;
+
+		/**
+		* The result of a speculative parse at a position. Statements try to parse a type at the same position several
+		* times while deciding what they are, so results are kept in small tables indexed by position.
+		*/
+		template <class T>
+		struct Memo {
+			TokenIterator begin = 0;
+			TokenIterator end = 0;
+			uint64_t generation = 0;
+			T result;
+		};
+
+		std::vector<Memo<C3TypePtr>> _type_memos;
+		std::vector<Memo<C3VariablePtr>> _variable_memos;
+		std::vector<Memo<C3FunctionPtr>> _function_memos;
+
+		/**
+		* Changes whenever what a name resolves to might change, e.g. when something's declared or a scope is entered,
+		* which makes every memo stale.
+		*/
+		uint64_t _generation = 1;
+
+		std::function<void(ASTNode*)> _statement_handler;
+		size_t _block_depth = 0;
+
+		/**
+		* A top-level function body that was skipped over, to be parsed by another parser on the shared pool. Lazy
+		* bodies from imported modules are only parsed once the rest of the file has been, and only if they turn out
+		* to be needed.
+		*/
+		struct DeferredBody {
+			// the definition that gets the body, or for lazy bodies, the module the definition is added to
+			ASTFunctionDef* node = nullptr;
+			ASTSequence* module = nullptr;
+
+			bool is_lazy = false;
+			bool is_needed = false;
+
+			// the top-level statement it's in
+			size_t statement = 0;
+
+			C3FunctionPtr function;
+			std::vector<Symbol> arg_names;
+			SourceLocation arg_location;
+			Symbol arg_prefix;
+
+			// the body's tokens, from the opening brace to the closing one
+			TokenRun tokens;
+			SourceManager* sources;
+
+			// the namespace it's in, and what it could see at that point
+			Namespace* ns;
+			uint64_t generation = 0;
+
+			// how many errors came before it
+			size_t preceding_errors;
+
+			// the functions the body references, once it's been parsed
+			std::future<std::unordered_set<const C3Function*>> parsed;
+
+			ASTSequence* body = nullptr;
+			std::list<ParseError> errors;
+
+			// whether the body was given to its definition before the statement was handed to the statement handler
+			bool is_attached = false;
+		};
+
+		// a deque so that the bodies stay put while they're being parsed
+		std::deque<DeferredBody> _deferred_bodies;
+
+		// the first deferred body that hasn't been attached or passed over on the way to handing statements over
+		size_t _attached_bodies = 0;
+
+		// the top-level sequence being parsed
+		ASTSequence* _top_level = nullptr;
+
+		bool _lazy_imports = false;
+		size_t _import_depth = 0;
+
+		// the functions referenced so far, tracked for lazy imports
+		std::unordered_set<const C3Function*> _referenced_functions;
+
+		/**
+		* The location of the current token (or the one at `it`). Invalid at the end of the tokens.
+		*/
+		SourceLocation _location();
+		SourceLocation _location(TokenIterator it);
+
+		TokenRecord _record();
+		std::string _value();
+		Symbol _symbol();
+		Symbol _symbol(TokenIterator it);
 
 		void _consume(size_t tokens);
-		TokenPtr _consume_token();
+		std::string _consume_value();
 
 		bool _peek(ParserTokenType type, TokenIterator* next = nullptr);
 		bool _peek(std::initializer_list<ParserTokenType> types);
 
-		Scope& _push_scope(const std::string& name = "");
+		Scope& _scope();
+		Symbol _scope_prefix(Symbol name);
+		Scope& _push_scope(Symbol name = Symbol());
 		Scope& _push_scope(C3FunctionPtr function);
 		void _pop_scope();
 
-		std::string _try_parse_full_name();
+		QualifiedName _try_parse_full_name();
+
+		/**
+		* Looks a name up in each enclosing namespace of each scope, innermost first. Doesn't allocate.
+		*/
+		template <class T>
+		T _resolve(QualifiedName name, SymbolMap<Declaration<T>> Namespace::*members);
+
+		template <class T>
+		void _declare(SymbolMap<Declaration<T>>& members, Symbol name, T value);
 
-		C3TypePtr _resolve_type(const std::string& name);
+		/**
+		* Runs `parse` at the current token unless it's already been run there since anything was declared, in which
+		* case its result and end position are reused. `parse` mustn't have any effect besides moving the cursor.
+		*/
+		template <class T>
+		T _memoized(std::vector<Memo<T>>& memos, T (Parser::*parse)());
+
+		C3TypePtr _resolve_type(QualifiedName name);
 		C3TypePtr _try_parse_type();
+		C3TypePtr _try_parse_type_unmemoized();
 
-		C3VariablePtr _resolveVariable(const std::string& name);
+		C3VariablePtr _resolveVariable(QualifiedName name);
 		C3VariablePtr _try_parse_variable();
+		C3VariablePtr _try_parse_variable_unmemoized();
 
-		C3FunctionPtr _resolveFunction(const std::string& name);
+		C3FunctionPtr _resolveFunction(QualifiedName name);
 		C3FunctionPtr _try_parse_function();
+		C3FunctionPtr _try_parse_function_unmemoized();
 		
 		/**
 		* Takes ownership of `from` only if successful.
@@ -152,11 +442,37 @@ class Parser {
 
 		ASTVariableDec* _parse_variable_dec();
 		ASTNode* _parse_function_proto_or_def(bool* was_just_proto);
+		void _declare_arguments(C3FunctionPtr function, const std::vector<Symbol>& names, SourceLocation location);
+
+		/**
+		* Skips over the function body starting at the current token, saving it to be parsed later. Returns false
+		* without moving if the body can't be deferred.
+		*/
+		bool _defer_function_body(ASTFunctionProto* proto, SourceLocation arg_location, bool is_lazy);
+
+		/**
+		* Waits for every deferred body that's needed to be parsed, and merges their errors in with the others.
+		* Returns false if one of them failed, in which case the parse stops there as if it had been parsed in place.
+		*/
+		bool _parse_deferred_bodies();
+
+		/**
+		* Starts parsing the body on the shared thread pool, with the parser that the thread it runs on keeps for
+		* bodies.
+		*/
+		void _submit_deferred_body(DeferredBody& deferred);
+
+		/**
+		* Waits for the body to be parsed, if it hasn't been waited for already, adding the functions it references
+		* to `_referenced_functions`.
+		*/
+		void _wait_for_deferred_body(DeferredBody& deferred);
+		void _parse_deferred_body(DeferredBody& deferred);
 		ASTFunctionProto* _parse_function_proto(bool* args_are_named = nullptr);
 		ASTFunctionCall* _parse_function_call(ASTExpression* func);
 		ASTNode* _parse_class_dec_or_def();
 
-		ASTExpression* _parse_expression(Precedence minPrecedence = { 0, false });
+		ASTExpression* _parse_expression();
 		ASTExpression* _parse_primary();
 		ASTCast* _parse_static_cast();
 
@@ -167,8 +483,73 @@ class Parser {
 
 		ASTReturn* _parse_return();
 
-		ASTExpression* _parse_binop_rhs(ASTExpression* lhs);
+		/**
+		* Imports a module unless it's already been imported, in which case a nop is returned. Returns nullptr if it
+		* fails.
+		*/
+		ASTNode* _import_module(Symbol name, SourceLocation location);
+
+		/**
+		* Whether a precompiled module was made from the files that would be parsed for it now.
+		*/
+		bool _is_current(const PrecompiledModule& module, const std::string& filename);
+
+		/**
+		* Whether loading a precompiled module gives the same result as parsing it here. It doesn't if anything besides
+		* its own imports and the built-in types declared a name it uses, since it was parsed without them.
+		*/
+		bool _can_load(const PrecompiledModule& module);
+		bool _can_load(Namespace& ns, const std::unordered_set<Symbol>& identifiers, const std::unordered_set<Symbol>& dependencies);
+
+		template <class T>
+		bool _can_load(const SymbolMap<Declaration<T>>& members, Symbol name, const std::unordered_set<Symbol>& dependencies);
+
+		ASTNode* _load_module(Symbol name, PrecompiledModule& module, SourceLocation location);
+
+		/**
+		* Parses a module by itself and saves it. Nothing is saved if that fails.
+		*/
+		void _precompile_module(Symbol name, const std::string& filename);
+
+		typedef std::vector<std::pair<uint64_t, PrecompiledModule::Entity>> DeclarationList;
+
+		/**
+		* Adds what the module declared to `declarations` with their generations, and tells `writer` about what other
+		* modules declared.
+		*/
+		void _collect_declarations(Namespace& ns, std::vector<Symbol>& name, PrecompiledModuleWriter& writer, DeclarationList& declarations);
+
+		template <class T>
+		void _collect_declarations(SymbolMap<Declaration<T>>& members, std::vector<Symbol>& name, PrecompiledModuleWriter& writer, DeclarationList& declarations);
+
+		PrecompiledModule::File _source_file(uint32_t id);
+
+		/**
+		* Parses a "." or "->" and the member name after it. Takes ownership of `lhs`.
+		*/
+		ASTExpression* _parse_selection(ASTExpression* lhs);
+
+		/**
+		* Type checks an operator and builds the node for it, taking ownership of the operands. Unary operators return
+		* nullptr if the operand isn't valid, but binary operators always succeed, recording an error if the operands
+		* aren't compatible.
+		*/
+		ASTExpression* _unary_operation(TokenKind kind, TokenIterator operand_tok, ASTExpression* operand);
+		ASTExpression* _binary_operation(TokenIterator tok, TokenKind kind, ASTExpression* lhs, ASTExpression* rhs);
+
 		ASTSequence* _parse_block();
+
+		/**
+		* Finishes the top-level block, parsing the deferred bodies and handing the statements that haven't been
+		* handed over yet to the statement handler. Returns false if the block has to be thrown away.
+		*/
+		bool _finish_top_level(ASTSequence* seq, size_t handed, bool succeeded);
+
+		/**
+		* Hands the top-level statements from `handed` on to the statement handler until one of them has a function
+		* body that's still being parsed, or there's an error. Returns how many have been handed over.
+		*/
+		size_t _hand_statements(ASTSequence* seq, size_t handed);
 		ASTNode* _parse_statement();
 
 		std::list<ParseError> _errors;
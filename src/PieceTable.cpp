@@ -0,0 +1,87 @@
+#include "PieceTable.h"
+
+#include <algorithm>
+#include <cstring>
+
+void PieceTable::reset(const char* data, size_t size) {
+	_original = data;
+	_inserted.clear();
+	_pieces.clear();
+	if (size) {
+		_pieces.push_back(Piece{0, size, 0, false});
+	}
+	_size = size;
+}
+
+char PieceTable::at(size_t offset) const {
+	auto& piece = _pieces[_find(offset)];
+	return _data(piece)[offset - piece.start];
+}
+
+const char* PieceTable::span(size_t offset, size_t* size) const {
+	if (offset >= _size) {
+		*size = 0;
+		return nullptr;
+	}
+	auto& piece = _pieces[_find(offset)];
+	*size = piece.start + piece.size - offset;
+	return _data(piece) + (offset - piece.start);
+}
+
+void PieceTable::copy(size_t offset, size_t size, char* destination) const {
+	while (size) {
+		size_t available = 0;
+		const char* data = span(offset, &available);
+		available = std::min(available, size);
+		memcpy(destination, data, available);
+		destination += available;
+		offset += available;
+		size -= available;
+	}
+}
+
+void PieceTable::replace(size_t offset, size_t removed, const char* text, size_t inserted) {
+	size_t first = _split(offset);
+	size_t last = _split(offset + removed);
+	_pieces.erase(_pieces.begin() + first, _pieces.begin() + last);
+
+	if (inserted) {
+		auto previous = first ? &_pieces[first - 1] : nullptr;
+		if (previous && previous->is_inserted && previous->source + previous->size == _inserted.size()) {
+			previous->size += inserted;
+		} else {
+			_pieces.insert(_pieces.begin() + first, Piece{offset, inserted, _inserted.size(), true});
+			++first;
+		}
+		_inserted.append(text, inserted);
+	}
+
+	for (size_t i = first; i < _pieces.size(); ++i) {
+		_pieces[i].start = i ? _pieces[i - 1].start + _pieces[i - 1].size : 0;
+	}
+
+	_size = _size - removed + inserted;
+}
+
+size_t PieceTable::_find(size_t offset) const {
+	return std::upper_bound(_pieces.begin(), _pieces.end(), offset, [](size_t offset, const Piece& piece) {
+		return offset < piece.start;
+	}) - _pieces.begin() - 1;
+}
+
+size_t PieceTable::_split(size_t offset) {
+	if (offset == _size) {
+		return _pieces.size();
+	}
+
+	size_t index = _find(offset);
+	auto piece = _pieces[index];
+	if (piece.start == offset) {
+		return index;
+	}
+
+	size_t size = offset - piece.start;
+	_pieces[index].size = size;
+	_pieces.insert(_pieces.begin() + index + 1, Piece{offset, piece.size - size, piece.source + size, piece.is_inserted});
+	return index + 1;
+}
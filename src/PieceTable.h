@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+* The contents of a buffer that's being edited, as pieces of the original buffer and of the text inserted since. The
+* original buffer is never copied or written to, so it can be a read-only mapping. An edit splits at most two pieces
+* and adds at most one more, and typing right after the last insertion just extends it.
+*/
+class PieceTable {
+	public:
+		/**
+		* Makes the `size` bytes at `data` the whole contents. They aren't copied, so they have to stay put until the
+		* table is reset again or goes away.
+		*/
+		void reset(const char* data, size_t size);
+
+		size_t size() const { return _size; }
+
+		char at(size_t offset) const;
+
+		/**
+		* Returns the bytes from `offset` to the end of the piece it's in, and their count in `size`.
+		*/
+		const char* span(size_t offset, size_t* size) const;
+
+		/**
+		* Copies `size` bytes at `offset` to `destination`.
+		*/
+		void copy(size_t offset, size_t size, char* destination) const;
+
+		/**
+		* Replaces `removed` bytes at `offset` with `inserted` bytes from `text`.
+		*/
+		void replace(size_t offset, size_t removed, const char* text, size_t inserted);
+
+	private:
+		struct Piece {
+			// where the piece is in the contents
+			size_t start;
+			size_t size;
+
+			// where its bytes are, in the original buffer or in `_inserted`
+			size_t source;
+			bool is_inserted;
+		};
+
+		const char* _original = nullptr;
+
+		// only ever appended to
+		std::string _inserted;
+
+		std::vector<Piece> _pieces;
+		size_t _size = 0;
+
+		const char* _data(const Piece& piece) const {
+			return (piece.is_inserted ? _inserted.data() : _original) + piece.source;
+		}
+
+		/**
+		* The index of the piece containing `offset`.
+		*/
+		size_t _find(size_t offset) const;
+
+		/**
+		* Makes sure a piece starts at `offset`, and returns its index, or the number of pieces if `offset` is the end.
+		*/
+		size_t _split(size_t offset);
+};
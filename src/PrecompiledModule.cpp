@@ -0,0 +1,1260 @@
+#include "PrecompiledModule.h"
+
+#include "Hash.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+	const char kMagic[4] = {'C', '3', 'P', 'M'};
+
+	// change this whenever the format or what goes into it changes
+	const uint32_t kVersion = 1;
+
+	// the magic number, the version, and a hash of everything after the header
+	const size_t kHeaderSize = sizeof(kMagic) + sizeof(uint32_t) + sizeof(uint64_t);
+
+	// symbols, types, variables, and functions are written out where they're first used, and as indices after that
+	const uint32_t kNull = UINT32_MAX;
+	const uint32_t kNew = UINT32_MAX - 1;
+
+	enum TypeTag : uint8_t {
+		TypeTagBuiltin,
+		TypeTagPointer,
+		TypeTagReference,
+		TypeTagFunction,
+		TypeTagStruct,
+		TypeTagModified,
+		TypeTagExternal,
+	};
+
+	enum NodeTag : uint8_t {
+		NodeTagNull,
+		NodeTagImport,
+		NodeTagNop,
+		NodeTagSequence,
+		NodeTagVariableRef,
+		NodeTagVariableDec,
+		NodeTagFunctionRef,
+		NodeTagFunctionProto,
+		NodeTagFunctionDef,
+		NodeTagStructMemberRef,
+		NodeTagFloatingPoint,
+		NodeTagInteger,
+		NodeTagConstantArray,
+		NodeTagUnaryOp,
+		NodeTagBinaryOp,
+		NodeTagReturn,
+		NodeTagInlineAsm,
+		NodeTagFunctionCall,
+		NodeTagCast,
+		NodeTagCondition,
+		NodeTagWhileLoop,
+		NodeTagNullPointer,
+	};
+
+	/**
+	* Maps a whole file read-only. Empty files give nullptr, since they can't be mapped.
+	*/
+	bool map_file(const std::string& filename, const char** data, size_t* size) {
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+
+		struct stat st;
+		void* contents = nullptr;
+
+		if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+			contents = MAP_FAILED;
+		} else if (st.st_size > 0) {
+			contents = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+
+		close(fd);
+
+		if (contents == MAP_FAILED) {
+			return false;
+		}
+
+		*data = (const char*)contents;
+		*size = st.st_size;
+		return true;
+	}
+
+	void unmap_file(const char* data, size_t size) {
+		if (data) {
+			munmap((void*)data, size);
+		}
+	}
+
+	/**
+	* Returns the instance of a type that everything shares, e.g. int32's, or nullptr for kinds of types that don't
+	* have one.
+	*/
+	C3TypePtr shared_type(C3TypeType type) {
+		switch (type) {
+			case C3TypeTypeAuto:        return C3Type::AutoType();
+			case C3TypeTypeVoid:        return C3Type::VoidType();
+			case C3TypeTypeNullPointer: return C3Type::NullPointerType();
+			case C3TypeTypeBool:        return C3Type::BoolType();
+			case C3TypeTypeInt8:        return C3Type::Int8Type();
+			case C3TypeTypeInt32:       return C3Type::Int32Type();
+			case C3TypeTypeInt64:       return C3Type::Int64Type();
+			case C3TypeTypeDouble:      return C3Type::DoubleType();
+			default:                    return nullptr;
+		}
+	}
+}
+
+PrecompiledModule::~PrecompiledModule() {
+	unmap_file(_data, _size);
+}
+
+bool PrecompiledModule::open(const std::string& filename) {
+	if (!map_file(filename, &_data, &_size) || _size < kHeaderSize || memcmp(_data, kMagic, sizeof(kMagic))) {
+		return false;
+	}
+
+	uint32_t version;
+	memcpy(&version, _data + sizeof(kMagic), sizeof(version));
+
+	uint64_t hash;
+	memcpy(&hash, _data + sizeof(kMagic) + sizeof(version), sizeof(hash));
+
+	// a module that's damaged or was cut short gets made again
+	if (version != kVersion || hash != hash_bytes(_data + kHeaderSize, _size - kHeaderSize)) {
+		return false;
+	}
+
+	_cursor = _data + kHeaderSize;
+
+	_source = _read_string();
+
+	auto count = _read_u32();
+	for (uint32_t i = 0; i < count && !_failed; ++i) {
+		_include_paths.push_back(_read_string());
+	}
+
+	count = _read_u32();
+	for (uint32_t i = 0; i < count && !_failed; ++i) {
+		File file;
+		file.path = _read_string();
+		file.size = _read_u64();
+		file.hash = _read_u64();
+		_files.push_back(std::move(file));
+	}
+
+	count = _read_u32();
+	for (uint32_t i = 0; i < count && !_failed; ++i) {
+		Dependency dependency;
+		dependency.name = _read_symbol();
+		dependency.path = _read_string();
+		_dependencies.push_back(std::move(dependency));
+	}
+
+	count = _read_u32();
+	for (uint32_t i = 0; i < count && !_failed; ++i) {
+		_identifiers.push_back(_read_symbol());
+	}
+
+	return !_failed;
+}
+
+bool PrecompiledModule::is_current() const {
+	for (auto& file : _files) {
+		const char* data = nullptr;
+		size_t size = 0;
+
+		if (!map_file(file.path, &data, &size)) {
+			return false;
+		}
+
+		bool is_same = (size == file.size && hash_bytes(data, size) == file.hash);
+		unmap_file(data, size);
+
+		if (!is_same) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+ASTSequence* PrecompiledModule::load(const Importer& importer, SourceLocation location) {
+	_importer = &importer;
+	_location = location;
+
+	auto count = _read_u32();
+	for (uint32_t i = 0; i < count && !_failed; ++i) {
+		if (_read_u8()) {
+			auto node = importer.import(_read_symbol());
+			if (!node) {
+				_failed = true;
+				break;
+			}
+			_imports.push_back(node);
+		} else {
+			Entity entity;
+			if (_read_entity(entity)) {
+				importer.declare(entity);
+			}
+		}
+	}
+
+	ASTSequence* ast = _failed ? nullptr : _read_sequence();
+
+	if (ast && _cursor != _data + _size) {
+		_failed = true;
+	}
+
+	if (_failed) {
+		delete ast;
+		ast = nullptr;
+	}
+
+	// anything that's still here didn't make it into the AST
+	for (ASTNode* node : _imports) {
+		delete node;
+	}
+	_imports.clear();
+
+	_importer = nullptr;
+	return ast;
+}
+
+bool PrecompiledModule::_read(void* data, size_t size) {
+	if (_failed || (size_t)(_data + _size - _cursor) < size) {
+		_failed = true;
+		memset(data, 0, size);
+		return false;
+	}
+	memcpy(data, _cursor, size);
+	_cursor += size;
+	return true;
+}
+
+uint8_t PrecompiledModule::_read_u8() {
+	uint8_t value;
+	_read(&value, sizeof(value));
+	return value;
+}
+
+uint32_t PrecompiledModule::_read_u32() {
+	uint32_t value;
+	_read(&value, sizeof(value));
+	return value;
+}
+
+uint64_t PrecompiledModule::_read_u64() {
+	uint64_t value;
+	_read(&value, sizeof(value));
+	return value;
+}
+
+std::string PrecompiledModule::_read_string() {
+	auto size = _read_u32();
+	if (_failed || (size_t)(_data + _size - _cursor) < size) {
+		_failed = true;
+		return std::string();
+	}
+	std::string value(_cursor, size);
+	_cursor += size;
+	return value;
+}
+
+Symbol PrecompiledModule::_read_symbol() {
+	auto index = _read_u32();
+	if (index == kNew) {
+		auto value = _read_string();
+		_symbols.push_back(_failed ? Symbol() : Symbol(value));
+		return _symbols.back();
+	}
+	if (index >= _symbols.size()) {
+		_failed = true;
+		return Symbol();
+	}
+	return _symbols[index];
+}
+
+std::vector<Symbol> PrecompiledModule::_read_name() {
+	std::vector<Symbol> name;
+	auto count = _read_u32();
+	for (uint32_t i = 0; i < count && !_failed; ++i) {
+		name.push_back(_read_symbol());
+	}
+	return name;
+}
+
+C3TypePtr PrecompiledModule::_read_type() {
+	auto index = _read_u32();
+	if (index == kNull) {
+		return nullptr;
+	}
+	if (index != kNew) {
+		if (index >= _types.size()) {
+			_failed = true;
+			return nullptr;
+		}
+		return _types[index];
+	}
+
+	C3TypePtr type;
+
+	switch (_read_u8()) {
+		case TypeTagBuiltin:
+			type = shared_type((C3TypeType)_read_u8());
+			break;
+		case TypeTagPointer:
+			if (auto pointed_to = _read_type()) {
+				type = C3Type::PointerType(pointed_to);
+			}
+			break;
+		case TypeTagReference:
+			if (auto referenced = _read_type()) {
+				type = C3Type::ReferenceType(referenced);
+			}
+			break;
+		case TypeTagFunction: {
+			auto return_type = _read_type();
+			std::vector<C3TypePtr> arg_types;
+			auto count = _read_u32();
+			for (uint32_t i = 0; i < count && !_failed; ++i) {
+				arg_types.push_back(_read_type());
+			}
+			if (return_type && !_failed) {
+				type = C3Type::FunctionType(C3FunctionSignature(return_type, std::move(arg_types)));
+			}
+			break;
+		}
+		case TypeTagStruct: {
+			auto name = _read_string();
+			auto global_name = _read_symbol();
+			std::vector<C3StructDefinition::MemberVariable> member_vars;
+			auto count = _read_u32();
+			for (uint32_t i = 0; i < count && !_failed; ++i) {
+				auto member_name = _read_symbol();
+				auto member_type = _read_type();
+				if (!member_type) {
+					_failed = true;
+					break;
+				}
+				member_vars.emplace_back(member_name, member_type);
+			}
+			if (!_failed) {
+				type = C3Type::StructType(name, global_name, C3StructDefinition(std::move(member_vars)));
+			}
+			break;
+		}
+		case TypeTagModified: {
+			auto original = _read_type();
+			auto modifiers = _read_u32();
+			if (original && !_failed) {
+				type = C3Type::ModifiedType(original, modifiers);
+			}
+			break;
+		}
+		case TypeTagExternal: {
+			Entity entity;
+			entity.kind = EntityKindType;
+			entity.name = _read_name();
+			if (!_failed && _importer->resolve(entity)) {
+				type = entity.type;
+			}
+			break;
+		}
+	}
+
+	if (!type) {
+		_failed = true;
+		return nullptr;
+	}
+
+	_types.push_back(type);
+	return type;
+}
+
+C3VariablePtr PrecompiledModule::_read_variable() {
+	auto index = _read_u32();
+	if (index == kNull) {
+		return nullptr;
+	}
+	if (index != kNew) {
+		if (index >= _variables.size()) {
+			_failed = true;
+			return nullptr;
+		}
+		return _variables[index];
+	}
+
+	C3VariablePtr variable;
+
+	if (_read_u8()) {
+		Entity entity;
+		entity.kind = EntityKindVariable;
+		entity.name = _read_name();
+		if (!_failed && _importer->resolve(entity)) {
+			variable = entity.variable;
+		}
+	} else {
+		auto type = _read_type();
+		auto name = _read_symbol();
+		auto global_name = _read_symbol();
+		bool is_static = _read_u8();
+		if (type && !_failed) {
+			variable = C3VariablePtr(new C3Variable(type, name, global_name, _location, is_static));
+		}
+	}
+
+	if (!variable) {
+		_failed = true;
+		return nullptr;
+	}
+
+	_variables.push_back(variable);
+	return variable;
+}
+
+C3FunctionPtr PrecompiledModule::_read_function() {
+	auto index = _read_u32();
+	if (index == kNull) {
+		return nullptr;
+	}
+	if (index != kNew) {
+		if (index >= _functions.size()) {
+			_failed = true;
+			return nullptr;
+		}
+		return _functions[index];
+	}
+
+	C3FunctionPtr function;
+
+	if (_read_u8()) {
+		Entity entity;
+		entity.kind = EntityKindFunction;
+		entity.name = _read_name();
+		if (!_failed && _importer->resolve(entity)) {
+			function = entity.function;
+		}
+	} else {
+		auto return_type = _read_type();
+		auto name = _read_symbol();
+		auto global_name = _read_symbol();
+		std::vector<C3TypePtr> arg_types;
+		auto count = _read_u32();
+		for (uint32_t i = 0; i < count && !_failed; ++i) {
+			arg_types.push_back(_read_type());
+		}
+		bool is_defined = _read_u8();
+		if (return_type && !_failed) {
+			function = C3FunctionPtr(new C3Function(return_type, name, global_name, std::move(arg_types), _location));
+			if (is_defined) {
+				function->set_definition(_location);
+			}
+		}
+	}
+
+	if (!function) {
+		_failed = true;
+		return nullptr;
+	}
+
+	_functions.push_back(function);
+	return function;
+}
+
+bool PrecompiledModule::_read_entity(Entity& entity) {
+	entity.kind = (EntityKind)_read_u8();
+	entity.name = _read_name();
+
+	switch (entity.kind) {
+		case EntityKindType:
+			entity.type = _read_type();
+			break;
+		case EntityKindVariable:
+			entity.variable = _read_variable();
+			break;
+		case EntityKindFunction:
+			entity.function = _read_function();
+			break;
+		default:
+			_failed = true;
+	}
+
+	if (entity.name.empty()) {
+		_failed = true;
+	}
+
+	return !_failed;
+}
+
+ASTExpression* PrecompiledModule::_read_expression() {
+	auto node = _read_node();
+	auto expression = dynamic_cast<ASTExpression*>(node);
+	if (node && !expression) {
+		delete node;
+		_failed = true;
+	}
+	return expression;
+}
+
+ASTSequence* PrecompiledModule::_read_sequence() {
+	auto node = _read_node();
+	auto sequence = dynamic_cast<ASTSequence*>(node);
+	if (node && !sequence) {
+		delete node;
+		_failed = true;
+	}
+	return sequence;
+}
+
+ASTNode* PrecompiledModule::_read_node() {
+	switch (_read_u8()) {
+		case NodeTagNull:
+			return nullptr;
+		case NodeTagImport: {
+			auto index = _read_u32();
+			if (index >= _imports.size() || !_imports[index]) {
+				break;
+			}
+			auto node = _imports[index];
+			_imports[index] = nullptr;
+			return node;
+		}
+		case NodeTagNop:
+			return new ASTNop();
+		case NodeTagSequence: {
+			std::unique_ptr<ASTSequence> sequence(new ASTSequence());
+			auto count = _read_u32();
+			for (uint32_t i = 0; i < count && !_failed; ++i) {
+				if (auto node = _read_node()) {
+					sequence->sequence.push_back(node);
+				} else {
+					_failed = true;
+				}
+			}
+			return _failed ? nullptr : sequence.release();
+		}
+		case NodeTagVariableRef: {
+			auto var = _read_variable();
+			if (!var) {
+				break;
+			}
+			return new ASTVariableRef(var);
+		}
+		case NodeTagVariableDec: {
+			auto var = _read_variable();
+			std::unique_ptr<ASTExpression> init(_read_expression());
+			if (!var || _failed) {
+				break;
+			}
+			return new ASTVariableDec(var, init.release());
+		}
+		case NodeTagFunctionRef: {
+			auto func = _read_function();
+			if (!func) {
+				break;
+			}
+			_referenced_functions.push_back(func);
+			return new ASTFunctionRef(func);
+		}
+		case NodeTagFunctionProto: {
+			auto func = _read_function();
+			auto arg_names = _read_name();
+			if (!func || _failed) {
+				break;
+			}
+			return new ASTFunctionProto(func, arg_names);
+		}
+		case NodeTagFunctionDef: {
+			auto node = _read_node();
+			std::unique_ptr<ASTFunctionProto> proto(dynamic_cast<ASTFunctionProto*>(node));
+			if (node && !proto) {
+				delete node;
+				break;
+			}
+			std::unique_ptr<ASTSequence> body(_read_sequence());
+			auto arg_prefix = _read_symbol();
+			if (!proto || !body || _failed) {
+				break;
+			}
+			proto->func->set_definition(_location);
+			return new ASTFunctionDef(proto.release(), body.release(), arg_prefix);
+		}
+		case NodeTagStructMemberRef: {
+			std::unique_ptr<ASTExpression> structure(_read_expression());
+			auto index = _read_u64();
+			if (!structure || _failed) {
+				break;
+			}
+			auto type = C3Type::RemoveReference(structure->type);
+			if (type->type() != C3TypeTypeStruct || index >= type->struct_definition().member_vars().size()) {
+				break;
+			}
+			return new ASTStructMemberRef(structure.release(), index);
+		}
+		case NodeTagFloatingPoint: {
+			double value;
+			_read(&value, sizeof(value));
+			auto type = _read_type();
+			if (!type || _failed) {
+				break;
+			}
+			return new ASTFloatingPoint(value, type);
+		}
+		case NodeTagInteger: {
+			auto value = _read_u64();
+			auto type = _read_type();
+			if (!type || _failed) {
+				break;
+			}
+			return new ASTInteger(value, type);
+		}
+		case NodeTagConstantArray: {
+			auto type = _read_type();
+			auto size = _read_u64();
+			if (!type || _failed || (uint64_t)(_data + _size - _cursor) < size) {
+				break;
+			}
+			auto node = new ASTConstantArray(_cursor, size, type);
+			_cursor += size;
+			return node;
+		}
+		case NodeTagUnaryOp: {
+			auto op = _read_string();
+			std::unique_ptr<ASTExpression> right(_read_expression());
+			auto type = _read_type();
+			if (!right || !type || _failed) {
+				break;
+			}
+			return new ASTUnaryOp(op, right.release(), type);
+		}
+		case NodeTagBinaryOp: {
+			auto op = _read_string();
+			std::unique_ptr<ASTExpression> left(_read_expression());
+			std::unique_ptr<ASTExpression> right(_read_expression());
+			auto type = _read_type();
+			if (!left || !right || !type || _failed) {
+				break;
+			}
+			return new ASTBinaryOp(op, left.release(), right.release(), type);
+		}
+		case NodeTagReturn: {
+			std::unique_ptr<ASTExpression> value(_read_expression());
+			if (_failed) {
+				break;
+			}
+			return new ASTReturn(value.release());
+		}
+		case NodeTagInlineAsm: {
+			auto assembly = _read_string();
+			std::vector<std::unique_ptr<ASTExpression>> operands[2];
+			for (auto& list : operands) {
+				auto count = _read_u32();
+				for (uint32_t i = 0; i < count && !_failed; ++i) {
+					list.emplace_back(_read_expression());
+					if (!list.back()) {
+						_failed = true;
+					}
+				}
+			}
+			std::vector<std::string> constraints;
+			auto count = _read_u32();
+			for (uint32_t i = 0; i < count && !_failed; ++i) {
+				constraints.push_back(_read_string());
+			}
+			if (_failed) {
+				break;
+			}
+			std::vector<ASTExpression*> outputs;
+			std::vector<ASTExpression*> inputs;
+			for (auto& output : operands[0]) {
+				outputs.push_back(output.release());
+			}
+			for (auto& input : operands[1]) {
+				inputs.push_back(input.release());
+			}
+			return new ASTInlineAsm(assembly, outputs, inputs, constraints);
+		}
+		case NodeTagFunctionCall: {
+			std::unique_ptr<ASTExpression> func(_read_expression());
+			std::vector<std::unique_ptr<ASTExpression>> args;
+			auto count = _read_u32();
+			for (uint32_t i = 0; i < count && !_failed; ++i) {
+				args.emplace_back(_read_expression());
+				if (!args.back()) {
+					_failed = true;
+				}
+			}
+			if (!func || _failed || func->type->type() != C3TypeTypeFunction) {
+				break;
+			}
+			std::vector<ASTExpression*> arg_nodes;
+			for (auto& arg : args) {
+				arg_nodes.push_back(arg.release());
+			}
+			return new ASTFunctionCall(func.release(), arg_nodes);
+		}
+		case NodeTagCast: {
+			std::unique_ptr<ASTExpression> original(_read_expression());
+			auto type = _read_type();
+			if (!original || !type || _failed) {
+				break;
+			}
+			return new ASTCast(original.release(), type);
+		}
+		case NodeTagCondition: {
+			std::unique_ptr<ASTExpression> condition(_read_expression());
+			std::unique_ptr<ASTNode> true_path(_read_node());
+			std::unique_ptr<ASTNode> false_path(_read_node());
+			if (!condition || _failed) {
+				break;
+			}
+			return new ASTCondition(condition.release(), true_path.release(), false_path.release());
+		}
+		case NodeTagWhileLoop: {
+			std::unique_ptr<ASTExpression> condition(_read_expression());
+			std::unique_ptr<ASTNode> body(_read_node());
+			if (!condition || _failed) {
+				break;
+			}
+			return new ASTWhileLoop(condition.release(), body.release());
+		}
+		case NodeTagNullPointer: {
+			auto type = _read_type();
+			if (!type) {
+				break;
+			}
+			return new ASTNullPointer(type);
+		}
+	}
+
+	_failed = true;
+	return nullptr;
+}
+
+PrecompiledModuleWriter::PrecompiledModuleWriter(const std::string& source, const std::vector<std::string>& include_paths) : _source(source), _include_paths(include_paths) {
+}
+
+void PrecompiledModuleWriter::add_file(const PrecompiledModule::File& file) {
+	if (_file_paths.insert(file.path).second) {
+		_files.push_back(file);
+	}
+}
+
+void PrecompiledModuleWriter::add_dependency(const PrecompiledModule::Dependency& dependency) {
+	if (_dependency_names.insert(dependency.name).second) {
+		_dependencies.push_back(dependency);
+	}
+}
+
+void PrecompiledModuleWriter::add_identifier(Symbol identifier) {
+	_identifiers.push_back(identifier);
+}
+
+void PrecompiledModuleWriter::add_external(const PrecompiledModule::Entity& entity) {
+	switch (entity.kind) {
+		case PrecompiledModule::EntityKindType:
+			_externals[&*entity.type] = entity.name;
+			if (entity.type->type() == C3TypeTypeStruct) {
+				_structs[entity.type->global_name()] = entity.type;
+			}
+			break;
+		case PrecompiledModule::EntityKindVariable:
+			_externals[entity.variable.get()] = entity.name;
+			break;
+		case PrecompiledModule::EntityKindFunction:
+			_externals[entity.function.get()] = entity.name;
+			break;
+	}
+}
+
+void PrecompiledModuleWriter::add_import(Symbol name, ASTNode* node) {
+	auto index = (uint32_t)_imports.size();
+	_imports[node] = index;
+
+	Item item;
+	item.is_import = true;
+	item.import = name;
+	_items.push_back(std::move(item));
+}
+
+void PrecompiledModuleWriter::add_declaration(const PrecompiledModule::Entity& entity) {
+	if (entity.kind == PrecompiledModule::EntityKindType && entity.type->type() == C3TypeTypeStruct) {
+		_own_structs.insert(&*entity.type);
+		_structs[entity.type->global_name()] = entity.type;
+	}
+
+	Item item;
+	item.is_import = false;
+	item.declaration = entity;
+	_items.push_back(std::move(item));
+}
+
+bool PrecompiledModuleWriter::write(ASTSequence* ast, const std::string& filename) {
+	_data.assign(kHeaderSize, 0);
+
+	_write_string(_source);
+
+	_write_u32(_include_paths.size());
+	for (auto& path : _include_paths) {
+		_write_string(path);
+	}
+
+	_write_u32(_files.size());
+	for (auto& file : _files) {
+		_write_string(file.path);
+		_write_u64(file.size);
+		_write_u64(file.hash);
+	}
+
+	_write_u32(_dependencies.size());
+	for (auto& dependency : _dependencies) {
+		_write_symbol(dependency.name);
+		_write_string(dependency.path);
+	}
+
+	_write_u32(_identifiers.size());
+	for (Symbol identifier : _identifiers) {
+		_write_symbol(identifier);
+	}
+
+	_write_u32(_items.size());
+	for (auto& item : _items) {
+		_write_u8(item.is_import);
+		if (item.is_import) {
+			_write_symbol(item.import);
+		} else {
+			_write_entity(item.declaration);
+		}
+	}
+
+	_write_node(ast);
+
+	if (_failed) {
+		return false;
+	}
+
+	uint64_t hash = hash_bytes(_data.data() + kHeaderSize, _data.size() - kHeaderSize);
+	memcpy(_data.data(), kMagic, sizeof(kMagic));
+	memcpy(_data.data() + sizeof(kMagic), &kVersion, sizeof(kVersion));
+	memcpy(_data.data() + sizeof(kMagic) + sizeof(kVersion), &hash, sizeof(hash));
+
+	// other compilations might be loading it, so it's written elsewhere and moved into place
+	auto temporary = filename + ".tmp" + std::to_string(getpid());
+
+	FILE* f = fopen(temporary.c_str(), "wb");
+	if (!f) {
+		return false;
+	}
+
+	bool is_written = (fwrite(_data.data(), 1, _data.size(), f) == _data.size());
+	is_written = !fclose(f) && is_written;
+
+	if (!is_written || rename(temporary.c_str(), filename.c_str())) {
+		remove(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void PrecompiledModuleWriter::_write(const void* data, size_t size) {
+	auto bytes = (const char*)data;
+	_data.insert(_data.end(), bytes, bytes + size);
+}
+
+void PrecompiledModuleWriter::_write_u8(uint8_t value) {
+	_write(&value, sizeof(value));
+}
+
+void PrecompiledModuleWriter::_write_u32(uint32_t value) {
+	_write(&value, sizeof(value));
+}
+
+void PrecompiledModuleWriter::_write_u64(uint64_t value) {
+	_write(&value, sizeof(value));
+}
+
+void PrecompiledModuleWriter::_write_string(const std::string& value) {
+	_write_u32(value.size());
+	_write(value.data(), value.size());
+}
+
+void PrecompiledModuleWriter::_write_symbol(Symbol symbol) {
+	auto it = _symbols.find(symbol);
+	if (it != _symbols.end()) {
+		_write_u32(it->second);
+		return;
+	}
+
+	_write_u32(kNew);
+	_write_string(symbol.str());
+
+	auto index = (uint32_t)_symbols.size();
+	_symbols[symbol] = index;
+}
+
+void PrecompiledModuleWriter::_write_name(const std::vector<Symbol>& name) {
+	_write_u32(name.size());
+	for (Symbol component : name) {
+		_write_symbol(component);
+	}
+}
+
+void PrecompiledModuleWriter::_write_type(C3TypePtr type) {
+	if (!type) {
+		_write_u32(kNull);
+		return;
+	}
+
+	auto it = _types.find(&*type);
+	if (it != _types.end()) {
+		_write_u32(it->second);
+		return;
+	}
+
+	_write_u32(kNew);
+
+	auto shared = shared_type(type->type());
+	auto external = _externals.find(&*type);
+
+	if (shared && &*shared == &*type) {
+		_write_u8(TypeTagBuiltin);
+		_write_u8(type->type());
+	} else if (external != _externals.end()) {
+		_write_u8(TypeTagExternal);
+		_write_name(external->second);
+	} else if (_own_structs.count(&*type)) {
+		_write_u8(TypeTagStruct);
+		_write_string(type->name());
+		_write_symbol(type->global_name());
+		auto& member_vars = type->struct_definition().member_vars();
+		_write_u32(member_vars.size());
+		for (auto& member : member_vars) {
+			_write_symbol(member.name);
+			_write_type(member.type);
+		}
+	} else if (!type->modifiers() && type->type() == C3TypeTypePointer && &*C3Type::PointerType(type->pointed_to_type()) == &*type) {
+		_write_u8(TypeTagPointer);
+		_write_type(type->pointed_to_type());
+	} else if (!type->modifiers() && type->type() == C3TypeTypeReference && &*C3Type::ReferenceType(type->referenced_type()) == &*type) {
+		_write_u8(TypeTagReference);
+		_write_type(type->referenced_type());
+	} else if (!type->modifiers() && type->type() == C3TypeTypeFunction) {
+		_write_u8(TypeTagFunction);
+		_write_type(type->signature().return_type());
+		auto& arg_types = type->signature().arg_types();
+		_write_u32(arg_types.size());
+		for (auto& arg_type : arg_types) {
+			_write_type(arg_type);
+		}
+	} else {
+		// a modified copy of some other type, which is saved as the type it was copied from
+		C3TypePtr original;
+
+		switch (type->type()) {
+			case C3TypeTypePointer:
+				original = C3Type::PointerType(type->pointed_to_type());
+				break;
+			case C3TypeTypeReference:
+				original = C3Type::ReferenceType(type->referenced_type());
+				break;
+			case C3TypeTypeFunction:
+				original = C3Type::FunctionType(type->signature());
+				break;
+			case C3TypeTypeStruct: {
+				auto declared = _structs.find(type->global_name());
+				if (declared != _structs.end()) {
+					original = declared->second;
+				}
+				break;
+			}
+			default:
+				original = shared;
+		}
+
+		if (!original || &*original == &*type) {
+			_failed = true;
+			return;
+		}
+
+		_write_u8(TypeTagModified);
+		_write_type(original);
+		_write_u32(type->modifiers());
+	}
+
+	auto index = (uint32_t)_types.size();
+	_types[&*type] = index;
+}
+
+void PrecompiledModuleWriter::_write_variable(C3VariablePtr variable) {
+	if (!variable) {
+		_write_u32(kNull);
+		return;
+	}
+
+	auto it = _variables.find(variable.get());
+	if (it != _variables.end()) {
+		_write_u32(it->second);
+		return;
+	}
+
+	_write_u32(kNew);
+
+	auto external = _externals.find(variable.get());
+	_write_u8(external != _externals.end());
+
+	if (external != _externals.end()) {
+		_write_name(external->second);
+	} else {
+		_write_type(variable->type());
+		_write_symbol(variable->name());
+		_write_symbol(variable->global_name());
+		_write_u8(variable->is_static());
+	}
+
+	auto index = (uint32_t)_variables.size();
+	_variables[variable.get()] = index;
+}
+
+void PrecompiledModuleWriter::_write_function(C3FunctionPtr function) {
+	if (!function) {
+		_write_u32(kNull);
+		return;
+	}
+
+	auto it = _functions.find(function.get());
+	if (it != _functions.end()) {
+		_write_u32(it->second);
+		return;
+	}
+
+	_write_u32(kNew);
+
+	auto external = _externals.find(function.get());
+	_write_u8(external != _externals.end());
+
+	if (external != _externals.end()) {
+		_write_name(external->second);
+	} else {
+		_write_type(function->return_type());
+		_write_symbol(function->name());
+		_write_symbol(function->global_name());
+		_write_u32(function->arg_types().size());
+		for (auto& arg_type : function->arg_types()) {
+			_write_type(arg_type);
+		}
+		_write_u8(function->definition().is_valid());
+	}
+
+	auto index = (uint32_t)_functions.size();
+	_functions[function.get()] = index;
+}
+
+void PrecompiledModuleWriter::_write_entity(const PrecompiledModule::Entity& entity) {
+	_write_u8(entity.kind);
+	_write_name(entity.name);
+
+	switch (entity.kind) {
+		case PrecompiledModule::EntityKindType:
+			_write_type(entity.type);
+			break;
+		case PrecompiledModule::EntityKindVariable:
+			_write_variable(entity.variable);
+			break;
+		case PrecompiledModule::EntityKindFunction:
+			_write_function(entity.function);
+			break;
+	}
+}
+
+void PrecompiledModuleWriter::_write_node(ASTNode* node) {
+	if (!node) {
+		_write_u8(NodeTagNull);
+		return;
+	}
+
+	auto import = _imports.find(node);
+	if (import != _imports.end()) {
+		_write_u8(NodeTagImport);
+		_write_u32(import->second);
+		return;
+	}
+
+	node->accept(this);
+}
+
+const void* PrecompiledModuleWriter::visit(ASTNode* node) {
+	// not something the parser makes
+	_failed = true;
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTNop* node) {
+	_write_u8(NodeTagNop);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTExpression* node) {
+	_failed = true;
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTSequence* node) {
+	_write_u8(NodeTagSequence);
+	_write_u32(node->sequence.size());
+	for (ASTNode* n : node->sequence) {
+		_write_node(n);
+	}
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTVariableRef* node) {
+	_write_u8(NodeTagVariableRef);
+	_write_variable(node->var);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTVariableDec* node) {
+	_write_u8(NodeTagVariableDec);
+	_write_variable(node->var);
+	_write_node(node->init);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTFunctionRef* node) {
+	_write_u8(NodeTagFunctionRef);
+	_write_function(node->func);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTFunctionProto* node) {
+	_write_u8(NodeTagFunctionProto);
+	_write_function(node->func);
+	_write_name(node->arg_names);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTFunctionDef* node) {
+	_write_u8(NodeTagFunctionDef);
+	_write_node(node->proto);
+	_write_node(node->body);
+	_write_symbol(node->arg_prefix);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTStructMemberRef* node) {
+	_write_u8(NodeTagStructMemberRef);
+	_write_node(node->structure);
+	_write_u64(node->index);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTFloatingPoint* node) {
+	_write_u8(NodeTagFloatingPoint);
+	_write(&node->value, sizeof(node->value));
+	_write_type(node->type);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTInteger* node) {
+	_write_u8(NodeTagInteger);
+	_write_u64(node->value);
+	_write_type(node->type);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTConstantArray* node) {
+	_write_u8(NodeTagConstantArray);
+	_write_type(node->type->pointed_to_type());
+	_write_u64(node->size);
+	_write(node->data, node->size);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTUnaryOp* node) {
+	_write_u8(NodeTagUnaryOp);
+	_write_string(node->op);
+	_write_node(node->right);
+	_write_type(node->ASTExpression::type);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTBinaryOp* node) {
+	_write_u8(NodeTagBinaryOp);
+	_write_string(node->op);
+	_write_node(node->left);
+	_write_node(node->right);
+	_write_type(node->ASTExpression::type);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTReturn* node) {
+	_write_u8(NodeTagReturn);
+	_write_node(node->value);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTInlineAsm* node) {
+	_write_u8(NodeTagInlineAsm);
+	_write_string(node->assembly);
+	_write_u32(node->outputs.size());
+	for (ASTExpression* output : node->outputs) {
+		_write_node(output);
+	}
+	_write_u32(node->inputs.size());
+	for (ASTExpression* input : node->inputs) {
+		_write_node(input);
+	}
+	_write_u32(node->constraints.size());
+	for (auto& constraint : node->constraints) {
+		_write_string(constraint);
+	}
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTFunctionCall* node) {
+	_write_u8(NodeTagFunctionCall);
+	_write_node(node->func);
+	_write_u32(node->args.size());
+	for (ASTExpression* arg : node->args) {
+		_write_node(arg);
+	}
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTCast* node) {
+	_write_u8(NodeTagCast);
+	_write_node(node->original);
+	_write_type(node->type);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTCondition* node) {
+	_write_u8(NodeTagCondition);
+	_write_node(node->condition);
+	_write_node(node->true_path);
+	_write_node(node->false_path);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTWhileLoop* node) {
+	_write_u8(NodeTagWhileLoop);
+	_write_node(node->condition);
+	_write_node(node->body);
+	return nullptr;
+}
+
+const void* PrecompiledModuleWriter::visit(ASTNullPointer* node) {
+	_write_u8(NodeTagNullPointer);
+	_write_type(node->type);
+	return nullptr;
+}
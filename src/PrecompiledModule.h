@@ -0,0 +1,252 @@
+#pragma once
+
+#include "AST.h"
+#include "SourceLocation.h"
+#include "Symbol.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+* A module's AST and what it declares in its global scope, saved next to its source so that other compilations can
+* import it without preprocessing or parsing it. Whatever it uses from the modules it imports is saved by name, and
+* those modules are imported again when it's loaded, so each module is only saved once.
+*/
+class PrecompiledModule {
+	public:
+		enum EntityKind : uint8_t {
+			EntityKindType,
+			EntityKindVariable,
+			EntityKindFunction,
+		};
+
+		/**
+		* A type, variable, or function, named by the namespaces it's in followed by its own name.
+		*/
+		struct Entity {
+			EntityKind kind;
+			std::vector<Symbol> name;
+
+			// whichever the kind is
+			C3TypePtr type;
+			C3VariablePtr variable;
+			C3FunctionPtr function;
+		};
+
+		/**
+		* A file that was read to parse the module, either directly or through an import.
+		*/
+		struct File {
+			std::string path;
+			uint64_t size;
+			uint64_t hash;
+		};
+
+		/**
+		* A module that was imported, either directly or through another import, and where it was found.
+		*/
+		struct Dependency {
+			Symbol name;
+			std::string path;
+		};
+
+		/**
+		* What the module needs from whoever's loading it.
+		*/
+		struct Importer {
+			// imports a module the module imported, returning nullptr if that fails
+			std::function<ASTNode*(Symbol name)> import;
+
+			// declares something the module declared
+			std::function<void(const Entity& entity)> declare;
+
+			// fills in the value of something from another module by its name, returning false if there's no such thing
+			std::function<bool(Entity& entity)> resolve;
+		};
+
+		PrecompiledModule() {}
+		~PrecompiledModule();
+
+		/**
+		* Maps a precompiled module and reads what it was made from, so that it can be checked before it's loaded.
+		* Returns false if it can't be read or was written by a different version.
+		*/
+		bool open(const std::string& filename);
+
+		const std::string& source() const { return _source; }
+		const std::vector<std::string>& include_paths() const { return _include_paths; }
+		const std::vector<File>& files() const { return _files; }
+		const std::vector<Dependency>& dependencies() const { return _dependencies; }
+
+		/**
+		* Every identifier in the module's own files.
+		*/
+		const std::vector<Symbol>& identifiers() const { return _identifiers; }
+
+		/**
+		* Whether the files it was made from still have the same contents. Reads every one of them.
+		*/
+		bool is_current() const;
+
+		/**
+		* Makes the module's imports and declarations in the order they were originally made, and returns the AST. What
+		* the module itself declared is given `location`. Returns nullptr if it fails part way.
+		*/
+		ASTSequence* load(const Importer& importer, SourceLocation location);
+
+		/**
+		* The functions the module's code refers to, once it's been loaded.
+		*/
+		const std::vector<C3FunctionPtr>& referenced_functions() const { return _referenced_functions; }
+
+	private:
+		PrecompiledModule(const PrecompiledModule& other) = delete;
+		PrecompiledModule& operator=(const PrecompiledModule& other) = delete;
+
+		const char* _data = nullptr;
+		size_t _size = 0;
+
+		const char* _cursor = nullptr;
+		bool _failed = false;
+
+		std::string _source;
+		std::vector<std::string> _include_paths;
+		std::vector<File> _files;
+		std::vector<Dependency> _dependencies;
+		std::vector<Symbol> _identifiers;
+
+		const Importer* _importer = nullptr;
+		SourceLocation _location;
+
+		// everything read so far, in the order it was first written
+		std::vector<Symbol> _symbols;
+		std::vector<C3TypePtr> _types;
+		std::vector<C3VariablePtr> _variables;
+		std::vector<C3FunctionPtr> _functions;
+
+		std::vector<ASTNode*> _imports;
+		std::vector<C3FunctionPtr> _referenced_functions;
+
+		bool _read(void* data, size_t size);
+		uint8_t _read_u8();
+		uint32_t _read_u32();
+		uint64_t _read_u64();
+		std::string _read_string();
+		Symbol _read_symbol();
+		std::vector<Symbol> _read_name();
+
+		C3TypePtr _read_type();
+		C3VariablePtr _read_variable();
+		C3FunctionPtr _read_function();
+		bool _read_entity(Entity& entity);
+
+		ASTNode* _read_node();
+		ASTExpression* _read_expression();
+		ASTSequence* _read_sequence();
+};
+
+/**
+* Saves a module for PrecompiledModule to load.
+*/
+class PrecompiledModuleWriter : private ASTNodeVisitor {
+	public:
+		PrecompiledModuleWriter(const std::string& source, const std::vector<std::string>& include_paths);
+
+		void add_file(const PrecompiledModule::File& file);
+		void add_dependency(const PrecompiledModule::Dependency& dependency);
+		void add_identifier(Symbol identifier);
+
+		/**
+		* Makes `entity` be saved as its name wherever it's used, to be looked up again when the module's loaded.
+		*/
+		void add_external(const PrecompiledModule::Entity& entity);
+
+		/**
+		* Imports and declarations are made again in the order they're added. `node` is where the import is in the AST.
+		*/
+		void add_import(Symbol name, ASTNode* node);
+		void add_declaration(const PrecompiledModule::Entity& entity);
+
+		/**
+		* Writes the module to `filename`, replacing whatever's there all at once. Returns false if it can't be written,
+		* or if something in it can't be saved.
+		*/
+		bool write(ASTSequence* ast, const std::string& filename);
+
+	private:
+		std::string _source;
+		std::vector<std::string> _include_paths;
+		std::vector<PrecompiledModule::File> _files;
+		std::unordered_set<std::string> _file_paths;
+		std::vector<PrecompiledModule::Dependency> _dependencies;
+		std::unordered_set<Symbol> _dependency_names;
+		std::vector<Symbol> _identifiers;
+
+		struct Item {
+			bool is_import;
+			Symbol import;
+			PrecompiledModule::Entity declaration;
+		};
+
+		std::vector<Item> _items;
+		std::unordered_map<const ASTNode*, uint32_t> _imports;
+
+		// entities from other modules, by address
+		std::unordered_map<const void*, std::vector<Symbol>> _externals;
+
+		// the declared struct types by global name, to find what modified copies of them were copied from
+		std::unordered_map<Symbol, C3TypePtr> _structs;
+
+		// the module's own struct types
+		std::unordered_set<const C3Type*> _own_structs;
+
+		std::vector<char> _data;
+		bool _failed = false;
+
+		std::unordered_map<Symbol, uint32_t> _symbols;
+		std::unordered_map<const C3Type*, uint32_t> _types;
+		std::unordered_map<const C3Variable*, uint32_t> _variables;
+		std::unordered_map<const C3Function*, uint32_t> _functions;
+
+		void _write(const void* data, size_t size);
+		void _write_u8(uint8_t value);
+		void _write_u32(uint32_t value);
+		void _write_u64(uint64_t value);
+		void _write_string(const std::string& value);
+		void _write_symbol(Symbol symbol);
+		void _write_name(const std::vector<Symbol>& name);
+
+		void _write_type(C3TypePtr type);
+		void _write_variable(C3VariablePtr variable);
+		void _write_function(C3FunctionPtr function);
+		void _write_entity(const PrecompiledModule::Entity& entity);
+
+		void _write_node(ASTNode* node);
+
+		virtual const void* visit(ASTNode* node);
+		virtual const void* visit(ASTNop* node);
+		virtual const void* visit(ASTExpression* node);
+		virtual const void* visit(ASTSequence* node);
+		virtual const void* visit(ASTVariableRef* node);
+		virtual const void* visit(ASTVariableDec* node);
+		virtual const void* visit(ASTFunctionRef* node);
+		virtual const void* visit(ASTFunctionProto* node);
+		virtual const void* visit(ASTFunctionDef* node);
+		virtual const void* visit(ASTStructMemberRef* node);
+		virtual const void* visit(ASTFloatingPoint* node);
+		virtual const void* visit(ASTInteger* node);
+		virtual const void* visit(ASTConstantArray* node);
+		virtual const void* visit(ASTUnaryOp* node);
+		virtual const void* visit(ASTBinaryOp* node);
+		virtual const void* visit(ASTReturn* node);
+		virtual const void* visit(ASTInlineAsm* node);
+		virtual const void* visit(ASTFunctionCall* node);
+		virtual const void* visit(ASTCast* node);
+		virtual const void* visit(ASTCondition* node);
+		virtual const void* visit(ASTWhileLoop* node);
+		virtual const void* visit(ASTNullPointer* node);
+};
@@ -1,125 +1,816 @@
 #include "Preprocessor.h"
+#include "Lexer.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
 
-Preprocessor::Preprocessor() {
+namespace {
+	// how many tokens are produced at a time
+	const size_t kTokenChunkSize = 1024;
+
+	// how many of a file's expansions are kept. a file that's included in more states than this is processed again
+	// in the rest of them
+	const size_t kMaximumExpansions = 8;
+
+	struct ExpressionToken {
+		TokenType type;
+		TokenKind kind;
+		const char* text;
+		size_t length;
+	};
+
+	int binary_precedence(TokenKind kind) {
+		switch (kind) {
+			case TokenKindAsterisk:
+			case TokenKindSlash:
+			case TokenKindPercent:
+				return 10;
+			case TokenKindPlus:
+			case TokenKindMinus:
+				return 9;
+			case TokenKindShiftLeft:
+			case TokenKindShiftRight:
+				return 8;
+			case TokenKindLessThan:
+			case TokenKindGreaterThan:
+			case TokenKindLessThanOrEqual:
+			case TokenKindGreaterThanOrEqual:
+				return 7;
+			case TokenKindEquality:
+			case TokenKindInequality:
+				return 6;
+			case TokenKindAmpersand:
+				return 5;
+			case TokenKindCaret:
+				return 4;
+			case TokenKindPipe:
+				return 3;
+			case TokenKindLogicalAnd:
+				return 2;
+			case TokenKindLogicalOr:
+				return 1;
+			default:
+				return 0;
+		}
+	}
+
+	/**
+	* Evaluates the integer constant expressions of #if and #elif with C's precedence. Arithmetic wraps instead of
+	* overflowing, and operands that aren't evaluated because of && || and ?: can't cause errors.
+	*/
+	class ExpressionEvaluator {
+		public:
+			ExpressionEvaluator(const std::vector<ExpressionToken>& tokens) : _tokens(tokens) {}
+
+			bool evaluate(int64_t* result, std::string* error) {
+				*result = _conditional(true);
+				if (_error.empty() && _position < _tokens.size()) {
+					_fail("unexpected \"" + _text(_tokens[_position]) + "\" in condition");
+				}
+				*error = _error;
+				return _error.empty();
+			}
+
+		private:
+			const std::vector<ExpressionToken>& _tokens;
+			size_t _position = 0;
+			std::string _error;
+
+			std::string _text(const ExpressionToken& token) {
+				return std::string(token.text, token.length);
+			}
+
+			void _fail(const std::string& error) {
+				if (_error.empty()) {
+					_error = error;
+				}
+			}
+
+			bool _accept(TokenKind kind) {
+				if (_position < _tokens.size() && _tokens[_position].kind == kind) {
+					++_position;
+					return true;
+				}
+				return false;
+			}
+
+			int64_t _conditional(bool is_evaluated) {
+				int64_t condition = _binary(1, is_evaluated);
+				if (!_accept(TokenKindQuestion)) {
+					return condition;
+				}
+				int64_t a = _conditional(is_evaluated && condition);
+				if (!_accept(TokenKindColon)) {
+					_fail("expected ':' in condition");
+					return 0;
+				}
+				int64_t b = _conditional(is_evaluated && !condition);
+				return condition ? a : b;
+			}
+
+			int64_t _binary(int minimum_precedence, bool is_evaluated) {
+				int64_t lhs = _unary(is_evaluated);
+
+				while (_position < _tokens.size() && _error.empty()) {
+					TokenKind op = _tokens[_position].kind;
+					int precedence = binary_precedence(op);
+					if (!precedence || precedence < minimum_precedence) {
+						break;
+					}
+					++_position;
+
+					if (op == TokenKindLogicalAnd) {
+						int64_t rhs = _binary(precedence + 1, is_evaluated && lhs);
+						lhs = lhs && rhs;
+					} else if (op == TokenKindLogicalOr) {
+						int64_t rhs = _binary(precedence + 1, is_evaluated && !lhs);
+						lhs = lhs || rhs;
+					} else {
+						int64_t rhs = _binary(precedence + 1, is_evaluated);
+						lhs = _apply(op, lhs, rhs, is_evaluated);
+					}
+				}
+
+				return lhs;
+			}
+
+			int64_t _apply(TokenKind op, int64_t lhs, int64_t rhs, bool is_evaluated) {
+				switch (op) {
+					case TokenKindAsterisk:
+						return (int64_t)((uint64_t)lhs * (uint64_t)rhs);
+					case TokenKindSlash:
+					case TokenKindPercent:
+						if (!rhs) {
+							if (is_evaluated) {
+								_fail("division by zero in condition");
+							}
+							return 0;
+						}
+						if (rhs == -1) {
+							// INT64_MIN / -1 overflows
+							return op == TokenKindSlash ? (int64_t)(0 - (uint64_t)lhs) : 0;
+						}
+						return op == TokenKindSlash ? lhs / rhs : lhs % rhs;
+					case TokenKindPlus:
+						return (int64_t)((uint64_t)lhs + (uint64_t)rhs);
+					case TokenKindMinus:
+						return (int64_t)((uint64_t)lhs - (uint64_t)rhs);
+					case TokenKindShiftLeft:
+						return (int64_t)((uint64_t)lhs << (rhs & 63));
+					case TokenKindShiftRight:
+						return lhs >> (rhs & 63);
+					case TokenKindLessThan:
+						return lhs < rhs;
+					case TokenKindGreaterThan:
+						return lhs > rhs;
+					case TokenKindLessThanOrEqual:
+						return lhs <= rhs;
+					case TokenKindGreaterThanOrEqual:
+						return lhs >= rhs;
+					case TokenKindEquality:
+						return lhs == rhs;
+					case TokenKindInequality:
+						return lhs != rhs;
+					case TokenKindAmpersand:
+						return lhs & rhs;
+					case TokenKindCaret:
+						return lhs ^ rhs;
+					case TokenKindPipe:
+						return lhs | rhs;
+					default:
+						return 0;
+				}
+			}
+
+			int64_t _unary(bool is_evaluated) {
+				if (_accept(TokenKindExclamation)) {
+					return !_unary(is_evaluated);
+				} else if (_accept(TokenKindTilde)) {
+					return ~_unary(is_evaluated);
+				} else if (_accept(TokenKindMinus)) {
+					return (int64_t)(0 - (uint64_t)_unary(is_evaluated));
+				} else if (_accept(TokenKindPlus)) {
+					return _unary(is_evaluated);
+				}
+				return _primary(is_evaluated);
+			}
+
+			int64_t _primary(bool is_evaluated) {
+				if (_position >= _tokens.size()) {
+					_fail("expected value at end of condition");
+					return 0;
+				}
+
+				if (_accept(TokenKindOpenParen)) {
+					int64_t value = _conditional(is_evaluated);
+					if (!_accept(TokenKindCloseParen)) {
+						_fail("expected ')' in condition");
+					}
+					return value;
+				}
+
+				const ExpressionToken& token = _tokens[_position];
+				if (token.type != TokenTypeNumber) {
+					_fail("unexpected \"" + _text(token) + "\" in condition");
+					return 0;
+				}
+				++_position;
+
+				std::string text = _text(token);
+				char* end = nullptr;
+				errno = 0;
+				// decimal only, like the language's own integer literals, so "010" is ten rather than C's eight
+				uint64_t value = strtoull(text.c_str(), &end, 10);
+				if (*end || errno) {
+					_fail("invalid integer \"" + text + "\" in condition");
+					return 0;
+				}
+				return (int64_t)value;
+			}
+	};
+
+	/**
+	* Replaces macros with their values and `defined X` or `defined(X)` with 1 or 0. Anything else that's an
+	* identifier, including a macro within its own value, becomes 0.
+	*/
+	template <class Lookup>
+	bool expand_condition(const char* contents, const std::vector<TokenRange>& tokens, size_t begin, const Lookup& lookup,
+		std::vector<Symbol>& expanding, std::vector<ExpressionToken>& expanded, std::string* error) {
+		static const char* const kZero = "0";
+		static const char* const kOne = "1";
+
+		for (size_t i = begin; i < tokens.size(); ++i) {
+			const TokenRange& token = tokens[i];
+			const char* text = contents + token.location;
+
+			if (token.type != TokenTypeIdentifier) {
+				expanded.push_back(ExpressionToken{token.type, token.kind, text, token.length});
+				continue;
+			}
+
+			if (token.length == 7 && !memcmp(text, "defined", 7)) {
+				bool is_parenthesized = (i + 1 < tokens.size() && tokens[i + 1].kind == TokenKindOpenParen);
+				size_t name = i + (is_parenthesized ? 2 : 1);
+				if (name >= tokens.size() || tokens[name].type != TokenTypeIdentifier ||
+					(is_parenthesized && (name + 1 >= tokens.size() || tokens[name + 1].kind != TokenKindCloseParen))) {
+					*error = "expected identifier after defined";
+					return false;
+				}
+				bool is_defined = lookup(Symbol(contents + tokens[name].location, tokens[name].length)) != nullptr;
+				expanded.push_back(ExpressionToken{TokenTypeNumber, TokenKindNone, is_defined ? kOne : kZero, 1});
+				i = name + (is_parenthesized ? 1 : 0);
+				continue;
+			}
+
+			Symbol symbol(text, token.length);
+			auto macro = lookup(symbol);
+			if (!macro || std::find(expanding.begin(), expanding.end(), symbol) != expanding.end()) {
+				expanded.push_back(ExpressionToken{TokenTypeNumber, TokenKindNone, kZero, 1});
+				continue;
+			}
+
+			expanding.push_back(symbol);
+			if (!expand_condition(macro->text.data(), macro->tokens, 0, lookup, expanding, expanded, error)) {
+				return false;
+			}
+			expanding.pop_back();
+		}
+
+		return true;
+	}
+
+	/**
+	* Lexes a macro's value, which must be lexed the same way in any file.
+	*/
+	bool lex_macro_value(const std::string& text, std::vector<TokenRange>* tokens) {
+		Lexer l;
+		if (!l.lex(text.data(), text.size(), *tokens)) {
+			return false;
+		}
+		for (auto& token : *tokens) {
+			token.kind = token_kind(token.type, text.data() + token.location, token.length);
+		}
+		return true;
+	}
+}
+
+Preprocessor::Preprocessor(SourceManager& sources) : _sources(sources), _tokens(sources, this) {
 }
 
 bool Preprocessor::process_file(const char* filename) {
-	auto file = std::make_shared<LexedFile>(filename);
-	
-	return file->lex(file) && _process_tokens(file->tokens());
+	return _begin_file(filename);
+}
+
+bool Preprocessor::define(const std::string& definition) {
+	auto equals = definition.find('=');
+	std::string name = definition.substr(0, equals);
+
+	std::vector<TokenRange> name_tokens;
+	if (!lex_macro_value(name, &name_tokens) || name_tokens.size() != 1 || name_tokens[0].type != TokenTypeIdentifier ||
+		name_tokens[0].length != name.size()) {
+		printf("Preprocessing error: invalid macro name \"%s\"\n", name.c_str());
+		return false;
+	}
+
+	Macro macro;
+	macro.text = (equals == std::string::npos) ? "1" : definition.substr(equals + 1);
+	if (!lex_macro_value(macro.text, &macro.tokens)) {
+		printf("Preprocessing error: invalid value for macro \"%s\"\n", name.c_str());
+		return false;
+	}
+
+	_define(Symbol(name), macro);
+	return true;
 }
 
-const std::list<TokenPtr>& Preprocessor::tokens() {
+TokenBuffer& Preprocessor::tokens() {
 	return _tokens;
 }
 
-template <class T>
-bool Preprocessor::_process_tokens(T& tokens) {
-	for (auto it = tokens.begin(); it != tokens.end();) {
-		TokenPtr tok = *it;
-		
-		if ((tok->flags() & TokenFlagLineFirst) && tok->type() == TokenTypePunctuator && tok->value() == "#") {
+bool Preprocessor::produce() {
+	if (_files.empty()) {
+		return false;
+	}
+
+	size_t target = _tokens.size() + kTokenChunkSize;
+	while (!_files.empty() && _tokens.size() < target) {
+		if (!_step(target)) {
+			_failed = true;
+			_files.clear();
+			_tokens.unpin();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Preprocessor::_evaluate_condition(LexedFile& file, const std::vector<TokenRange>& directive, bool* result) {
+	std::vector<ExpressionToken> expanded;
+	std::vector<Symbol> expanding;
+	std::string error;
+	int64_t value = 0;
+
+	if (directive.size() < 2) {
+		error = "expected condition";
+	} else if (expand_condition(file.contents(), directive, 1, [this](Symbol name) { return _macro(name); }, expanding, expanded, &error)) {
+		ExpressionEvaluator(expanded).evaluate(&value, &error);
+	}
+
+	if (!error.empty()) {
+		printf("Preprocessing error: %s\n", error.c_str());
+		file.print_pointer(directive[0].location);
+		return false;
+	}
+
+	*result = (value != 0);
+	return true;
+}
+
+bool Preprocessor::_begin_file(const char* filename) {
+	uint32_t file_index = 0;
+
+	if (!_sources.load(filename, &file_index)) {
+		return false;
+	}
+
+	if (std::find(_loaded_files.begin(), _loaded_files.end(), file_index) == _loaded_files.end()) {
+		_loaded_files.push_back(file_index);
+	}
+
+	if (_once.count(file_index)) {
+		return true;
+	}
+
+	auto guard = _guards.find(file_index);
+	if (guard != _guards.end() && _macro(guard->second)) {
+		return true;
+	}
+
+	for (size_t i = 1; i < _files.size(); ++i) {
+		_files[i].expansion.included.insert(file_index);
+	}
+
+	auto expansions = _expansions.find(file_index);
+	if (expansions != _expansions.end()) {
+		for (auto& expansion : expansions->second) {
+			if (_repeat(expansion)) {
+				return true;
+			}
+		}
+	}
+
+	if (!_active.insert(file_index).second) {
+		printf("Preprocessing error: %s includes itself\n", filename);
+		return false;
+	}
+
+	if (!_sources.file(file_index).restore_tokens()) {
+		_active.erase(file_index);
+		return false;
+	}
+
+	_files.push_back(FileState{file_index, 0, _tokens.size(), {}, Symbol()});
+
+	// included files' tokens are kept until they're done so that they can be copied
+	if (_files.size() == 2) {
+		_tokens.pin(_files.back().begin);
+	}
+
+	return true;
+}
+
+bool Preprocessor::_end_file() {
+	FileState& state = _files.back();
+	LexedFile& file = _sources.file(state.file);
+
+	if (!state.conditionals.empty()) {
+		printf("Preprocessing error: unterminated conditional\n");
+		file.print_pointer(state.conditionals.back().location);
+		return false;
+	}
+
+	_active.erase(state.file);
+
+	auto& expansions = _expansions[state.file];
+	if (_files.size() > 1 && expansions.size() < kMaximumExpansions) {
+		auto& expansion = state.expansion;
+		for (Symbol name : state.written) {
+			auto macro = _macros.find(name);
+			expansion.outputs.push_back(macro == _macros.end() ? MacroState{name, false, Macro()} : MacroState{name, true, macro->second});
+		}
+		expansion.tokens = _tokens.copy(state.begin, _tokens.size());
+		expansions.push_back(std::move(expansion));
+	}
+
+	// everything needed from the file's tokens is in the buffer now. an included file might be included again
+	// though, so its tokens are kept for as long as loading it gives the same file
+	if (_files.size() == 1 || !_sources.is_cached(state.file)) {
+		file.discard_tokens();
+	}
+
+	_files.pop_back();
+	if (_files.size() == 1) {
+		_tokens.unpin();
+	}
+
+	return true;
+}
+
+bool Preprocessor::_repeat(const Expansion& expansion) {
+	for (auto& input : expansion.inputs) {
+		auto macro = _macros.find(input.name);
+		bool is_defined = (macro != _macros.end());
+		if (is_defined != input.is_defined || (is_defined && macro->second.text != input.macro.text)) {
+			return false;
+		}
+	}
+
+	for (auto file : expansion.included) {
+		if (_once.count(file)) {
+			return false;
+		}
+	}
+
+	// the files that include this one read and did the same things
+	for (auto& input : expansion.inputs) {
+		_macro(input.name);
+	}
+	for (size_t i = 1; i < _files.size(); ++i) {
+		_files[i].expansion.included.insert(expansion.included.begin(), expansion.included.end());
+	}
+	for (auto& output : expansion.outputs) {
+		if (output.is_defined) {
+			_define(output.name, output.macro);
+		} else {
+			_undefine(output.name);
+		}
+	}
+
+	_tokens.append(expansion.tokens);
+	return true;
+}
+
+const Preprocessor::Macro* Preprocessor::_macro(Symbol name) {
+	auto macro = _macros.find(name);
+	const Macro* value = (macro == _macros.end()) ? nullptr : &macro->second;
+
+	for (size_t i = 1; i < _files.size(); ++i) {
+		auto& state = _files[i];
+		if (state.touched.insert(name).second) {
+			state.expansion.inputs.push_back(value ? MacroState{name, true, *value} : MacroState{name, false, Macro()});
+		}
+	}
+
+	return value;
+}
+
+void Preprocessor::_define(Symbol name, const Macro& macro) {
+	for (size_t i = 1; i < _files.size(); ++i) {
+		_files[i].touched.insert(name);
+		_files[i].written.insert(name);
+	}
+	_macros[name] = macro;
+}
+
+void Preprocessor::_undefine(Symbol name) {
+	for (size_t i = 1; i < _files.size(); ++i) {
+		_files[i].touched.insert(name);
+		_files[i].written.insert(name);
+	}
+	_macros.erase(name);
+}
+
+bool Preprocessor::_step(size_t target) {
+	FileState& state = _files.back();
+	LexedFile& file = _sources.file(state.file);
+	const std::vector<TokenRange>& tokens = file.tokens();
+	const char* contents = file.contents();
+
+	if (state.position == tokens.size()) {
+		return _end_file();
+	}
+
+	bool is_skipping = !state.conditionals.empty() && !state.conditionals.back().is_active;
+
+	while (state.position < tokens.size() && _tokens.size() < target) {
+		const TokenRange& tok = tokens[state.position];
+
+		if ((tok.flags & TokenFlagLineFirst) && tok.kind == TokenKindHash) {
 			// directive
-			std::vector<TokenPtr> directive;
+			bool is_first = (state.position == 0);
+			std::vector<TokenRange> directive;
 
-			++it;
-			while (it != tokens.end() && !((*it)->flags() & TokenFlagLineFirst)) {
-				directive.push_back(*it);
-				++it;
+			++state.position;
+			while (state.position < tokens.size() && !(tokens[state.position].flags & TokenFlagLineFirst)) {
+				directive.push_back(tokens[state.position]);
+				++state.position;
 			}
-		
+
 			if (!directive.size()) {
+				if (is_skipping) {
+					return true;
+				}
 				printf("Preprocessing error: expected directive\n");
-				tok->print_pointer();
+				file.print_pointer(tok.location);
 				return false;
 			}
-		
-			if (directive[0]->value() == "include") {
-				// include directive
-				if (directive.size() < 2 || directive[1]->type() != TokenTypeStringLiteral) {
-					printf("Preprocessing error: expected string literal after include\n");
-					directive[0]->print_pointer();
-					return false;
-				}
-				
-				std::string filename = directive[1]->value().substr(1, directive[1]->value().size() - 2);
-				std::shared_ptr<LexedFile> file(new LexedFile(filename.c_str()));
-				
-				if (!file->lex(file) || !_process_tokens(file->tokens())) {
-					return false;
-				}
-			} else {
-				printf("Preprocessing error: unknown directive\n");
-				directive[0]->print_pointer();
-				return false;
+
+			// the directive might start another file, so this file's state can't be touched after it
+			return _directive(directive, is_first);
+		} else if (is_skipping) {
+			// skipped tokens never make it to the buffer
+			++state.position;
+		} else if (tok.type == TokenTypeStringLiteral) {
+			// transform / merge string literals, sizing the value for all of them up front
+			size_t last = state.position;
+			size_t size = 0;
+			for (; last < tokens.size() && tokens[last].type == TokenTypeStringLiteral; ++last) {
+				size += tokens[last].length;
 			}
-		} else if (tok->type() == TokenTypeStringLiteral) {
-			// transform / merge string literals
-			std::string value = "";
-			while (it != tokens.end()) {
-				TokenPtr str_tok = *it;
-				if (str_tok->type() != TokenTypeStringLiteral) {
-					break;
-				}
-				_read_string_value(str_tok, value);
-				++it;
+			std::string str;
+			str.reserve(size);
+			for (; state.position < last; ++state.position) {
+				_read_string_value(contents + tokens[state.position].location, tokens[state.position].length, str);
 			}
-			TokenPtr new_tok(new PPModifiedToken(tok, value));
-			_tokens.push_back(new_tok);
-		} else if (tok->type() == TokenTypeCharacterConstant) {
+			_tokens.push_back_literal(state.file, tok, str);
+		} else if (tok.type == TokenTypeCharacterConstant) {
 			// transform character constants
-			std::string value = "";
-			_read_string_value(tok, value);
-			TokenPtr new_tok(new PPModifiedToken(tok, value));
-			_tokens.push_back(new_tok);
-			++it;
-		} else {			
-			_tokens.push_back(tok);
-			++it;
+			std::string str;
+			_read_string_value(contents + tok.location, tok.length, str);
+			_tokens.push_back_literal(state.file, tok, str);
+			++state.position;
+		} else {
+			_tokens.push_back(state.file, tok);
+			++state.position;
 		}
 	}
 
 	return true;
 }
 
-char Preprocessor::_escape_character(char c) {
+bool Preprocessor::_directive(const std::vector<TokenRange>& directive, bool is_first) {
+	FileState& state = _files.back();
+	LexedFile& file = _sources.file(state.file);
+	const char* contents = file.contents();
+	auto& conditionals = state.conditionals;
+	bool is_skipping = !conditionals.empty() && !conditionals.back().is_active;
+
+	auto value = [&](const TokenRange& token) {
+		return std::string(contents + token.location, token.length);
+	};
+
+	std::string name = value(directive[0]);
+
+	if (name == "if" || name == "ifdef" || name == "ifndef") {
+		if (is_skipping) {
+			// none of the branches can be taken
+			conditionals.push_back(Conditional{false, true, false, directive[0].location});
+			return true;
+		}
+
+		bool condition = false;
+		if (name == "if") {
+			if (!_evaluate_condition(file, directive, &condition)) {
+				return false;
+			}
+		} else {
+			if (directive.size() != 2 || directive[1].type != TokenTypeIdentifier) {
+				printf("Preprocessing error: expected identifier after %s\n", name.c_str());
+				file.print_pointer(directive[0].location);
+				return false;
+			}
+			Symbol macro(contents + directive[1].location, directive[1].length);
+			condition = (_macro(macro) != nullptr) == (name == "ifdef");
+			if (is_first && name == "ifndef") {
+				state.guard_candidate = macro;
+			}
+		}
+
+		conditionals.push_back(Conditional{condition, condition, false, directive[0].location});
+	} else if (name == "elif" || name == "else") {
+		if (conditionals.empty() || conditionals.back().has_else) {
+			printf("Preprocessing error: #%s %s\n", name.c_str(), conditionals.empty() ? "without #if" : "after #else");
+			file.print_pointer(directive[0].location);
+			return false;
+		}
+
+		Conditional& conditional = conditionals.back();
+		if (conditional.was_taken) {
+			conditional.is_active = false;
+		} else if (name == "else") {
+			conditional.is_active = conditional.was_taken = true;
+		} else {
+			bool condition = false;
+			if (!_evaluate_condition(file, directive, &condition)) {
+				return false;
+			}
+			conditional.is_active = conditional.was_taken = condition;
+		}
+
+		conditional.has_else = (name == "else");
+		if (conditionals.size() == 1) {
+			state.guard_candidate = Symbol();
+		}
+	} else if (name == "endif") {
+		if (conditionals.empty()) {
+			printf("Preprocessing error: #endif without #if\n");
+			file.print_pointer(directive[0].location);
+			return false;
+		}
+
+		conditionals.pop_back();
+		if (conditionals.empty() && !state.guard_candidate.empty()) {
+			if (state.position == file.tokens().size()) {
+				_guards[state.file] = state.guard_candidate;
+			}
+			state.guard_candidate = Symbol();
+		}
+	} else if (is_skipping) {
+		// anything else in a skipped branch is ignored, even if it isn't a directive
+	} else if (name == "define") {
+		if (directive.size() < 2 || directive[1].type != TokenTypeIdentifier) {
+			printf("Preprocessing error: expected identifier after define\n");
+			file.print_pointer(directive[0].location);
+			return false;
+		}
+
+		if (directive.size() > 2 && directive[2].kind == TokenKindOpenParen &&
+			directive[2].location == directive[1].location + directive[1].length) {
+			printf("Preprocessing error: function-like macros aren't supported\n");
+			file.print_pointer(directive[2].location);
+			return false;
+		}
+
+		Macro macro;
+		if (directive.size() > 2) {
+			uint32_t offset = directive[2].location;
+			macro.text = std::string(contents + offset, directive.back().location + directive.back().length - offset);
+			for (size_t i = 2; i < directive.size(); ++i) {
+				macro.tokens.push_back(directive[i]);
+				macro.tokens.back().location -= offset;
+			}
+		}
+
+		_define(Symbol(contents + directive[1].location, directive[1].length), macro);
+	} else if (name == "undef") {
+		if (directive.size() != 2 || directive[1].type != TokenTypeIdentifier) {
+			printf("Preprocessing error: expected identifier after undef\n");
+			file.print_pointer(directive[0].location);
+			return false;
+		}
+
+		_undefine(Symbol(contents + directive[1].location, directive[1].length));
+	} else if (name == "include") {
+		// include directive
+		if (directive.size() < 2 || directive[1].type != TokenTypeStringLiteral) {
+			printf("Preprocessing error: expected string literal after include\n");
+			file.print_pointer(directive[0].location);
+			return false;
+		}
+		
+		std::string name = value(directive[1]).substr(1, directive[1].length - 2);
+		std::string filename;
+
+		if (!_sources.find_include(name, &filename)) {
+			printf("Preprocessing error: unable to find included file \"%s\"\n", name.c_str());
+			file.print_pointer(directive[1].location);
+			return false;
+		}
+		
+		return _begin_file(filename.c_str());
+	} else if (name == "pragma") {
+		// unknown pragmas are ignored
+		if (directive.size() > 1 && value(directive[1]) == "once") {
+			_once.insert(state.file);
+		}
+	} else {
+		printf("Preprocessing error: unknown directive\n");
+		file.print_pointer(directive[0].location);
+		return false;
+	}
+
+	return true;
+}
+
+const char* Preprocessor::_read_escape_sequence(const char* it, const char* end, std::string& value) {
+	char c = *it++;
+
+	if (c >= '0' && c <= '7') {
+		// up to three octal digits
+		unsigned code = c - '0';
+		for (int i = 0; i < 2 && it < end && *it >= '0' && *it <= '7'; ++i) {
+			code = code * 8 + (*it++ - '0');
+		}
+		value += (char)code;
+		return it;
+	}
+
 	switch (c) {
+		case 'x': {
+			// any number of hex digits, truncated to a byte like C does
+			const char* digits = it;
+			unsigned code = 0;
+			for (; it < end && isxdigit((unsigned char)*it); ++it) {
+				code = code * 16 + (isdigit((unsigned char)*it) ? *it - '0' : (tolower((unsigned char)*it) - 'a' + 10));
+			}
+			value += (it == digits) ? 'x' : (char)code;
+			return it;
+		}
 		case 'r':
-			return '\r';
+			value += '\r';
+			break;
 		case 'n':
-			return '\n';
+			value += '\n';
+			break;
 		case 'v':
-			return '\v';
+			value += '\v';
+			break;
 		case 'b':
-			return '\b';
+			value += '\b';
+			break;
 		case 'f':
-			return '\f';
+			value += '\f';
+			break;
 		case 'a':
-			return '\a';
+			value += '\a';
+			break;
 		case 't':
-			return '\t';
-		case '0':
-			return '\0';
+			value += '\t';
+			break;
 		default:
-			return c;
-	}	
-}
-
-void Preprocessor::_read_string_value(TokenPtr token, std::string& value) {
-	bool escape = false;
-	for (size_t i = 1; i < token->value().size() - 1; ++i) { // skip beginning and end characters
-		// TODO: support octal / hex numbers
-		char c = token->value()[i];
-		if (escape) {
-			value += _escape_character(c);
-			escape = false;
-		} else if (c == '\\') {
-			escape = true;
-		} else {
 			value += c;
+			break;
+	}
+
+	return it;
+}
+
+void Preprocessor::_read_string_value(const char* text, size_t size, std::string& value) {
+	if (size < 2) {
+		return;
+	}
+
+	// skip beginning and end characters
+	const char* it = text + 1;
+	const char* end = text + size - 1;
+
+	// copy everything between escape sequences in one go
+	while (it < end) {
+		auto backslash = (const char*)memchr(it, '\\', end - it);
+		if (!backslash) {
+			value.append(it, end - it);
+			break;
+		}
+		value.append(it, backslash - it);
+		it = backslash + 1;
+		if (it < end) {
+			it = _read_escape_sequence(it, end, value);
 		}
 	}
-}
\ No newline at end of file
+}
@@ -1,38 +1,181 @@
 #pragma once
 
 #include "Token.h"
-#include "LexedFile.h"
+#include "TokenKind.h"
+#include "SourceManager.h"
+#include "TokenBuffer.h"
 
-class Preprocessor {
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+* Produces the tokens of a file and everything it includes. Nothing is done until the tokens are read, and then only
+* far enough ahead to keep the reader busy.
+*/
+class Preprocessor : public TokenProducer {
 	public:
 
-		Preprocessor();
+		/**
+		* Files are loaded into `sources`, which must outlive the tokens.
+		*/
+		Preprocessor(SourceManager& sources);
 
+		/**
+		* Loads the file whose tokens are to be produced. Errors found while producing them are printed as they're
+		* found, and end the tokens early.
+		*/
 		bool process_file(const char* filename);
+
+		/**
+		* Whether producing the tokens failed.
+		*/
+		bool failed() const { return _failed; }
+
+		/**
+		* The files that have been loaded so far, including the ones that didn't add any tokens.
+		*/
+		const std::vector<uint32_t>& files() const { return _loaded_files; }
+
+		/**
+		* Defines a macro from the command line, given as "name" or "name=value". A name alone is defined as 1. Must be
+		* called before any files are processed. Errors are printed.
+		*/
+		bool define(const std::string& definition);
 		
-		const std::list<TokenPtr>& tokens();
+		TokenBuffer& tokens();
+
+		virtual bool produce() override;
 
 	private:
-		template <class T>
-		bool _process_tokens(T& tokens);
+		/**
+		* An object-like macro. Macros are only expanded in conditions, so the replacement is kept as its own text
+		* rather than as tokens of a file.
+		*/
+		struct Macro {
+			std::string text;
+			std::vector<TokenRange> tokens; // locations are offsets into the text
+		};
+
+		/**
+		* A macro's value at some point, or that it wasn't defined.
+		*/
+		struct MacroState {
+			Symbol name;
+			bool is_defined;
+			Macro macro;
+		};
+
+		/**
+		* What processing an included file, along with everything it included, read from the preprocessor's state and
+		* did to it. Including the file again anywhere everything it read is the same can just repeat the result.
+		*/
+		struct Expansion {
+			std::vector<MacroState> inputs;        // macros it tested or expanded before defining them itself
+			std::unordered_set<uint32_t> included; // files it processed, which "#pragma once" might skip next time
+			std::vector<MacroState> outputs;       // macros it defined or undefined, as they were at its end
+			TokenRun tokens;
+		};
+
+		struct Conditional {
+			bool is_active;    // whether the current branch's tokens are kept
+			bool was_taken;    // whether any branch so far has been kept, or none of them can be
+			bool has_else;
+			uint32_t location;
+		};
+
+		/**
+		* A file that's being processed. Files are processed a token or directive at a time, so all of this has to be
+		* kept between steps.
+		*/
+		struct FileState {
+			uint32_t file;
+			size_t position;                          // index of the file's next token
+			size_t begin;                             // where the file's tokens start in the buffer
+			std::vector<Conditional> conditionals;
+
+			// a leading #ifndef might be an include guard, in which case the macro it tests is remembered here until
+			// its #endif turns out to be the end of the file
+			Symbol guard_candidate;
+
+			// what an included file has read and done so far. macros it has already read or written aren't inputs
+			// when they're read again
+			Expansion expansion;
+			std::unordered_set<Symbol> touched;
+			std::unordered_set<Symbol> written;
+		};
+
+		std::vector<FileState> _files;
+		bool _failed = false;
+
+		std::vector<uint32_t> _loaded_files;
+
+		/**
+		* Starts processing a file, or copies its tokens if that's all it would do.
+		*/
+		bool _begin_file(const char* filename);
+
+		/**
+		* Processes the current file's tokens up to its next directive, or until the buffer has `target` tokens, or
+		* finishes the file if there aren't any left.
+		*/
+		bool _step(size_t target);
+
+		bool _end_file();
+
+		/**
+		* Repeats an earlier expansion of a file if everything it read is the same now.
+		*/
+		bool _repeat(const Expansion& expansion);
+
+		/**
+		* Looks up a macro, which is an input of each included file being processed that hasn't touched it yet.
+		*/
+		const Macro* _macro(Symbol name);
+
+		/**
+		* Defines or undefines a macro, which is an output of each included file being processed.
+		*/
+		void _define(Symbol name, const Macro& macro);
+		void _undefine(Symbol name);
+
+		/**
+		* Processes a directive, given as the tokens after the "#".
+		*/
+		bool _directive(const std::vector<TokenRange>& directive, bool is_first);
+
+		/**
+		* Evaluates the condition of an #if or #elif. Macros are expanded and `defined` is applied first, and any
+		* identifiers left over are 0. Errors are printed.
+		*/
+		bool _evaluate_condition(LexedFile& file, const std::vector<TokenRange>& directive, bool* result);
 		
-		char _escape_character(char c);
-		void _read_string_value(TokenPtr token, std::string& value);
-	
-		std::list<TokenPtr> _tokens;
-};
+		/**
+		* Decodes the escape sequence after a backslash, appending it to `value`, and returns where it ends.
+		*/
+		const char* _read_escape_sequence(const char* it, const char* end, std::string& value);
 
-class PPModifiedToken : public Token {
-	public:
-		PPModifiedToken(TokenPtr base, const std::string& value) : _base(base), _value(value) {}
+		/**
+		* Appends the decoded value of a string literal or character constant to `value`.
+		*/
+		void _read_string_value(const char* text, size_t size, std::string& value);
 	
-		virtual TokenType type() { return _base->type(); };
-		virtual uint32_t flags() { return _base->flags(); };
-		virtual const std::string value() { return _value; };
-		virtual void print_pointer() { return _base->print_pointer(); }
+		SourceManager& _sources;
+		TokenBuffer _tokens;
 
-		virtual ~PPModifiedToken() {}
-	private:
-		TokenPtr _base;
-		std::string _value;
+		// each included file's expansions in the states it's been included in so far, so later includes don't have to
+		// process it again
+		std::unordered_map<uint32_t, std::vector<Expansion>> _expansions;
+
+		std::unordered_map<Symbol, Macro> _macros;
+
+		// files wrapped in "#ifndef X" ... "#endif", with the X that guards them
+		std::unordered_map<uint32_t, Symbol> _guards;
+
+		// files that have "#pragma once"
+		std::unordered_set<uint32_t> _once;
+
+		// files that are currently being processed, for catching recursive includes
+		std::unordered_set<uint32_t> _active;
 };
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+* A bounded queue for handing values from one thread to another without locks. Only one thread may push and only
+* one thread may pop.
+*/
+template <class T>
+class SPSCQueue {
+	public:
+		/**
+		* `capacity` must be a power of two.
+		*/
+		explicit SPSCQueue(size_t capacity) : _slots(capacity), _mask(capacity - 1) {}
+
+		/**
+		* Pushes a value if there's room. `value` is only moved from if it's pushed.
+		*/
+		bool try_push(T&& value) {
+			size_t tail = _tail.load(std::memory_order_relaxed);
+			if (tail - _cached_head == _slots.size()) {
+				_cached_head = _head.load(std::memory_order_acquire);
+				if (tail - _cached_head == _slots.size()) {
+					return false;
+				}
+			}
+			_slots[tail & _mask] = std::move(value);
+			_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		* Pops a value if there is one.
+		*/
+		bool try_pop(T& value) {
+			size_t head = _head.load(std::memory_order_relaxed);
+			if (head == _cached_tail) {
+				_cached_tail = _tail.load(std::memory_order_acquire);
+				if (head == _cached_tail) {
+					return false;
+				}
+			}
+			value = std::move(_slots[head & _mask]);
+			_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		* Pushes a value, waiting for room. Gives up and returns false if `is_cancelled` becomes true first.
+		*/
+		bool push(T&& value, const std::atomic<bool>* is_cancelled = nullptr) {
+			for (unsigned attempts = 0; !try_push(std::move(value)); ++attempts) {
+				if (is_cancelled && is_cancelled->load(std::memory_order_relaxed)) {
+					return false;
+				}
+				_Wait(attempts);
+			}
+			return true;
+		}
+
+		/**
+		* Pops a value, waiting for one.
+		*/
+		void pop(T& value) {
+			for (unsigned attempts = 0; !try_pop(value); ++attempts) {
+				_Wait(attempts);
+			}
+		}
+
+	private:
+		SPSCQueue(const SPSCQueue& other) = delete;
+		SPSCQueue& operator=(const SPSCQueue& other) = delete;
+
+		/**
+		* Yields, then sleeps, so that a stage that's far ahead of the other doesn't burn a core.
+		*/
+		static void _Wait(unsigned attempts) {
+			if (attempts < 64) {
+				std::this_thread::yield();
+			} else {
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		}
+
+		std::vector<T> _slots;
+		const size_t _mask;
+
+		// the head is written by the consumer and the tail by the producer, so they're kept on separate cache lines.
+		// each side keeps a copy of the other's index so it only has to read it when the queue looks full or empty
+		alignas(64) std::atomic<size_t> _head{0};
+		size_t _cached_tail = 0;
+		alignas(64) std::atomic<size_t> _tail{0};
+		size_t _cached_head = 0;
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+* A position in one of a source manager's files. Symbols and diagnostics hold these instead of tokens so that
+* token buffers can be freed as soon as they've been parsed.
+*/
+struct SourceLocation {
+	SourceLocation() : file(UINT32_MAX), offset(0) {}
+	SourceLocation(uint32_t file, uint32_t offset) : file(file), offset(offset) {}
+
+	bool is_valid() const { return file != UINT32_MAX; }
+
+	uint32_t file;
+	uint32_t offset;
+};
@@ -0,0 +1,198 @@
+#include "SourceManager.h"
+#include "DependencyScanner.h"
+#include "ThreadPool.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/stat.h>
+
+SourceManager::SourceManager() {
+	_module_paths.push_back("modules");
+}
+
+SourceManager::~SourceManager() {
+	// prefetches refer back to the manager, so they have to finish first
+	while (true) {
+		std::future<std::unique_ptr<LexedFile>> prefetch;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_prefetches.empty()) {
+				break;
+			}
+			prefetch = std::move(_prefetches.begin()->second);
+			_prefetches.erase(_prefetches.begin());
+		}
+		ThreadPool::Shared().wait(prefetch);
+	}
+}
+
+bool SourceManager::load(const char* filename, uint32_t* id) {
+	// standard input and anything that can't be resolved are never cached
+	std::string path;
+	struct stat st;
+
+	if (strcmp(filename, "-") && !stat(filename, &st) && S_ISREG(st.st_mode)) {
+		if (char* resolved = realpath(filename, nullptr)) {
+			path = resolved;
+			free(resolved);
+		}
+	}
+
+	std::future<std::unique_ptr<LexedFile>> prefetch;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _prefetches.find(filename);
+		if (it != _prefetches.end()) {
+			prefetch = std::move(it->second);
+			_prefetches.erase(it);
+		}
+	}
+
+	if (!path.empty()) {
+		std::unique_lock<std::mutex> lock(_files_mutex);
+		auto it = _cache.find(path);
+		if (it != _cache.end() && it->second.mtime == st.st_mtime && it->second.size == st.st_size) {
+			*id = it->second.id;
+			lock.unlock();
+			if (prefetch.valid()) {
+				// loaded under another name in the meantime
+				ThreadPool::Shared().wait(prefetch);
+			}
+			return true;
+		}
+	}
+
+	// if the prefetch failed, it already printed the error
+	auto file = prefetch.valid() ? ThreadPool::Shared().wait(prefetch) : _lex(filename);
+
+	if (!file) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(_files_mutex);
+
+	_files.push_back(std::move(file));
+	_paths.push_back(path);
+	*id = _files.size() - 1;
+
+	if (!path.empty()) {
+		CachedFile& cached = _cache[path];
+		cached.id = *id;
+		cached.mtime = st.st_mtime;
+		cached.size = st.st_size;
+	}
+
+	return true;
+}
+
+LexedFile& SourceManager::file(uint32_t id) {
+	std::lock_guard<std::mutex> lock(_files_mutex);
+	return *_files[id];
+}
+
+bool SourceManager::is_cached(uint32_t id) {
+	std::lock_guard<std::mutex> lock(_files_mutex);
+	if (_paths[id].empty()) {
+		return false;
+	}
+	auto it = _cache.find(_paths[id]);
+	return it != _cache.end() && it->second.id == id;
+}
+
+void SourceManager::prefetch(const std::string& filename) {
+	if (!_file_system.is_file(filename)) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_prefetched.insert(filename).second) {
+		_prefetches[filename] = ThreadPool::Shared().submit([this, filename]() {
+			return _lex(filename);
+		});
+	}
+}
+
+std::unique_ptr<LexedFile> SourceManager::_lex(const std::string& filename) {
+	std::unique_ptr<LexedFile> file(new LexedFile(filename.c_str()));
+
+	if (!file->lex()) {
+		return nullptr;
+	}
+
+	std::vector<std::string> includes;
+	std::vector<std::string> imports;
+	scan_dependencies(*file, includes, imports);
+
+	std::string path;
+
+	for (auto& name : includes) {
+		if (find_include(name, &path)) {
+			prefetch(path);
+		}
+	}
+
+	for (auto& name : imports) {
+		if (find_module(name, &path)) {
+			prefetch(path);
+		}
+	}
+
+	return file;
+}
+
+void SourceManager::add_include_path(const std::string& directory) {
+	_include_paths.push_back(directory);
+}
+
+void SourceManager::add_module_path(const std::string& directory) {
+	// "modules" stays last
+	_module_paths.insert(_module_paths.end() - 1, directory);
+}
+
+bool SourceManager::find_include(const std::string& name, std::string* path) {
+	if (_file_system.is_file(name)) {
+		*path = name;
+		return true;
+	}
+
+	if (name.empty() || name[0] == '/') {
+		return false;
+	}
+
+	for (auto& directory : _include_paths) {
+		auto candidate = directory + '/' + name;
+		if (_file_system.is_file(candidate)) {
+			*path = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool SourceManager::find_module(const std::string& name, std::string* path) {
+	for (auto& directory : _module_paths) {
+		auto candidate = directory + '/' + name + '/' + name + ".c3";
+		if (_file_system.is_file(candidate)) {
+			*path = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::string SourceManager::location_string(SourceLocation location) {
+	if (!location.is_valid()) {
+		return std::string();
+	}
+	return file(location.file).location_string(location.offset);
+}
+
+void SourceManager::print_pointer(SourceLocation location) {
+	if (location.is_valid()) {
+		file(location.file).print_pointer(location.offset);
+	}
+}
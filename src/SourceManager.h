@@ -0,0 +1,118 @@
+#pragma once
+
+#include "FileSystemCache.h"
+#include "LexedFile.h"
+#include "SourceLocation.h"
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/types.h>
+
+/**
+* Owns every file loaded during a compilation so that locations can be resolved for as long as the compilation
+* needs them. Thread-safe, apart from adding search paths.
+*/
+class SourceManager {
+	public:
+		SourceManager();
+		~SourceManager();
+
+		/**
+		* Loads and lexes a file, setting `id` to its index. Files are cached by canonical path, so loading one that's
+		* already loaded and hasn't changed since gives the same id without reading or lexing it again. Errors are
+		* printed.
+		*
+		* A cached file's tokens might have been discarded, so anything that reads them should bracket its use with
+		* LexedFile::restore_tokens() and LexedFile::discard_tokens().
+		*
+		* Whatever the file includes or imports is prefetched.
+		*/
+		bool load(const char* filename, uint32_t* id);
+
+		/**
+		* Starts loading a file on the shared thread pool, and then whatever it includes or imports, so that load()
+		* finds them ready. Files that don't exist are skipped without an error since they might never be loaded.
+		*/
+		void prefetch(const std::string& filename);
+
+		/**
+		* Adds a directory to search for included files that aren't found relative to the working directory.
+		* Directories are searched in the order they're added. Search paths must be added before anything is loaded.
+		*/
+		void add_include_path(const std::string& directory);
+
+		/**
+		* Adds a directory to search for modules, which are found at "directory/name/name.c3". Directories are searched
+		* in the order they're added, followed by "modules". Search paths must be added before anything is loaded.
+		*/
+		void add_module_path(const std::string& directory);
+
+		const std::vector<std::string>& include_paths() const { return _include_paths; }
+
+		/**
+		* Finds the file that `#include "name"` refers to.
+		*/
+		bool find_include(const std::string& name, std::string* path);
+
+		/**
+		* Finds the file that `import name` refers to.
+		*/
+		bool find_module(const std::string& name, std::string* path);
+
+		LexedFile& file(uint32_t id);
+
+		/**
+		* Whether loading the file again would give the same id.
+		*/
+		bool is_cached(uint32_t id);
+
+		/**
+		* Returns "file:line:column", or an empty string for invalid locations.
+		*/
+		std::string location_string(SourceLocation location);
+
+		/**
+		* Prints the line containing `location` with a caret under it.
+		*/
+		void print_pointer(SourceLocation location);
+
+	private:
+		SourceManager(const SourceManager& other) = delete;
+		SourceManager& operator=(const SourceManager& other) = delete;
+
+		// guards the files and the cache
+		std::mutex _files_mutex;
+
+		std::vector<std::unique_ptr<LexedFile>> _files;
+
+		struct CachedFile {
+			uint32_t id;
+			time_t mtime;
+			off_t size;
+		};
+
+		std::unordered_map<std::string, CachedFile> _cache;
+
+		// each file's canonical path, or an empty string if it isn't cached
+		std::vector<std::string> _paths;
+
+		std::vector<std::string> _include_paths;
+		std::vector<std::string> _module_paths;
+		FileSystemCache _file_system;
+
+		/**
+		* Lexes a file and prefetches its dependencies. Returns nullptr if it couldn't be lexed.
+		*/
+		std::unique_ptr<LexedFile> _lex(const std::string& filename);
+
+		// guards the prefetches, which are started from the pool's threads as well
+		std::mutex _mutex;
+		std::unordered_map<std::string, std::future<std::unique_ptr<LexedFile>>> _prefetches;
+		std::unordered_set<std::string> _prefetched;
+};
@@ -0,0 +1,139 @@
+#include "Symbol.h"
+
+#include "Hash.h"
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+	inline size_t pair_hash(const std::string* a, const std::string* b) {
+		uint64_t hash = (uint64_t)(uintptr_t)a * 0x9e3779b97f4a7c15ULL ^ (uint64_t)(uintptr_t)b * 0xc2b2ae3d27d4eb4fULL;
+		return (size_t)(hash ^ (hash >> 32));
+	}
+
+	/**
+	* Open addressing tables of every interned string and every concatenation made so far. Lookups go straight
+	* from the characters to the slot without building a std::string. The strings are never moved or freed, so
+	* symbols can read them without holding the lock.
+	*/
+	struct SymbolTable {
+		SymbolTable() : strings(1024), concatenations(1024) {
+			empty = intern("", 0);
+		}
+
+		const std::string* intern(const char* str, size_t length) {
+			auto hash = (size_t)hash_bytes(str, length);
+			auto mask = strings.size() - 1;
+
+			for (auto i = hash & mask;; i = (i + 1) & mask) {
+				auto& slot = strings[i];
+				if (!slot.string) {
+					slot.hash = hash;
+					slot.string = new std::string(str, length);
+					auto ret = slot.string;
+					if (++string_count * 2 > strings.size()) {
+						grow_strings();
+					}
+					return ret;
+				}
+				if (slot.hash == hash && slot.string->size() == length && !memcmp(slot.string->data(), str, length)) {
+					return slot.string;
+				}
+			}
+		}
+
+		const std::string* concat(const std::string* prefix, const std::string* suffix) {
+			auto mask = concatenations.size() - 1;
+
+			for (auto i = pair_hash(prefix, suffix) & mask;; i = (i + 1) & mask) {
+				auto& slot = concatenations[i];
+				if (!slot.result) {
+					auto str = *prefix + *suffix;
+					slot.prefix = prefix;
+					slot.suffix = suffix;
+					slot.result = intern(str.data(), str.size());
+					auto ret = slot.result;
+					if (++concatenation_count * 2 > concatenations.size()) {
+						grow_concatenations();
+					}
+					return ret;
+				}
+				if (slot.prefix == prefix && slot.suffix == suffix) {
+					return slot.result;
+				}
+			}
+		}
+
+		struct StringSlot {
+			size_t hash = 0;
+			const std::string* string = nullptr;
+		};
+
+		struct ConcatenationSlot {
+			const std::string* prefix = nullptr;
+			const std::string* suffix = nullptr;
+			const std::string* result = nullptr;
+		};
+
+		std::mutex mutex;
+		std::vector<StringSlot> strings;
+		size_t string_count = 0;
+		std::vector<ConcatenationSlot> concatenations;
+		size_t concatenation_count = 0;
+		const std::string* empty = nullptr;
+
+		void grow_strings() {
+			std::vector<StringSlot> old(strings.size() * 2);
+			old.swap(strings);
+			auto mask = strings.size() - 1;
+			for (auto& slot : old) {
+				if (slot.string) {
+					auto i = slot.hash & mask;
+					while (strings[i].string) {
+						i = (i + 1) & mask;
+					}
+					strings[i] = slot;
+				}
+			}
+		}
+
+		void grow_concatenations() {
+			std::vector<ConcatenationSlot> old(concatenations.size() * 2);
+			old.swap(concatenations);
+			auto mask = concatenations.size() - 1;
+			for (auto& slot : old) {
+				if (slot.result) {
+					auto i = pair_hash(slot.prefix, slot.suffix) & mask;
+					while (concatenations[i].result) {
+						i = (i + 1) & mask;
+					}
+					concatenations[i] = slot;
+				}
+			}
+		}
+	};
+
+	SymbolTable& table() {
+		// symbols can outlive anything with static storage, so the table is never destroyed
+		static SymbolTable* table = new SymbolTable();
+		return *table;
+	}
+}
+
+Symbol::Symbol() : _string(table().empty) {}
+
+Symbol::Symbol(const std::string& str) : Symbol(str.data(), str.size()) {}
+
+Symbol::Symbol(const char* str, size_t length) {
+	auto& t = table();
+	std::lock_guard<std::mutex> lock(t.mutex);
+	_string = t.intern(str, length);
+}
+
+Symbol Symbol::_Concat(Symbol prefix, Symbol suffix) {
+	auto& t = table();
+	std::lock_guard<std::mutex> lock(t.mutex);
+	return Symbol(t.concat(prefix._string, suffix._string));
+}
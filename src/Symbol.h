@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+/**
+* An interned string. Every distinct string is stored once for the life of the program, so symbols are as cheap
+* to copy, compare, and hash as pointers. Interning is thread-safe.
+*/
+class Symbol {
+	public:
+		/**
+		* The empty symbol.
+		*/
+		Symbol();
+
+		explicit Symbol(const std::string& str);
+		Symbol(const char* str, size_t length);
+
+		const std::string& str() const { return *_string; }
+		const char* c_str() const { return _string->c_str(); }
+		size_t size() const { return _string->size(); }
+		bool empty() const { return _string->empty(); }
+
+		bool operator==(Symbol other) const { return _string == other._string; }
+		bool operator!=(Symbol other) const { return _string != other._string; }
+
+		/**
+		* Returns the symbol for `prefix` followed by `suffix`. Results are remembered, so qualifying a name that's
+		* been qualified before doesn't look at any characters.
+		*/
+		static Symbol Concat(Symbol prefix, Symbol suffix) {
+			return prefix.empty() ? suffix : suffix.empty() ? prefix : _Concat(prefix, suffix);
+		}
+
+	private:
+		explicit Symbol(const std::string* string) : _string(string) {}
+
+		static Symbol _Concat(Symbol prefix, Symbol suffix);
+
+		const std::string* _string;
+
+		friend struct std::hash<Symbol>;
+};
+
+namespace std {
+	template <> struct hash<Symbol> {
+		size_t operator()(Symbol symbol) const { return std::hash<const std::string*>()(symbol._string); }
+	};
+}
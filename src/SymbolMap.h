@@ -0,0 +1,184 @@
+#pragma once
+
+#include "Symbol.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+* An open addressing hash map keyed by symbols. Since symbols hash and compare as pointers, a lookup is usually a
+* single probe, and it never allocates. Keys can't be empty, and entries can't be removed individually.
+*
+* One thread can insert while any number of others look things up, without locking. Values are never changed or
+* moved once they're inserted; inserting a key again publishes a new value in its place, and the old one stays
+* where it is until the map is cleared. Likewise, the tables outgrown by the map are kept until then, so that
+* lookups already probing them can finish.
+*/
+template <class T>
+class SymbolMap {
+	public:
+		SymbolMap() = default;
+		SymbolMap(const SymbolMap&) = delete;
+		SymbolMap& operator=(const SymbolMap&) = delete;
+
+		/**
+		* Returns the value for `key`, or nullptr if there isn't one.
+		*/
+		T* find(Symbol key) {
+			auto table = _table.load(std::memory_order_acquire);
+			if (!table) {
+				return nullptr;
+			}
+
+			auto mask = table->size - 1;
+
+			for (auto i = _Hash(key) & mask;; i = (i + 1) & mask) {
+				auto& slot = table->slots[i];
+				auto slot_key = slot.key.load(std::memory_order_acquire);
+				if (slot_key == key) {
+					return slot.value.load(std::memory_order_acquire);
+				}
+				if (slot_key.empty()) {
+					return nullptr;
+				}
+			}
+		}
+
+		const T* find(Symbol key) const {
+			return const_cast<SymbolMap*>(this)->find(key);
+		}
+
+		bool count(Symbol key) const {
+			return find(key) != nullptr;
+		}
+
+		/**
+		* Makes `value` the value for `key`, replacing the current one if there is one, and returns it.
+		*/
+		T& insert(Symbol key, T value) {
+			_values.push_back(std::move(value));
+			auto published = &_values.back();
+
+			auto table = _table.load(std::memory_order_relaxed);
+			if (!table || (_count + 1) * 2 > table->size) {
+				table = _grow();
+			}
+
+			auto mask = table->size - 1;
+
+			for (auto i = _Hash(key) & mask;; i = (i + 1) & mask) {
+				auto& slot = table->slots[i];
+				auto slot_key = slot.key.load(std::memory_order_relaxed);
+				if (slot_key == key) {
+					slot.value.store(published, std::memory_order_release);
+					return *published;
+				}
+				if (slot_key.empty()) {
+					// the value has to be there before the key can be found
+					slot.value.store(published, std::memory_order_release);
+					slot.key.store(key, std::memory_order_release);
+					++_count;
+					return *published;
+				}
+			}
+		}
+
+		size_t size() const { return _count; }
+
+		/**
+		* Calls `f` with each key and value, in no particular order.
+		*/
+		template <class F>
+		void for_each(F f) {
+			auto table = _table.load(std::memory_order_relaxed);
+			if (!table) {
+				return;
+			}
+			for (size_t i = 0; i < table->size; ++i) {
+				auto& slot = table->slots[i];
+				auto key = slot.key.load(std::memory_order_relaxed);
+				if (!key.empty()) {
+					f(key, *slot.value.load(std::memory_order_relaxed));
+				}
+			}
+		}
+
+		/**
+		* Removes everything, keeping the current table for reuse. Nothing can be looking anything up meanwhile.
+		*/
+		void clear() {
+			if (!_count) {
+				return;
+			}
+
+			auto table = _table.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < table->size; ++i) {
+				table->slots[i].key.store(Symbol(), std::memory_order_relaxed);
+				table->slots[i].value.store(nullptr, std::memory_order_relaxed);
+			}
+
+			_tables.erase(_tables.begin(), _tables.end() - 1);
+			_values.clear();
+			_count = 0;
+		}
+
+	private:
+		struct Slot {
+			std::atomic<Symbol> key{Symbol()};
+			std::atomic<T*> value{nullptr};
+		};
+
+		struct Table {
+			explicit Table(size_t size) : size(size), slots(new Slot[size]) {}
+
+			size_t size;
+			std::unique_ptr<Slot[]> slots;
+		};
+
+		std::atomic<Table*> _table{nullptr};
+
+		// every table the map has had, the current one last
+		std::vector<std::unique_ptr<Table>> _tables;
+
+		// every value the map has had, in a deque so that they stay put
+		std::deque<T> _values;
+
+		size_t _count = 0;
+
+		static size_t _Hash(Symbol key) {
+			// symbols are aligned pointers, so the low bits need mixing in from the high ones
+			uint64_t hash = (uint64_t)std::hash<Symbol>()(key) * 0x9e3779b97f4a7c15ULL;
+			return (size_t)(hash ^ (hash >> 32));
+		}
+
+		Table* _grow() {
+			auto old = _table.load(std::memory_order_relaxed);
+			_tables.emplace_back(new Table(old ? old->size * 2 : 8));
+			auto table = _tables.back().get();
+
+			if (old) {
+				auto mask = table->size - 1;
+
+				for (size_t i = 0; i < old->size; ++i) {
+					auto key = old->slots[i].key.load(std::memory_order_relaxed);
+					if (!key.empty()) {
+						auto j = _Hash(key) & mask;
+						while (!table->slots[j].key.load(std::memory_order_relaxed).empty()) {
+							j = (j + 1) & mask;
+						}
+						table->slots[j].key.store(key, std::memory_order_relaxed);
+						table->slots[j].value.store(old->slots[i].value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+					}
+				}
+			}
+
+			// the old table's left as it is for anyone still probing it
+			_table.store(table, std::memory_order_release);
+			return table;
+		}
+};
@@ -0,0 +1,53 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) {
+	for (size_t i = 0; i < threads; ++i) {
+		_workers.emplace_back([this]() {
+			while (true) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_condition.wait(lock, [this]() { return _is_stopping || !_tasks.empty(); });
+					if (_tasks.empty()) {
+						return;
+					}
+					task = std::move(_tasks.front());
+					_tasks.pop();
+				}
+				task();
+			}
+		});
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_is_stopping = true;
+	}
+	_condition.notify_all();
+	for (auto& worker : _workers) {
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::Shared() {
+	static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u));
+	return pool;
+}
+
+bool ThreadPool::_run_one() {
+	std::function<void()> task;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_tasks.empty()) {
+			return false;
+		}
+		task = std::move(_tasks.front());
+		_tasks.pop();
+	}
+	task();
+	return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+* A fixed set of worker threads that run submitted tasks in the order they were submitted.
+*/
+class ThreadPool {
+	public:
+		ThreadPool(size_t threads);
+		~ThreadPool();
+
+		size_t size() const { return _workers.size(); }
+
+		template <class F>
+		std::future<typename std::result_of<F()>::type> submit(F&& f) {
+			typedef typename std::result_of<F()>::type Result;
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+			auto future = task->get_future();
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_tasks.push([task]() { (*task)(); });
+			}
+			_condition.notify_one();
+			return future;
+		}
+
+		/**
+		* Waits for `future`, running queued tasks in the meantime. Tasks that wait on other tasks should use this
+		* instead of waiting on the future directly so that they can't deadlock the pool.
+		*/
+		template <class T>
+		T wait(std::future<T>& future) {
+			while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				if (!_run_one()) {
+					future.wait();
+				}
+			}
+			return future.get();
+		}
+
+		/**
+		* The pool used by the compiler, with one thread per core.
+		*/
+		static ThreadPool& Shared();
+
+	private:
+		ThreadPool(const ThreadPool& other) = delete;
+		ThreadPool& operator=(const ThreadPool& other) = delete;
+
+		bool _run_one();
+
+		std::vector<std::thread> _workers;
+		std::queue<std::function<void()>> _tasks;
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		bool _is_stopping = false;
+};
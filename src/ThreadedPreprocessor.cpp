@@ -0,0 +1,80 @@
+#include "ThreadedPreprocessor.h"
+
+namespace {
+	// how many chunks of tokens can be waiting to be read
+	const size_t kQueuedRunCount = 64;
+}
+
+ThreadedPreprocessor::ThreadedPreprocessor(SourceManager& sources) : _preprocessor(sources), _tokens(sources, this), _runs(kQueuedRunCount) {
+}
+
+ThreadedPreprocessor::~ThreadedPreprocessor() {
+	_stop();
+}
+
+bool ThreadedPreprocessor::define(const std::string& definition) {
+	return _preprocessor.define(definition);
+}
+
+bool ThreadedPreprocessor::process_file(const char* filename) {
+	if (!_preprocessor.process_file(filename)) {
+		return false;
+	}
+	_thread = std::thread([this]() { _run(); });
+	return true;
+}
+
+bool ThreadedPreprocessor::failed() {
+	_stop();
+	return _preprocessor.failed();
+}
+
+TokenBuffer& ThreadedPreprocessor::tokens() {
+	return _tokens;
+}
+
+bool ThreadedPreprocessor::produce() {
+	// once the thread's been stopped, the end of the tokens may never be pushed
+	if (_is_finished || _is_stopping) {
+		return false;
+	}
+
+	TokenRun run;
+	_runs.pop(run);
+
+	if (run.tokens.empty()) {
+		_is_finished = true;
+		return false;
+	}
+
+	_tokens.append(run);
+	return true;
+}
+
+void ThreadedPreprocessor::_run() {
+	TokenBuffer& tokens = _preprocessor.tokens();
+	size_t begin = 0;
+
+	while (!_is_stopping && _preprocessor.produce()) {
+		if (tokens.size() == begin) {
+			continue;
+		}
+
+		if (!_runs.push(tokens.copy(begin, tokens.size()), &_is_stopping)) {
+			return;
+		}
+
+		// nothing reads the preprocessor's own buffer
+		begin = tokens.size();
+		tokens.release(begin);
+	}
+
+	_runs.push(TokenRun(), &_is_stopping);
+}
+
+void ThreadedPreprocessor::_stop() {
+	if (_thread.joinable()) {
+		_is_stopping = true;
+		_thread.join();
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Preprocessor.h"
+#include "SPSCQueue.h"
+#include "TokenBuffer.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+/**
+* Runs a preprocessor on its own thread, handing its tokens over in chunks as they're produced so that whoever reads
+* them can work at the same time.
+*/
+class ThreadedPreprocessor : public TokenProducer {
+	public:
+		ThreadedPreprocessor(SourceManager& sources);
+		~ThreadedPreprocessor();
+
+		/**
+		* See Preprocessor::define.
+		*/
+		bool define(const std::string& definition);
+
+		/**
+		* Loads the file and starts producing its tokens.
+		*/
+		bool process_file(const char* filename);
+
+		/**
+		* Whether producing the tokens failed. Stops the preprocessor if it's still going.
+		*/
+		bool failed();
+
+		TokenBuffer& tokens();
+
+		virtual bool produce() override;
+
+	private:
+		Preprocessor _preprocessor;
+		TokenBuffer _tokens;
+
+		// an empty run marks the end of the tokens
+		SPSCQueue<TokenRun> _runs;
+		bool _is_finished = false;
+
+		std::thread _thread;
+		std::atomic<bool> _is_stopping{false};
+
+		void _run();
+		void _stop();
+};
@@ -1,9 +1,8 @@
 #pragma once
 
-#include <memory>
-#include <string>
+#include <cstdint>
 
-enum TokenType {
+enum TokenType : uint8_t {
 	TokenTypeIdentifier,
 	TokenTypeNumber,
 	TokenTypeCharacterConstant,
@@ -16,15 +15,3 @@ enum TokenType {
 enum TokenFlag {
 	TokenFlagLineFirst = 1,
 };
-
-class Token {
-	public:
-		virtual TokenType type() = 0;
-		virtual uint32_t flags() = 0;
-		virtual const std::string value() = 0;
-		virtual void print_pointer() {}
-
-		virtual ~Token() {}
-};
-
-typedef std::shared_ptr<Token> TokenPtr;
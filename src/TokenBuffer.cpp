@@ -0,0 +1,129 @@
+#include "TokenBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	/**
+	* Keywords make up a good share of identifiers, and their symbols can be looked up by kind instead of hashed.
+	*/
+	struct KeywordSymbols {
+		KeywordSymbols() {
+			for (unsigned kind = 1; kind < TokenKindCount; ++kind) {
+				auto spelling = token_kind_spelling((TokenKind)kind);
+				symbols[kind] = Symbol(spelling, strlen(spelling));
+			}
+		}
+
+		Symbol symbols[TokenKindCount];
+	};
+
+	// releasing is put off until it'd free at least this many tokens and at least half of the window
+	const size_t kMinimumRelease = 4096;
+}
+
+void TokenBuffer::release(size_t index) {
+	index = std::min(index, _pinned);
+	if (index <= _released) {
+		return;
+	}
+
+	size_t count = index - _released;
+	if (count < kMinimumRelease || count * 2 < _tokens.size()) {
+		return;
+	}
+
+	// values are added in the same order as their tokens, so the first one still needed is the first remaining
+	// token's
+	size_t values = _released_values + _values.size();
+	for (size_t i = count; i < _tokens.size(); ++i) {
+		if (_has_value(_tokens[i])) {
+			values = _tokens[i].symbol;
+			break;
+		}
+	}
+
+	_tokens.erase(_tokens.begin(), _tokens.begin() + count);
+	_released = index;
+	_values.erase(_values.begin(), _values.begin() + (values - _released_values));
+	_released_values = values;
+}
+
+bool TokenBuffer::_produce(size_t index) {
+	while (index >= size()) {
+		if (!_producer || !_producer->produce()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void TokenBuffer::push_back(uint32_t file, const TokenRange& range) {
+	TokenRecord token;
+	token.type = range.type;
+	token.flags = range.flags;
+	token.kind = range.kind;
+	token.reserved = 0;
+	token.file = file;
+	token.location = range.location;
+	token.length = range.length;
+
+	if (range.type == TokenTypeIdentifier) {
+		static const KeywordSymbols keywords;
+		token.symbol = _released_values + _values.size();
+		if (range.kind != TokenKindNone) {
+			_values.push_back(keywords.symbols[range.kind]);
+		} else {
+			_values.emplace_back(_sources.file(file).contents() + range.location, range.length);
+		}
+	}
+
+	_tokens.push_back(token);
+}
+
+void TokenBuffer::push_back_literal(uint32_t file, const TokenRange& range, const std::string& value) {
+	push_back(file, range);
+	_tokens.back().literal = _released_values + _values.size();
+	_values.emplace_back(value);
+}
+
+TokenRun TokenBuffer::copy(size_t begin, size_t end) const {
+	TokenRun run;
+	run.tokens.assign(_tokens.begin() + (begin - _released), _tokens.begin() + (end - _released));
+	for (auto& token : run.tokens) {
+		if (_has_value(token)) {
+			run.values.push_back(_values[token.symbol - _released_values]);
+			token.symbol = run.values.size() - 1;
+		}
+	}
+	return run;
+}
+
+void TokenBuffer::append(const TokenRun& run) {
+	size_t values = _released_values + _values.size();
+	if (_tokens.capacity() < _tokens.size() + run.tokens.size()) {
+		// still grown geometrically, since the same file's tokens might be appended over and over
+		_tokens.reserve(std::max(_tokens.capacity() * 2, _tokens.size() + run.tokens.size()));
+	}
+	for (auto token : run.tokens) {
+		if (_has_value(token)) {
+			token.symbol += values;
+		}
+		_tokens.push_back(token);
+	}
+	_values.insert(_values.end(), run.values.begin(), run.values.end());
+}
+
+std::string TokenBuffer::value(const TokenRecord& token) const {
+	if (_has_value(token)) {
+		return _values[token.symbol - _released_values].str();
+	}
+	return std::string(_sources.file(token.file).contents() + token.location, token.length);
+}
+
+Symbol TokenBuffer::symbol(const TokenRecord& token) const {
+	if (_has_value(token)) {
+		return _values[token.symbol - _released_values];
+	}
+	return Symbol(value(token));
+}
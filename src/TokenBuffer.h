@@ -0,0 +1,142 @@
+#pragma once
+
+#include "Token.h"
+#include "TokenKind.h"
+#include "SourceManager.h"
+#include "Symbol.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+* A preprocessed token. Kept to 16 bytes so that a whole program's worth of them can be stored contiguously.
+*/
+struct TokenRecord {
+	TokenType type;
+	uint8_t flags;
+	TokenKind kind;
+	uint8_t reserved;
+	uint32_t file;            // id of the file in the source manager
+	uint32_t location;        // offset of the token in its file
+
+	union {
+		uint32_t length;      // length of the token's text
+		uint32_t literal;     // string literals and character constants: index of the decoded value in the buffer
+		uint32_t symbol;      // identifiers: index of the interned name in the buffer
+	};
+};
+
+static_assert(sizeof(TokenRecord) == 16, "token records should be 16 bytes");
+
+/**
+* Produces tokens for a TokenBuffer as they're asked for.
+*/
+class TokenProducer {
+	public:
+		virtual ~TokenProducer() {}
+
+		/**
+		* Appends more tokens to the buffer. Returns false once there are no more to come.
+		*/
+		virtual bool produce() = 0;
+};
+
+/**
+* A copy of a run of tokens, along with the values they refer to, that can be appended to a buffer again.
+*/
+struct TokenRun {
+	std::vector<TokenRecord> tokens;
+	std::vector<Symbol> values;
+};
+
+/**
+* The preprocessor's output: the tokens of every file it processed, in order, along with the decoded values of
+* their literals. The files themselves belong to the source manager.
+*
+* Tokens are produced as they're read, and the reader releases them once it's done with them, so only a window of
+* them is kept at a time. Indices count every token that's ever been added.
+*/
+class TokenBuffer {
+	public:
+		TokenBuffer(SourceManager& sources, TokenProducer* producer = nullptr) : _sources(sources), _producer(producer) {}
+
+		/**
+		* The number of tokens added so far, including released ones.
+		*/
+		size_t size() const { return _released + _tokens.size(); }
+
+		/**
+		* Returns the token at `index`, producing tokens up to it if needed, or nullptr if there aren't that many.
+		* The pointer is only good until the next call. The token must not have been released.
+		*/
+		const TokenRecord* at(size_t index) {
+			return index < size() || _produce(index) ? &_tokens[index - _released] : nullptr;
+		}
+
+		/**
+		* Lets the buffer free the tokens before `index`. Tokens from `pin()` on are kept regardless.
+		*/
+		void release(size_t index);
+
+		/**
+		* Keeps the tokens from `index` on until unpinned, so that they can be copied.
+		*/
+		void pin(size_t index) { _pinned = index; }
+		void unpin() { _pinned = SIZE_MAX; }
+
+		/**
+		* Appends a token from one of the source manager's files. Identifiers are interned as they're added.
+		*/
+		void push_back(uint32_t file, const TokenRange& range);
+
+		/**
+		* Appends a string literal or character constant whose text is replaced by its decoded value.
+		*/
+		void push_back_literal(uint32_t file, const TokenRange& range, const std::string& value);
+
+		/**
+		* Copies the tokens in [begin, end), which must not have been released.
+		*/
+		TokenRun copy(size_t begin, size_t end) const;
+
+		/**
+		* Appends a copy of a run of tokens.
+		*/
+		void append(const TokenRun& run);
+
+		/**
+		* The token's text, or for literals, its decoded value.
+		*/
+		std::string value(const TokenRecord& token) const;
+
+		/**
+		* The token's value as a symbol. Free for identifiers and literals, which were interned when they were added.
+		*/
+		Symbol symbol(const TokenRecord& token) const;
+
+		SourceLocation location(const TokenRecord& token) const { return SourceLocation(token.file, token.location); }
+
+		SourceManager& sources() const { return _sources; }
+
+	private:
+		SourceManager& _sources;
+		TokenProducer* _producer;
+
+		std::vector<TokenRecord> _tokens;
+		size_t _released = 0;         // the index of the first token in _tokens
+		size_t _pinned = SIZE_MAX;
+
+		// the interned names of identifiers and values of literals, in the same order as the tokens they belong to
+		std::vector<Symbol> _values;
+		size_t _released_values = 0;
+
+		/**
+		* Produces tokens until there's one at `index`. Returns false if there won't be.
+		*/
+		bool _produce(size_t index);
+
+		static bool _has_value(const TokenRecord& token) {
+			return token.type == TokenTypeIdentifier || token.type == TokenTypeStringLiteral || token.type == TokenTypeCharacterConstant;
+		}
+};
@@ -0,0 +1,61 @@
+#include "TokenKind.h"
+
+#include <cstring>
+
+namespace {
+	const char* const spellings[TokenKindCount] = {
+		"",
+#define TOKEN_KIND_SPELLING(name, spelling) spelling,
+		TOKEN_KIND_KEYWORDS(TOKEN_KIND_SPELLING)
+		TOKEN_KIND_PUNCTUATORS(TOKEN_KIND_SPELLING)
+#undef TOKEN_KIND_SPELLING
+	};
+
+	inline unsigned kind_hash(const char* text, size_t size) {
+		return (unsigned)(size * 31 + (unsigned char)text[0] * 7 + (unsigned char)text[size - 1] * 3);
+	}
+
+	/**
+	* Open addressing table of every kind by spelling. Small enough that probes rarely go past the first slot.
+	*/
+	struct KindTable {
+		static const unsigned kSize = 256;
+
+		KindTable() {
+			memset(slots, 0, sizeof(slots));
+			for (unsigned kind = 1; kind < TokenKindCount; ++kind) {
+				unsigned i = kind_hash(spellings[kind], strlen(spellings[kind])) % kSize;
+				while (slots[i]) {
+					i = (i + 1) % kSize;
+				}
+				slots[i] = (TokenKind)kind;
+			}
+		}
+
+		TokenKind find(const char* text, size_t size) const {
+			for (unsigned i = kind_hash(text, size) % kSize; slots[i]; i = (i + 1) % kSize) {
+				const char* spelling = spellings[slots[i]];
+				if (!strncmp(spelling, text, size) && !spelling[size]) {
+					return slots[i];
+				}
+			}
+			return TokenKindNone;
+		}
+
+		TokenKind slots[kSize];
+	};
+}
+
+TokenKind token_kind(TokenType type, const char* text, size_t size) {
+	// no keyword or punctuator is longer than "static_cast"
+	if ((type != TokenTypeIdentifier && type != TokenTypePunctuator) || !size || size > 11) {
+		return TokenKindNone;
+	}
+
+	static const KindTable table;
+	return table.find(text, size);
+}
+
+const char* token_kind_spelling(TokenKind kind) {
+	return kind < TokenKindCount ? spellings[kind] : "";
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Token.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+* Keywords and punctuators, as (name, spelling) pairs. Keywords include the built-in type names.
+*/
+#define TOKEN_KIND_KEYWORDS(X) \
+	X(KeywordAsm, "asm") \
+	X(KeywordAuto, "auto") \
+	X(KeywordBool, "bool") \
+	X(KeywordClass, "class") \
+	X(KeywordConst, "const") \
+	X(KeywordDouble, "double") \
+	X(KeywordElse, "else") \
+	X(KeywordExtern, "extern") \
+	X(KeywordIf, "if") \
+	X(KeywordImport, "import") \
+	X(KeywordInt8, "int8") \
+	X(KeywordInt32, "int32") \
+	X(KeywordInt64, "int64") \
+	X(KeywordNamespace, "namespace") \
+	X(KeywordNullptr, "nullptr") \
+	X(KeywordReturn, "return") \
+	X(KeywordStatic, "static") \
+	X(KeywordStaticCast, "static_cast") \
+	X(KeywordUInt8, "uint8") \
+	X(KeywordUInt32, "uint32") \
+	X(KeywordUInt64, "uint64") \
+	X(KeywordVoid, "void") \
+	X(KeywordWhile, "while")
+
+#define TOKEN_KIND_PUNCTUATORS(X) \
+	X(OpenBracket, "[") \
+	X(CloseBracket, "]") \
+	X(OpenParen, "(") \
+	X(CloseParen, ")") \
+	X(OpenBrace, "{") \
+	X(CloseBrace, "}") \
+	X(Period, ".") \
+	X(Arrow, "->") \
+	X(Increment, "++") \
+	X(Decrement, "--") \
+	X(Ampersand, "&") \
+	X(Asterisk, "*") \
+	X(Plus, "+") \
+	X(Minus, "-") \
+	X(Tilde, "~") \
+	X(Exclamation, "!") \
+	X(Slash, "/") \
+	X(Percent, "%") \
+	X(ShiftLeft, "<<") \
+	X(ShiftRight, ">>") \
+	X(LessThan, "<") \
+	X(GreaterThan, ">") \
+	X(LessThanOrEqual, "<=") \
+	X(GreaterThanOrEqual, ">=") \
+	X(Equality, "==") \
+	X(Inequality, "!=") \
+	X(Caret, "^") \
+	X(Pipe, "|") \
+	X(LogicalAnd, "&&") \
+	X(LogicalOr, "||") \
+	X(Question, "?") \
+	X(Colon, ":") \
+	X(Semicolon, ";") \
+	X(Ellipsis, "...") \
+	X(Assignment, "=") \
+	X(MultiplyAssignment, "*=") \
+	X(DivideAssignment, "/=") \
+	X(ModuloAssignment, "%=") \
+	X(AddAssignment, "+=") \
+	X(SubtractAssignment, "-=") \
+	X(ShiftLeftAssignment, "<<=") \
+	X(ShiftRightAssignment, ">>=") \
+	X(AndAssignment, "&=") \
+	X(XorAssignment, "^=") \
+	X(OrAssignment, "|=") \
+	X(Comma, ",") \
+	X(Hash, "#") \
+	X(HashHash, "##") \
+	X(NamespaceDelimiter, "::") \
+	X(PeriodAsterisk, ".*") \
+	X(ArrowAsterisk, "->*") \
+	X(DigraphOpenBracket, "<:") \
+	X(DigraphCloseBracket, ":>") \
+	X(DigraphOpenBrace, "<%") \
+	X(DigraphCloseBrace, "%>") \
+	X(DigraphHash, "%:") \
+	X(DigraphHashHash, "%:%:")
+
+/**
+* A small integer identifying a token's keyword or punctuator, assigned when a file is lexed so that the parser
+* doesn't have to compare strings.
+*/
+enum TokenKind : uint8_t {
+	TokenKindNone,
+
+#define TOKEN_KIND_ENUMERATOR(name, spelling) TokenKind##name,
+	TOKEN_KIND_KEYWORDS(TOKEN_KIND_ENUMERATOR)
+	TOKEN_KIND_PUNCTUATORS(TOKEN_KIND_ENUMERATOR)
+#undef TOKEN_KIND_ENUMERATOR
+
+	TokenKindCount,
+};
+
+/**
+* Returns the kind of a token given its type and text. Identifiers that aren't keywords and tokens of any other type
+* are TokenKindNone.
+*/
+TokenKind token_kind(TokenType type, const char* text, size_t size);
+
+inline bool token_kind_is_keyword(TokenKind kind) {
+	return kind >= TokenKindKeywordAsm && kind <= TokenKindKeywordWhile;
+}
+
+const char* token_kind_spelling(TokenKind kind);
@@ -1,35 +1,152 @@
 #include <stdio.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
 
 #include "Preprocessor.h"
+#include "ThreadedPreprocessor.h"
 #include "Parser.h"
 #include "LLVMCodeGenerator.h"
 
+namespace {
+	/**
+	* Preprocesses and parses a file with either kind of preprocessor. Returns false if preprocessing failed, in which
+	* case the error has been printed and whatever was parsed is still left in `ast`.
+	*/
+	template <class P>
+	bool parse(P& pp, Parser& p, const char* filename, const std::vector<const char*>& definitions, ASTSequence** ast) {
+		for (const char* definition : definitions) {
+			if (!pp.define(definition)) {
+				return false;
+			}
+		}
+
+		if (!pp.process_file(filename)) {
+			printf("Couldn't preprocess file.\n");
+			return false;
+		}
+
+		// the parser pulls the preprocessed tokens as it goes
+
+		*ast = p.generate_ast(pp.tokens());
+
+		if (pp.failed()) {
+			printf("Couldn't preprocess file.\n");
+			return false;
+		}
+
+		return true;
+	}
+}
+
 int main(int argc, char* argv[]) {
-	if (argc < 2) {
-		printf("Usage: %s in [out]\n", argv[0]);
+	SourceManager sources;
+	std::vector<const char*> files;
+	std::vector<const char*> definitions;
+	bool is_pipelined = false;
+	bool is_lazy = false;
+	bool is_precompiled = false;
+
+	for (int i = 1; i < argc; ++i) {
+		// -D, -I, and -M take an argument, either attached or as the next argument
+		if (!strncmp(argv[i], "-D", 2)) {
+			const char* definition = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : nullptr);
+			if (!definition) {
+				files.clear();
+				break;
+			}
+			definitions.push_back(definition);
+		} else if (!strncmp(argv[i], "-I", 2) || !strncmp(argv[i], "-M", 2)) {
+			bool is_include_path = (argv[i][1] == 'I');
+			const char* directory = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : nullptr);
+			if (!directory) {
+				files.clear();
+				break;
+			}
+			if (is_include_path) {
+				sources.add_include_path(directory);
+			} else {
+				sources.add_module_path(directory);
+			}
+		} else if (!strcmp(argv[i], "-p")) {
+			// preprocess, parse, and generate code on separate threads
+			is_pipelined = true;
+		} else if (!strcmp(argv[i], "-l")) {
+			// only parse the imported function bodies that are used
+			is_lazy = true;
+		} else if (!strcmp(argv[i], "-m")) {
+			// import modules from precompiled modules, saving any that are missing or out of date
+			is_precompiled = true;
+		} else {
+			files.push_back(argv[i]);
+		}
+	}
+
+	if (files.empty() || files.size() > 2) {
+		printf("Usage: %s [-l] [-m] [-p] [-D name[=value]]... [-I dir]... [-M dir]... in [out]\n", argv[0]);
 		return 1;
 	}
 	
-	// PREPROCESS
+	// PREPROCESS AND PARSE
 
-	Preprocessor pp;
+	Parser p;
+	p.set_lazy_imports(is_lazy);
+	p.set_precompiled_modules(is_precompiled);
+	LLVMCodeGenerator cg;
+	ASTSequence* ast = nullptr;
 
-	if (!pp.process_file(argv[1])) {
-		printf("Couldn't preprocess file.\n");
-		return 1;
-	}
+	if (is_pipelined) {
+		// top-level statements are handed to a code generation thread as soon as they're parsed
+		SPSCQueue<ASTNode*> statements(1024);
 
-	// PARSE
+		std::thread generator([&]() {
+			ASTNode* node = nullptr;
+			while (statements.pop(node), node) {
+				cg.add_ir(node);
+			}
+		});
 
-	Parser p;
-	
-	ASTSequence* ast = p.generate_ast(pp.tokens());
+		auto finish_generating = [&]() {
+			if (generator.joinable()) {
+				statements.push(nullptr);
+				generator.join();
+			}
+		};
+
+		p.set_statement_handler([&](ASTNode* node) {
+			if (node) {
+				statements.push(std::move(node));
+			} else {
+				finish_generating();
+			}
+		});
+
+		ThreadedPreprocessor pp(sources);
+		bool success = parse(pp, p, files[0], definitions, &ast);
+
+		finish_generating();
+
+		if (!success) {
+			delete ast;
+			return 1;
+		}
+	} else {
+		Preprocessor pp(sources);
+
+		if (!parse(pp, p, files[0], definitions, &ast)) {
+			delete ast;
+			return 1;
+		}
+
+		// whatever's left of the preprocessed tokens goes away with the preprocessor, but the sources stay for
+		// diagnostics
+	}
 	
 	if (p.errors().size() > 0) {
 		delete ast;
 		for (const ParseError& e : p.errors()) {
-			printf("Error: %s\n", e.message.c_str());
-			e.token->print_pointer();
+			e.print(sources);
 		}
 		return 1;
 	}
@@ -39,20 +156,20 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
+	// the dump is indented by depth, so like code generation it recurses and isn't meant for huge machine-generated
+	// expressions
 	ast->print();
 
 	// GENERATE CODE
 
-	LLVMCodeGenerator cg;
-	
-	if (!cg.build_ir(ast)) {
+	if (!(is_pipelined ? cg.finish_ir() : cg.build_ir(ast))) {
 		printf("Couldn't build IR.\n");
 		delete ast;
 		return 1;
 	}
 	
-	if (argc >= 3) {
-		cg.write_executable(argv[2]);
+	if (files.size() > 1) {
+		cg.write_executable(files[1]);
 	}
 	
 	delete ast;
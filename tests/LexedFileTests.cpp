@@ -0,0 +1,144 @@
+#include "Test.h"
+
+#include "LexedFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	/**
+	* Checks that an edited file has the same tokens and lines as a file with its contents that was lexed from
+	* scratch.
+	*/
+	void check_matches_full_lex(LexedFile& edited) {
+		std::string contents(edited.contents(), edited.size());
+		TemporaryFile file(contents);
+		LexedFile lexed(file.path());
+		TEST_ASSERT(lexed.lex());
+
+		auto& a = edited.tokens();
+		auto& b = lexed.tokens();
+		TEST_ASSERT(a.size() == b.size());
+		for (size_t i = 0; i < a.size(); ++i) {
+			TEST_ASSERT(a[i].type == b[i].type && a[i].flags == b[i].flags && a[i].kind == b[i].kind);
+			TEST_ASSERT(a[i].location == b[i].location && a[i].length == b[i].length);
+		}
+
+		size_t lines = 0, column = 0, other_lines = 0, other_column = 0;
+		edited.line_column(edited.size(), &lines, &column);
+		lexed.line_column(lexed.size(), &other_lines, &other_column);
+		TEST_ASSERT(lines == other_lines && column == other_column);
+
+		for (size_t line = 1; line <= lines; ++line) {
+			TEST_ASSERT(edited.line_start(line) == lexed.line_start(line));
+			TEST_ASSERT(edited.line_end(line) == lexed.line_end(line));
+		}
+	}
+
+	/**
+	* Random insertions, removals, and replacements of the pieces that change the lexer's state have to leave the
+	* tokens and line starts exactly as lexing the whole file again would. Files are checked every few edits, so that
+	* edits build on earlier ones that haven't been put back together yet, and some are big enough to be split into
+	* several chunks.
+	*/
+	void test_edits_match_full_lex() {
+		static const char* pieces[] = {
+			" ", "\t", "\n", "\r\n", "\r", "\\", "/*", "*/", "*", "/", "//", "\"", "'", "a", "abc_123", "0x1f", "1.5e+3",
+			"+", "->", "<=", "==", "{", "}", ";", "int64 x = y + z;\n", "/* comment\nover lines */", "\"a\\\"b\"",
+		};
+
+		std::mt19937 random(3);
+		std::uniform_int_distribution<size_t> piece(0, sizeof(pieces) / sizeof(*pieces) - 1);
+		std::uniform_int_distribution<size_t> piece_count(0, 4);
+
+		auto random_text = [&]() {
+			std::string text;
+			for (size_t i = piece_count(random); i > 0; --i) {
+				text += pieces[piece(random)];
+			}
+			return text;
+		};
+
+		for (size_t round = 0; round < 50; ++round) {
+			std::string contents;
+			for (size_t i = 0, count = (round % 5) ? 100 : 3000; i < count; ++i) {
+				contents += random_text();
+			}
+
+			TemporaryFile file(contents);
+			LexedFile edited(file.path());
+			TEST_ASSERT(edited.lex());
+
+			for (size_t i = 0; i < 100; ++i) {
+				size_t offset = std::uniform_int_distribution<size_t>(0, edited.size())(random);
+				size_t removed = std::uniform_int_distribution<size_t>(0, std::min<size_t>(edited.size() - offset, 20))(random);
+				auto text = random_text();
+				TEST_ASSERT(edited.edit(offset, removed, text.data(), text.size()));
+				if (i % 5 == 4) {
+					check_matches_full_lex(edited);
+				}
+			}
+		}
+	}
+
+	/**
+	* Returns the fastest of a few runs of typing and deleting in the middle of a file of `size` bytes, in seconds per
+	* edit.
+	*/
+	double edit_time(size_t size) {
+		std::string contents;
+		while (contents.size() < size) {
+			contents += "int64 x = y + z; // a comment\n";
+		}
+		TemporaryFile file(contents);
+
+		const size_t edits = 2000;
+		double fastest = 0.0;
+
+		for (int run = 0; run < 3; ++run) {
+			LexedFile edited(file.path());
+			TEST_ASSERT(edited.lex());
+
+			auto start = std::chrono::steady_clock::now();
+			size_t cursor = size / 2;
+			for (size_t i = 0; i < edits; ++i) {
+				if (i % 5 == 4) {
+					TEST_ASSERT(edited.edit(--cursor, 1, nullptr, 0));
+				} else {
+					TEST_ASSERT(edited.edit(cursor++, 0, "a;\n" + i % 3, 1));
+				}
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / edits;
+			fastest = run ? std::min(fastest, seconds) : seconds;
+
+			check_matches_full_lex(edited);
+		}
+
+		return fastest;
+	}
+
+	/**
+	* Edits only touch the text, tokens, and line starts near them, so they take about as long in a big file as in a
+	* small one. Copying or moving everything after each edit would make the big file's take 64 times as long.
+	*/
+	void test_edit_time_is_independent_of_size() {
+		double small = edit_time(64 * 1024);
+		double big = edit_time(4 * 1024 * 1024);
+		if (big > small * 4) {
+			printf("%.2f us per edit in 64KB, %.2f us in 4MB\n", small * 1e6, big * 1e6);
+		}
+		TEST_ASSERT(big <= small * 4);
+	}
+}
+
+int main() {
+	test_edits_match_full_lex();
+	test_edit_time_is_independent_of_size();
+	printf("lexed file tests passed\n");
+	return 0;
+}
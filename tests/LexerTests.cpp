@@ -0,0 +1,210 @@
+#include "Test.h"
+
+#include "Lexer.h"
+#include "ThreadPool.h"
+
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	/**
+	* Lexes `input` from a buffer of exactly its size, so that reading past the end can be caught by sanitizers.
+	*/
+	std::vector<TokenRange> lex(Lexer& lexer, const std::string& input) {
+		std::unique_ptr<char[]> buffer(new char[input.size()]);
+		memcpy(buffer.get(), input.data(), input.size());
+		std::vector<TokenRange> tokens;
+		TEST_ASSERT(lexer.lex(buffer.get(), input.size(), tokens));
+		return tokens;
+	}
+
+	bool same_tokens(const std::vector<TokenRange>& a, const std::vector<TokenRange>& b) {
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); ++i) {
+			if (a[i].type != b[i].type || a[i].flags != b[i].flags || a[i].kind != b[i].kind || a[i].location != b[i].location || a[i].length != b[i].length) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	* Runs that start at every offset around the kernels' 16 and 32 byte blocks and end at every offset around them,
+	* many of them at the end of the input.
+	*/
+	std::vector<std::string> boundary_inputs() {
+		static const size_t lengths[] = {0, 1, 2, 14, 15, 16, 17, 30, 31, 32, 33, 47, 63, 64, 65, 100};
+
+		std::vector<std::string> inputs;
+
+		for (size_t pad = 0; pad <= 70; ++pad) {
+			std::string prefix(pad, ' ');
+			for (size_t length : lengths) {
+				std::string body(length, 'x');
+				std::string blanks;
+				for (size_t i = 0; i < length; ++i) {
+					blanks += (i % 3) ? ' ' : '\t';
+				}
+
+				inputs.push_back(prefix + "/*" + body + "*/ a");
+				inputs.push_back(prefix + "/*" + body + "*/");
+				inputs.push_back(prefix + "/*" + body);
+				inputs.push_back(prefix + "/*" + body + "*");
+				inputs.push_back(prefix + "/*" + body + "**/" + body);
+				inputs.push_back(prefix + "//" + body + "\na");
+				inputs.push_back(prefix + "//" + body);
+				inputs.push_back(prefix + "//" + body + "\\\n" + body + "\nb");
+				inputs.push_back(prefix + "//" + body + "\r\n" + body);
+				inputs.push_back(prefix + "\"" + body + "\" a");
+				inputs.push_back(prefix + "\"" + body + "\"");
+				inputs.push_back(prefix + "\"" + body + "\\\"" + body + "\"");
+				inputs.push_back(prefix + "\"" + body);
+				inputs.push_back(prefix + "\"" + body + "\\");
+				inputs.push_back(prefix + "'" + body + "'");
+				inputs.push_back(prefix + "'" + body + "\\'" + body);
+				inputs.push_back(prefix + "a" + body + " b");
+				inputs.push_back(prefix + "a" + body);
+				inputs.push_back(prefix + "a" + body + "->b");
+				inputs.push_back(prefix + "a" + blanks + "b");
+				inputs.push_back(prefix + "a" + blanks);
+				inputs.push_back(prefix + "a" + blanks + "\r\n" + blanks + "b");
+				inputs.push_back(prefix + "1" + body + "e+5" + blanks);
+			}
+		}
+
+		return inputs;
+	}
+
+	/**
+	* Random mixes of the pieces that change the lexer's state.
+	*/
+	std::vector<std::string> random_inputs(size_t count) {
+		static const char* pieces[] = {
+			" ", "   ", "\t", "\n", "\r\n", "\r", "\\", "\\\n", "/*", "*/", "*", "/", "//", "\"", "'", "\\\"",
+			"a", "abc_123", "_", "0", "0x1f", "1.5e+3", "+", "->", "<=", "==", "!", "{", "}", "(", ")", ";", "#", "@",
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", "                                ", "\0",
+		};
+
+		std::mt19937 random(1);
+		std::uniform_int_distribution<size_t> piece_count(0, 200);
+		std::uniform_int_distribution<size_t> piece(0, sizeof(pieces) / sizeof(*pieces) - 1);
+
+		std::vector<std::string> inputs;
+
+		for (size_t i = 0; i < count; ++i) {
+			std::string input;
+			for (size_t j = piece_count(random); j > 0; --j) {
+				auto p = pieces[piece(random)];
+				input.append(p, *p ? strlen(p) : 1);
+			}
+			inputs.push_back(input);
+		}
+
+		return inputs;
+	}
+
+	/**
+	* The vector kernels have to produce exactly the same tokens as the scalar ones.
+	*/
+	void test_kernels_match_scalar() {
+		auto inputs = boundary_inputs();
+		auto random = random_inputs(5000);
+		inputs.insert(inputs.end(), random.begin(), random.end());
+
+		Lexer scalar(LexerKernelsScalar);
+		TEST_ASSERT(scalar.kernels() == LexerKernelsScalar);
+
+		for (auto kernels : {LexerKernelsSSE2, LexerKernelsAVX2}) {
+			Lexer lexer(kernels);
+			if (lexer.kernels() != kernels) {
+				printf("skipping kernels the cpu doesn't support (%d)\n", (int)kernels);
+				continue;
+			}
+			for (auto& input : inputs) {
+				TEST_ASSERT(same_tokens(lex(lexer, input), lex(scalar, input)));
+			}
+		}
+	}
+
+	/**
+	* Inputs whose newlines are almost all inside a block comment, inside a string literal, inside a line comment
+	* that's continued by escaped newlines, or at the start of an ordinary line, so that wherever lex_parallel splits
+	* them, the split is in that state. Followed by random mixes of all of them.
+	*/
+	std::vector<std::string> multiline_inputs(size_t count) {
+		static const char* lines[] = {
+			"a = b + c;\n",
+			"int64 x = 0x1f; // comment\r\n",
+			"/* a block comment\nthat goes on\n\nfor a few lines */ x\n",
+			"\"a string\nthat goes on \\\" for\r\na few lines\" y\n",
+			"'a\nb'\n",
+			"// a line comment \\\ncontinued \\\r\nand continued\n",
+			"\n",
+			"\t  \n",
+		};
+
+		std::vector<std::string> inputs;
+
+		std::string comment = "/*";
+		std::string literal = "\"";
+		std::string continued = "//";
+		std::string plain;
+		for (size_t i = 0; i < 200; ++i) {
+			comment += " line " + std::to_string(i) + (i % 7 ? " *\n" : " **\r\n");
+			literal += " line " + std::to_string(i) + (i % 5 ? " \\\"\n" : "\r\n");
+			continued += " line " + std::to_string(i) + " \\\n";
+			plain += "x" + std::to_string(i) + " = y;\n";
+		}
+		inputs.push_back(comment + "*/ end");
+		inputs.push_back(comment);
+		inputs.push_back(literal + "\" end");
+		inputs.push_back(literal);
+		inputs.push_back(continued + "\nend");
+		inputs.push_back(continued);
+		inputs.push_back(plain);
+
+		std::mt19937 random(2);
+		std::uniform_int_distribution<size_t> line_count(0, 100);
+		std::uniform_int_distribution<size_t> line(0, sizeof(lines) / sizeof(*lines) - 1);
+
+		for (size_t i = 0; i < count; ++i) {
+			std::string input;
+			for (size_t j = line_count(random); j > 0; --j) {
+				input += lines[line(random)];
+			}
+			inputs.push_back(input);
+		}
+
+		return inputs;
+	}
+
+	/**
+	* Lexing in parallel has to produce exactly the same tokens as lexing serially, regardless of where the chunks
+	* start.
+	*/
+	void test_parallel_matches_serial() {
+		ThreadPool pool(4);
+		Lexer lexer;
+
+		for (auto& input : multiline_inputs(1000)) {
+			auto serial = lex(lexer, input);
+			for (size_t minimum_chunk_size : {1, 16, 100}) {
+				std::vector<TokenRange> parallel;
+				TEST_ASSERT(lexer.lex_parallel(input.data(), input.size(), parallel, pool, minimum_chunk_size));
+				TEST_ASSERT(same_tokens(parallel, serial));
+			}
+		}
+	}
+}
+
+int main() {
+	test_kernels_match_scalar();
+	test_parallel_matches_serial();
+	printf("lexer tests passed\n");
+	return 0;
+}
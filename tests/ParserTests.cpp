@@ -0,0 +1,66 @@
+#include "Test.h"
+
+#include "Parser.h"
+#include "Preprocessor.h"
+
+#include <string>
+
+namespace {
+	/**
+	* Preprocesses and parses a function that returns `expression`, then deletes the AST. Both have to work without
+	* recursing once per operator or per level of nesting.
+	*/
+	void check_parses(const std::string& expression) {
+		TemporaryFile file("int64 f(int64 a) {\n\treturn " + expression + ";\n}\n");
+
+		SourceManager sources;
+		Preprocessor pp(sources);
+		TEST_ASSERT(pp.process_file(file.path()));
+
+		Parser p;
+		ASTSequence* ast = p.generate_ast(pp.tokens());
+		TEST_ASSERT(!pp.failed());
+		TEST_ASSERT(ast);
+		TEST_ASSERT(p.errors().empty());
+
+		delete ast;
+	}
+
+	/**
+	* Machine-generated expressions can be far longer and deeper than anyone would write by hand.
+	*/
+	void test_long_expressions() {
+		const size_t terms = 1000000;
+
+		std::string binary = "a";
+		std::string nested;
+		std::string unary;
+		std::string mixed = "a";
+		for (size_t i = 1; i < terms; ++i) {
+			binary += (i % 3) ? " + a" : " * a";
+			nested += "(";
+			unary += "- ";
+			mixed += (i % 2) ? " - - a" : " + (a * - a)";
+		}
+		nested += "a" + std::string(terms - 1, ')');
+		unary += "a";
+
+		std::string unary_nested;
+		for (size_t i = 0; i < terms / 4; ++i) {
+			unary_nested += "- (a + ";
+		}
+		unary_nested += "a" + std::string(terms / 4, ')');
+
+		check_parses(binary);
+		check_parses(nested);
+		check_parses(unary);
+		check_parses(mixed);
+		check_parses(unary_nested);
+	}
+}
+
+int main() {
+	test_long_expressions();
+	printf("parser tests passed\n");
+	return 0;
+}
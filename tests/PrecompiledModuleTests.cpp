@@ -0,0 +1,163 @@
+#include "Test.h"
+
+#include "Parser.h"
+#include "Preprocessor.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <utime.h>
+
+namespace {
+	/**
+	* A directory of modules, found at "directory/name/name.c3", that's deleted when it goes away.
+	*/
+	class ModuleDirectory {
+		public:
+			ModuleDirectory() {
+				char path[] = "/tmp/c3-test-XXXXXX";
+				TEST_ASSERT(mkdtemp(path));
+				_path = path;
+			}
+
+			~ModuleDirectory() {
+				for (auto& name : _modules) {
+					unlink(source(name).c_str());
+					unlink(artifact(name).c_str());
+					rmdir((_path + '/' + name).c_str());
+				}
+				unlink((_path + "/main.c3").c_str());
+				rmdir(_path.c_str());
+			}
+
+			const std::string& path() const { return _path; }
+
+			std::string source(const std::string& name) const { return _path + '/' + name + '/' + name + ".c3"; }
+			std::string artifact(const std::string& name) const { return source(name) + "m"; }
+
+			void write_module(const std::string& name, const std::string& contents) {
+				mkdir((_path + '/' + name).c_str(), 0700);
+				write(source(name), contents);
+				_modules.push_back(name);
+			}
+
+			void write(const std::string& filename, const std::string& contents) {
+				FILE* file = fopen(filename.c_str(), "w");
+				TEST_ASSERT(file);
+				TEST_ASSERT(fwrite(contents.data(), 1, contents.size(), file) == contents.size());
+				fclose(file);
+			}
+
+		private:
+			std::string _path;
+			std::vector<std::string> _modules;
+	};
+
+	/**
+	* The AST's dump, which is what the compiler prints for it.
+	*/
+	std::string dump(ASTNode* ast) {
+		fflush(stdout);
+		FILE* output = tmpfile();
+		TEST_ASSERT(output);
+		int saved = dup(STDOUT_FILENO);
+		dup2(fileno(output), STDOUT_FILENO);
+		ast->print();
+		fflush(stdout);
+		dup2(saved, STDOUT_FILENO);
+		close(saved);
+
+		std::string contents;
+		rewind(output);
+		char buffer[4096];
+		for (size_t size; (size = fread(buffer, 1, sizeof(buffer), output)) > 0;) {
+			contents.append(buffer, size);
+		}
+		fclose(output);
+		return contents;
+	}
+
+	/**
+	* Parses the directory's main.c3 the way the compiler does, and returns the AST's dump.
+	*/
+	std::string parse(const ModuleDirectory& directory, bool is_precompiled) {
+		SourceManager sources;
+		sources.add_module_path(directory.path());
+
+		Preprocessor pp(sources);
+		TEST_ASSERT(pp.process_file((directory.path() + "/main.c3").c_str()));
+
+		Parser p;
+		p.set_precompiled_modules(is_precompiled);
+		ASTSequence* ast = p.generate_ast(pp.tokens());
+		TEST_ASSERT(!pp.failed());
+		TEST_ASSERT(ast);
+		TEST_ASSERT(p.errors().empty());
+
+		auto contents = dump(ast);
+		delete ast;
+		return contents;
+	}
+
+	/**
+	* Makes the file look like it hasn't been written since 1970, so that writing it again can be noticed.
+	*/
+	void make_old(const std::string& filename) {
+		struct utimbuf times = {0, 0};
+		TEST_ASSERT(!utime(filename.c_str(), &times));
+	}
+
+	bool is_old(const std::string& filename) {
+		struct stat st;
+		TEST_ASSERT(!stat(filename.c_str(), &st));
+		return st.st_mtime == 0;
+	}
+
+	/**
+	* Importing from precompiled modules has to give the same AST as parsing them, and modules have to be saved
+	* again when anything they were made from changes, including the modules they import.
+	*/
+	void test_precompiled_imports_match_parsing() {
+		ModuleDirectory directory;
+		directory.write_module("b", "namespace b {\n\tint64 twice(int64 x) { return x * 2; }\n}\n");
+		directory.write_module("a", "import b;\n\nnamespace a {\n\tint64 four() { return b::twice(2); }\n}\n");
+		directory.write(directory.path() + "/main.c3", "import a;\n\nint64 main() { return a::four(); }\n");
+
+		auto parsed = parse(directory, false);
+		TEST_ASSERT(!parsed.empty());
+
+		// the first import saves the modules
+		TEST_ASSERT(parse(directory, true) == parsed);
+		make_old(directory.artifact("a"));
+		make_old(directory.artifact("b"));
+
+		// the next loads them as they are
+		TEST_ASSERT(parse(directory, true) == parsed);
+		TEST_ASSERT(is_old(directory.artifact("a")));
+		TEST_ASSERT(is_old(directory.artifact("b")));
+
+		// changing the module a imports makes both of them stale
+		directory.write(directory.source("b"), "namespace b {\n\tint64 twice(int64 x) { return x + x; }\n\tint64 once(int64 x) { return x; }\n}\n");
+
+		auto edited = parse(directory, false);
+		TEST_ASSERT(edited != parsed);
+
+		TEST_ASSERT(parse(directory, true) == edited);
+		TEST_ASSERT(!is_old(directory.artifact("a")));
+		TEST_ASSERT(!is_old(directory.artifact("b")));
+
+		make_old(directory.artifact("a"));
+		make_old(directory.artifact("b"));
+		TEST_ASSERT(parse(directory, true) == edited);
+		TEST_ASSERT(is_old(directory.artifact("a")));
+		TEST_ASSERT(is_old(directory.artifact("b")));
+	}
+}
+
+int main() {
+	test_precompiled_imports_match_parsing();
+	printf("precompiled module tests passed\n");
+	return 0;
+}
@@ -0,0 +1,157 @@
+#include "Test.h"
+
+#include "Preprocessor.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+	/**
+	* Preprocesses `source` with the given command line definitions and returns the decoded values of its string
+	* literals and character constants.
+	*/
+	std::vector<std::string> literal_values(const std::string& source, const std::vector<std::string>& definitions = {}) {
+		TemporaryFile file(source);
+
+		SourceManager sources;
+		Preprocessor pp(sources);
+		for (auto& definition : definitions) {
+			TEST_ASSERT(pp.define(definition));
+		}
+		TEST_ASSERT(pp.process_file(file.path()));
+
+		auto& tokens = pp.tokens();
+		std::vector<std::string> values;
+		for (size_t i = 0; auto token = tokens.at(i); ++i) {
+			if (token->type == TokenTypeStringLiteral || token->type == TokenTypeCharacterConstant) {
+				values.push_back(tokens.value(*token));
+			}
+		}
+		TEST_ASSERT(!pp.failed());
+		return values;
+	}
+
+	/**
+	* Hex and octal escapes decode like C's, including ones that are too big for a byte or cut short by the end of
+	* the literal.
+	*/
+	void test_numeric_escapes() {
+		struct {
+			const char* literal;
+			std::string value;
+		} cases[] = {
+			{"\"\\x41\"", "A"},
+			{"\"\\x4a\\x4A\"", "JJ"},
+			{"\"\\x0041z\"", "Az"},
+			{"\"\\x141\"", "A"},                         // too big, truncated to a byte
+			{"\"\\xffffffff41\"", "A"},
+			{"\"\\x4\"", "\x04"},                        // cut short by the end of the literal
+			{"\"\\x4\" \"1\"", "\x04" "1"},              // even if the next literal continues it
+			{"\"\\x\"", "x"},                            // no digits at all
+			{"\"\\xg\"", "xg"},
+			{"\"\\101\"", "A"},
+			{"\"\\1012\"", "A2"},                        // at most three octal digits
+			{"\"\\0\"", std::string(1, '\0')},
+			{"\"\\08\"", std::string(1, '\0') + "8"},
+			{"\"\\18\"", "\x01" "8"},
+			{"\"\\377\"", "\xff"},
+			{"\"\\777\"", "\xff"},                       // too big, truncated to a byte
+			{"\"\\1\"", "\x01"},                         // cut short by the end of the literal
+			{"\"\\8\\9\"", "89"},                        // not octal digits
+			{"'\\x41'", "A"},
+			{"'\\101'", "A"},
+			{"'\\0'", std::string(1, '\0')},
+		};
+
+		for (auto& test : cases) {
+			auto values = literal_values(std::string(test.literal) + ";\n");
+			if (values.size() != 1 || values[0] != test.value) {
+				printf("literal %s\n", test.literal);
+			}
+			TEST_ASSERT(values.size() == 1);
+			TEST_ASSERT(values[0] == test.value);
+		}
+	}
+
+	/**
+	* "-Dname" defines the name as 1, and "-Dname=value" as the value's text, which is substituted into conditions
+	* as is.
+	*/
+	void test_command_line_definitions() {
+		auto values = literal_values(
+			"#if A == 1\n\"a\"\n#endif\n"
+			"#if B * 2 == 8\n\"b\"\n#endif\n"
+			"#if defined(C) && D == 10\n\"c\"\n#endif\n"
+			"#if E == 3\n\"e\"\n#endif\n",
+			{"A", "B=2 + 3", "C=", "D=010", "E=1", "E=3"}
+		);
+		TEST_ASSERT(values == std::vector<std::string>({"a", "b", "c", "e"}));
+
+		SourceManager sources;
+		Preprocessor pp(sources);
+		TEST_ASSERT(!pp.define("1A"));
+		TEST_ASSERT(!pp.define("A B"));
+		TEST_ASSERT(!pp.define("=1"));
+	}
+
+	/**
+	* Including a file again has to give what processing it again would, whether that's repeating an earlier
+	* expansion or not, in every state of the macros and "#pragma once" files it reads.
+	*/
+	void test_repeated_includes() {
+		auto include = [](const TemporaryFile& file) {
+			return "#include \"" + std::string(file.path()) + "\"\n";
+		};
+
+		TemporaryFile tests_x("#ifdef X\n\"x\"\n#else\n\"no x\"\n#endif\n");
+		TEST_ASSERT(literal_values(include(tests_x) + "#define X\n" + include(tests_x) + "#undef X\n" + include(tests_x) + include(tests_x)) ==
+			std::vector<std::string>({"no x", "x", "no x", "no x"}));
+
+		TemporaryFile tests_n("#if N == 1\n\"one\"\n#else\n\"other\"\n#endif\n");
+		TEST_ASSERT(literal_values("#define N 1\n" + include(tests_n) + "#define N 2\n" + include(tests_n) + "#define N 1\n" + include(tests_n)) ==
+			std::vector<std::string>({"one", "other", "one"}));
+
+		// repeating an expansion does what it did to the macros again
+		TemporaryFile defines_y("#define Y 3\n#undef Z\n\"y\"\n");
+		TEST_ASSERT(literal_values("#define Z\n" + include(defines_y) + "#undef Y\n#define Z\n" + include(defines_y) + "#if Y == 3 && !defined(Z)\n\"defined\"\n#endif\n") ==
+			std::vector<std::string>({"y", "y", "defined"}));
+
+		// macros the file defines before testing them aren't read from outside it
+		TemporaryFile defines_w("#define W 1\n#if W\n\"w\"\n#endif\n");
+		TEST_ASSERT(literal_values("#define W 0\n" + include(defines_w) + "#define W 0\n" + include(defines_w)) ==
+			std::vector<std::string>({"w", "w"}));
+
+		// files the file includes can be skipped the next time
+		TemporaryFile once("#pragma once\n\"once\"\n");
+		TemporaryFile includes_once(include(once) + "\"includes once\"\n");
+		TEST_ASSERT(literal_values(include(includes_once) + include(includes_once)) ==
+			std::vector<std::string>({"once", "includes once", "includes once"}));
+
+		TemporaryFile guarded("#ifndef GUARD\n#define GUARD\n\"guarded\"\n#endif\n");
+		TemporaryFile includes_guarded(include(guarded) + "\"includes guarded\"\n");
+		TEST_ASSERT(literal_values(include(includes_guarded) + include(includes_guarded) + "#undef GUARD\n" + include(includes_guarded)) ==
+			std::vector<std::string>({"guarded", "includes guarded", "includes guarded", "guarded", "includes guarded"}));
+
+		// what an included file reads is read by whatever included it too
+		TemporaryFile includes_x(include(tests_x));
+		TEST_ASSERT(literal_values(include(includes_x) + "#define X\n" + include(includes_x) + "#undef X\n" + include(includes_x)) ==
+			std::vector<std::string>({"no x", "x", "no x"}));
+
+		// more states than expansions are kept
+		std::string source;
+		std::vector<std::string> expected;
+		for (int i = 0; i < 20; ++i) {
+			source += "#define N " + std::to_string(i % 10) + "\n" + include(tests_n);
+			expected.push_back(i % 10 == 1 ? "one" : "other");
+		}
+		TEST_ASSERT(literal_values(source) == expected);
+	}
+}
+
+int main() {
+	test_numeric_escapes();
+	test_command_line_definitions();
+	test_repeated_includes();
+	printf("preprocessor tests passed\n");
+	return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+/**
+* Support for the compiler's own unit tests, which are built and run by "make test". Each test is a program that
+* returns 0 if everything passed.
+*/
+
+/**
+* Stops the test with the location and text of `condition` if it's false.
+*/
+#define TEST_ASSERT(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #condition); \
+		exit(1); \
+	} \
+} while (0)
+
+/**
+* A file with the given contents that's deleted when it goes away.
+*/
+class TemporaryFile {
+	public:
+		TemporaryFile(const std::string& contents) {
+			char path[] = "/tmp/c3-test-XXXXXX";
+			int fd = mkstemp(path);
+			TEST_ASSERT(fd >= 0);
+			TEST_ASSERT(write(fd, contents.data(), contents.size()) == (ssize_t)contents.size());
+			close(fd);
+			_path = path;
+		}
+
+		~TemporaryFile() {
+			unlink(_path.c_str());
+		}
+
+		const char* path() const { return _path.c_str(); }
+
+	private:
+		std::string _path;
+};